@@ -0,0 +1,385 @@
+// rife implemented with ncnn library
+
+// microbenchmarks of the cpu kernels, the image codecs and the task queue on synthetic data
+// no model or gpu is needed, every kernel prints one json line with the spread of its runs, see trace_runs
+// timed with ncnn::get_current_time rather than google-benchmark, which the build cannot fetch or vendor next to ncnn
+// every kernel first runs warmup times untimed so that caches, the frame pool and the thread pool are warm
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <algorithm>
+#include <vector>
+
+// ncnn
+#include "benchmark.h"
+#include "cpu.h"
+#include "mat.h"
+#include "option.h"
+#include "platform.h"
+
+#include "filesystem_utils.h"
+#include "image_io.h"
+#include "rife_cpu.h"
+#include "rife_ops.h"
+#include "task_queue.h"
+#include "trace.h"
+
+static void print_usage()
+{
+    fprintf(stderr, "Usage: rife-bench [WxH [loops [threads [warmup]]]]\n\n");
+    fprintf(stderr, "  WxH                  synthetic frame size (default=1920x1080)\n");
+    fprintf(stderr, "  loops                timed runs of every kernel (default=10)\n");
+    fprintf(stderr, "  threads              cpu thread count (default=all cores)\n");
+    fprintf(stderr, "  warmup               untimed runs of every kernel before the timed ones (default=2)\n");
+}
+
+// the preprocessing, tta merges and warp of process_cpu
+static int bench_cpu_kernels(int w, int h, int warmup, int loops, int num_threads, FILE* fp)
+{
+    int w_padded = (w + 31) / 32 * 32;
+    int h_padded = (h + 31) / 32 * 32;
+
+    std::vector<unsigned char> pixels((size_t)w * h * 3);
+    for (size_t i = 0; i < pixels.size(); i++)
+    {
+        pixels[i] = (unsigned char)((i * 2654435761u) >> 24);
+    }
+
+    std::vector<double> ms;
+
+    for (int l = -warmup; l < loops; l++)
+    {
+        ncnn::Mat out;
+        double start = ncnn::get_current_time();
+        preproc_cpu_direction(pixels.data(), w, h, w_padded, h_padded, 0, out, num_threads);
+        if (l >= 0)
+            ms.push_back(ncnn::get_current_time() - start);
+    }
+    trace_runs(fp, "preproc", w, h, ms);
+    ms.clear();
+
+    ncnn::Mat outs[8];
+    for (int l = -warmup; l < loops; l++)
+    {
+        double start = ncnn::get_current_time();
+        preproc_cpu(pixels.data(), w, h, w_padded, h_padded, outs, 8, num_threads);
+        if (l >= 0)
+            ms.push_back(ncnn::get_current_time() - start);
+    }
+    trace_runs(fp, "preproc tta", w, h, ms);
+    ms.clear();
+
+    // one flow pair in every tta direction, the preprocessed directions stand in for the outputs
+    ncnn::Mat flows[8];
+    for (int ti = 0; ti < 8; ti++)
+    {
+        flows[ti] = outs[ti].channel_range(0, 2).clone();
+    }
+
+    ncnn::Mat flow_sum(w_padded, h_padded, 2);
+    for (int l = -warmup; l < loops; l++)
+    {
+        flow_sum.fill(0.f);
+        double start = ncnn::get_current_time();
+        for (int ti = 0; ti < 8; ti++)
+        {
+            tta_flow_accumulate(flows[ti], ti, flow_sum, num_threads);
+        }
+        if (l >= 0)
+            ms.push_back(ncnn::get_current_time() - start);
+    }
+    trace_runs(fp, "tta flow accumulate", w, h, ms);
+    ms.clear();
+
+    for (int l = -warmup; l < loops; l++)
+    {
+        double start = ncnn::get_current_time();
+        for (int ti = 0; ti < 8; ti++)
+        {
+            tta_flow_transform(flow_sum, ti, flows[ti], num_threads);
+        }
+        if (l >= 0)
+            ms.push_back(ncnn::get_current_time() - start);
+    }
+    trace_runs(fp, "tta flow transform", w, h, ms);
+    ms.clear();
+
+    ncnn::Mat out_sum(w, h, 3);
+    for (int l = -warmup; l < loops; l++)
+    {
+        out_sum.fill(0.f);
+        double start = ncnn::get_current_time();
+        for (int ti = 0; ti < 8; ti++)
+        {
+            tta_out_accumulate(outs[ti], ti, w_padded, h_padded, out_sum, num_threads);
+        }
+        if (l >= 0)
+            ms.push_back(ncnn::get_current_time() - start);
+    }
+    trace_runs(fp, "tta out accumulate", w, h, ms);
+    ms.clear();
+
+    // 8 channel feature map along a flow of up to 8 pixels, in each packing the layer sees
+    ncnn::Option opt;
+    opt.num_threads = num_threads;
+    opt.use_vulkan_compute = false;
+
+    Warp warp;
+
+    ncnn::Mat flow(w, h, 2);
+    for (int q = 0; q < 2; q++)
+    {
+        float* ptr = flow.channel(q);
+        for (int i = 0; i < w * h; i++)
+        {
+            ptr[i] = (float)(int)((i * 2654435761u + q) >> 28) - 8.f;
+        }
+    }
+
+    ncnn::Mat image(w, h, 8);
+    for (int q = 0; q < 8; q++)
+    {
+        image.channel(q).fill(q * 0.125f);
+    }
+
+    static const int elempacks[3] = {1, 4, 8};
+    for (int e = 0; e < 3; e++)
+    {
+        std::vector<ncnn::Mat> bottom_blobs(2);
+        ncnn::convert_packing(image, bottom_blobs[0], elempacks[e], opt);
+        bottom_blobs[1] = flow;
+
+        for (int l = -warmup; l < loops; l++)
+        {
+            std::vector<ncnn::Mat> top_blobs(1);
+            double start = ncnn::get_current_time();
+            if (warp.forward(bottom_blobs, top_blobs, opt) != 0)
+                return -1;
+            if (l >= 0)
+                ms.push_back(ncnn::get_current_time() - start);
+        }
+
+        char kernel[32];
+        sprintf(kernel, "warp pack%d", elempacks[e]);
+        trace_runs(fp, kernel, w, h, ms);
+        ms.clear();
+    }
+
+    return 0;
+}
+
+// a fresh directory under the system temp directory for the codec scratch files
+static int create_temp_dir(path_t& dirpath)
+{
+#if _WIN32
+    wchar_t tmp[MAX_PATH];
+    if (GetTempPathW(MAX_PATH, tmp) == 0)
+        return -1;
+
+    wchar_t name[64];
+    swprintf(name, 64, L"rife-bench-%lu", (unsigned long)GetCurrentProcessId());
+
+    dirpath = path_t(tmp) + name;
+    return CreateDirectoryW(dirpath.c_str(), NULL) ? 0 : -1;
+#else
+    const char* tmp = getenv("TMPDIR");
+    std::string templ = std::string(tmp && tmp[0] ? tmp : "/tmp") + "/rife-bench-XXXXXX";
+
+    std::vector<char> buf(templ.begin(), templ.end());
+    buf.push_back('\0');
+    if (!mkdtemp(buf.data()))
+        return -1;
+
+    dirpath = buf.data();
+    return 0;
+#endif
+}
+
+static void remove_dir(const path_t& dirpath)
+{
+#if _WIN32
+    RemoveDirectoryW(dirpath.c_str());
+#else
+    rmdir(dirpath.c_str());
+#endif
+}
+
+// encode and decode of a synthetic frame in every output format, through a scratch file in dirpath
+static int bench_codecs(const path_t& dirpath, int w, int h, int warmup, int loops, FILE* fp)
+{
+    ncnn::Mat image;
+    synthesize_frame(w, h, 0, 0, image);
+
+    static const char* const names[3] = {"png", "jpg", "webp"};
+    const path_t exts[3] = {PATHSTR("png"), PATHSTR("jpg"), PATHSTR("webp")};
+
+    for (int i=0; i<3; i++)
+    {
+        const path_t path = dirpath + PATHSTR("/frame.") + exts[i];
+
+        std::vector<double> encode_ms;
+        std::vector<double> decode_ms;
+        int ret = 0;
+        for (int l=-warmup; l<loops && ret == 0; l++)
+        {
+            double start = ncnn::get_current_time();
+            ret = encode_image(path, image);
+            if (l >= 0)
+                encode_ms.push_back(ncnn::get_current_time() - start);
+
+            if (ret != 0)
+                break;
+
+            ncnn::Mat decoded;
+            start = ncnn::get_current_time();
+            ret = decode_image(path, decoded);
+            if (l >= 0)
+                decode_ms.push_back(ncnn::get_current_time() - start);
+
+            frame_pool_free(decoded.data);
+        }
+
+        remove_file(path);
+
+        if (ret != 0)
+            return -1;
+
+        char kernel[32];
+        sprintf(kernel, "encode %s", names[i]);
+        trace_runs(fp, kernel, w, h, encode_ms);
+        sprintf(kernel, "decode %s", names[i]);
+        trace_runs(fp, kernel, w, h, decode_ms);
+    }
+
+    return 0;
+}
+
+class QueueBenchParams
+{
+public:
+    TaskQueue* queue;
+    int count;
+};
+
+static void* queue_bench_put(void* args)
+{
+    const QueueBenchParams* qbp = (const QueueBenchParams*)args;
+
+    for (int i=0; i<qbp->count; i++)
+    {
+        Task v;
+        v.id = i;
+        qbp->queue->put(v);
+    }
+
+    return 0;
+}
+
+static void* queue_bench_get(void* args)
+{
+    const QueueBenchParams* qbp = (const QueueBenchParams*)args;
+
+    for (int i=0; i<qbp->count; i++)
+    {
+        Task v;
+        qbp->queue->get(v);
+    }
+
+    return 0;
+}
+
+// empty tasks through the default sized queue, with one and with four threads on either side
+static void bench_task_queue(int warmup, int loops, FILE* fp)
+{
+    const int count = 100000;
+
+    static const int threads[2] = {1, 4};
+    for (int i=0; i<2; i++)
+    {
+        std::vector<double> ms;
+        for (int l=-warmup; l<loops; l++)
+        {
+            TaskQueue queue;
+
+            QueueBenchParams qbp;
+            qbp.queue = &queue;
+            qbp.count = count / threads[i];
+
+            double start = ncnn::get_current_time();
+
+            std::vector<ncnn::Thread*> workers;
+            for (int t=0; t<threads[i]; t++)
+            {
+                workers.push_back(new ncnn::Thread(queue_bench_get, (void*)&qbp));
+                workers.push_back(new ncnn::Thread(queue_bench_put, (void*)&qbp));
+            }
+
+            for (size_t t=0; t<workers.size(); t++)
+            {
+                workers[t]->join();
+                delete workers[t];
+            }
+
+            if (l >= 0)
+                ms.push_back(ncnn::get_current_time() - start);
+        }
+
+        char kernel[32];
+        sprintf(kernel, "task queue %d:%d", threads[i], threads[i]);
+        trace_runs(fp, kernel, count, 1, ms);
+    }
+}
+
+int main(int argc, char** argv)
+{
+    int w = 1920;
+    int h = 1080;
+    int loops = 10;
+    int warmup = 2;
+    int num_threads = std::max(1, ncnn::get_cpu_count());
+
+    if (argc > 1 && sscanf(argv[1], "%dx%d", &w, &h) != 2)
+    {
+        print_usage();
+        return -1;
+    }
+
+    if (argc > 2)
+        loops = atoi(argv[2]);
+
+    if (argc > 3)
+        num_threads = atoi(argv[3]);
+
+    if (argc > 4)
+        warmup = atoi(argv[4]);
+
+    if (argc > 5 || w < 1 || h < 1 || loops < 1 || num_threads < 1 || warmup < 0)
+    {
+        print_usage();
+        return -1;
+    }
+
+    if (bench_cpu_kernels(w, h, warmup, loops, num_threads, stdout) != 0)
+    {
+        fprintf(stderr, "cpu kernels failed\n");
+        return -1;
+    }
+
+    path_t dirpath;
+    if (create_temp_dir(dirpath) != 0)
+    {
+        fprintf(stderr, "create temp directory failed\n");
+        return -1;
+    }
+
+    int ret = bench_codecs(dirpath, w, h, warmup, loops, stdout);
+
+    remove_dir(dirpath);
+
+    if (ret != 0)
+        return -1;
+
+    bench_task_queue(warmup, loops, stdout);
+
+    return 0;
+}
@@ -164,6 +164,25 @@ static bool filepath_is_readable(const path_t& path)
     return true;
 }
 
+// replaces dst if it exists, readers see either the old or the new file
+static int replace_file(const path_t& src, const path_t& dst)
+{
+#if _WIN32
+    return MoveFileExW(src.c_str(), dst.c_str(), MOVEFILE_REPLACE_EXISTING) ? 0 : -1;
+#else // _WIN32
+    return rename(src.c_str(), dst.c_str());
+#endif // _WIN32
+}
+
+static void remove_file(const path_t& path)
+{
+#if _WIN32
+    _wremove(path.c_str());
+#else // _WIN32
+    remove(path.c_str());
+#endif // _WIN32
+}
+
 static path_t sanitize_filepath(const path_t& path)
 {
     if (filepath_is_readable(path))
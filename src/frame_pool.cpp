@@ -0,0 +1,333 @@
+// rife implemented with ncnn library
+
+#include "frame_pool.h"
+
+#include <string.h>
+
+#if __linux__
+#include <sys/mman.h>
+#endif
+
+// ahead of every buffer, keeps the returned pointer aligned like the block itself
+struct FrameHeader
+{
+    size_t capacity;
+    int index;// size class, -1 for oversized buffers that are never cached
+    int mapped;// 0=heap 1=mmap 2=backing
+    ncnn::Allocator* backing;
+};
+
+static const size_t frame_header_size = 64;
+
+static const size_t min_class_size = 4096;
+static const int class_count = 4 * 32;
+
+// more than this many idle buffers of one class are given back
+static const size_t max_cached_per_class = 32;
+
+#if __linux__
+// hugepages only pay off for buffers spanning several of them
+static const size_t mmap_threshold = 2 * 1024 * 1024;
+#endif
+
+// size of the decoded frame stb is about to allocate on this thread, 0 outside of a FrameBufferScope
+static thread_local size_t frame_buffer_size = 0;
+
+static int size_class(size_t size, size_t* capacity)
+{
+    size_t base = min_class_size;
+    for (int i=0; i<class_count; i++)
+    {
+        size_t c = base / 4 * (4 + i % 4);
+        if (c >= size)
+        {
+            *capacity = c;
+            return i;
+        }
+
+        if (i % 4 == 3)
+            base *= 2;
+    }
+
+    *capacity = size;
+    return -1;
+}
+
+static FrameHeader* allocate_block(size_t capacity, int index, ncnn::Allocator* backing)
+{
+    const size_t blocksize = frame_header_size + capacity;
+
+    void* block = 0;
+    int mapped = 0;
+
+    if (backing)
+    {
+        block = backing->fastMalloc(blocksize);
+        if (block)
+            mapped = 2;
+        else
+            backing = 0;
+    }
+
+#if __linux__
+    if (!block && blocksize >= mmap_threshold)
+    {
+        block = mmap(NULL, blocksize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (block == MAP_FAILED)
+        {
+            block = 0;
+        }
+        else
+        {
+#ifdef MADV_HUGEPAGE
+            madvise(block, blocksize, MADV_HUGEPAGE);
+#endif
+            mapped = 1;
+        }
+    }
+#endif
+
+    if (!block)
+    {
+        block = ncnn::fastMalloc(blocksize);
+        if (!block)
+            return 0;
+    }
+
+    FrameHeader* header = (FrameHeader*)block;
+    header->capacity = capacity;
+    header->index = index;
+    header->mapped = mapped;
+    header->backing = backing;
+    return header;
+}
+
+static void free_block(FrameHeader* header)
+{
+    if (header->mapped == 2)
+    {
+        header->backing->fastFree(header);
+        return;
+    }
+
+#if __linux__
+    if (header->mapped)
+    {
+        munmap(header, frame_header_size + header->capacity);
+        return;
+    }
+#endif
+
+    ncnn::fastFree(header);
+}
+
+static FrameHeader* header_of(void* ptr)
+{
+    return (FrameHeader*)((unsigned char*)ptr - frame_header_size);
+}
+
+FramePool::FramePool() : backing(0), frames(this)
+{
+    freelists.resize(class_count);
+    backing_freelists.resize(class_count);
+}
+
+FramePool::~FramePool()
+{
+    clear();
+}
+
+void* FramePool::fastMalloc(size_t size)
+{
+    size_t capacity = 0;
+    int index = size_class(size, &capacity);
+
+    if (index != -1)
+    {
+        lock.lock();
+
+        std::vector<void*>& freelist = freelists[index];
+        if (!freelist.empty())
+        {
+            void* ptr = freelist.back();
+            freelist.pop_back();
+
+            lock.unlock();
+
+            return ptr;
+        }
+
+        lock.unlock();
+    }
+
+    FrameHeader* header = allocate_block(capacity, index, 0);
+    if (!header)
+        return 0;
+
+    return (unsigned char*)header + frame_header_size;
+}
+
+void* FramePool::frame_malloc(size_t size)
+{
+    size_t capacity = 0;
+    int index = size_class(size, &capacity);
+
+    lock.lock();
+
+    ncnn::Allocator* allocator = backing;
+    if (!allocator)
+    {
+        lock.unlock();
+        return fastMalloc(size);
+    }
+
+    if (index != -1)
+    {
+        std::vector<void*>& freelist = backing_freelists[index];
+        if (!freelist.empty())
+        {
+            void* ptr = freelist.back();
+            freelist.pop_back();
+
+            lock.unlock();
+
+            return ptr;
+        }
+    }
+
+    lock.unlock();
+
+    // falls back to plain memory when the backing is exhausted
+    FrameHeader* header = allocate_block(capacity, index, allocator);
+    if (!header)
+        return 0;
+
+    return (unsigned char*)header + frame_header_size;
+}
+
+ncnn::Allocator* FramePool::frame_allocator()
+{
+    return &frames;
+}
+
+void FramePool::fastFree(void* ptr)
+{
+    if (!ptr)
+        return;
+
+    FrameHeader* header = header_of(ptr);
+
+    if (header->index != -1)
+    {
+        lock.lock();
+
+        std::vector<void*>& freelist = header->mapped == 2 ? backing_freelists[header->index] : freelists[header->index];
+        if (freelist.size() < max_cached_per_class)
+        {
+            freelist.push_back(ptr);
+
+            lock.unlock();
+
+            return;
+        }
+
+        lock.unlock();
+    }
+
+    free_block(header);
+}
+
+void* FramePool::fastRealloc(void* ptr, size_t size)
+{
+    if (!ptr)
+        return fastMalloc(size);
+
+    FrameHeader* header = header_of(ptr);
+    if (size <= header->capacity)
+        return ptr;
+
+    void* newptr = fastMalloc(size);
+    if (!newptr)
+        return 0;
+
+    memcpy(newptr, ptr, header->capacity);
+    fastFree(ptr);
+
+    return newptr;
+}
+
+void FramePool::clear()
+{
+    lock.lock();
+
+    for (size_t i=0; i<freelists.size(); i++)
+    {
+        for (size_t j=0; j<freelists[i].size(); j++)
+        {
+            free_block(header_of(freelists[i][j]));
+        }
+
+        freelists[i].clear();
+    }
+
+    for (size_t i=0; i<backing_freelists.size(); i++)
+    {
+        for (size_t j=0; j<backing_freelists[i].size(); j++)
+        {
+            free_block(header_of(backing_freelists[i][j]));
+        }
+
+        backing_freelists[i].clear();
+    }
+
+    lock.unlock();
+}
+
+void FramePool::set_backing(ncnn::Allocator* allocator)
+{
+    clear();
+
+    lock.lock();
+    backing = allocator;
+    lock.unlock();
+}
+
+FramePool* frame_pool()
+{
+    // never destroyed, global frames may still hand buffers back during exit
+    static FramePool* pool = new FramePool;
+    return pool;
+}
+
+void* frame_pool_malloc(size_t size)
+{
+    if (frame_buffer_size && size == frame_buffer_size)
+        return frame_pool()->frame_malloc(size);
+
+    return frame_pool()->fastMalloc(size);
+}
+
+void* frame_pool_realloc(void* ptr, size_t size)
+{
+    return frame_pool()->fastRealloc(ptr, size);
+}
+
+void frame_pool_free(void* ptr)
+{
+    frame_pool()->fastFree(ptr);
+}
+
+void* frame_pool_frame_malloc(size_t size)
+{
+    return frame_pool()->frame_malloc(size);
+}
+
+FrameBufferScope::FrameBufferScope(size_t size) : saved(frame_buffer_size)
+{
+    frame_buffer_size = size;
+}
+
+FrameBufferScope::~FrameBufferScope()
+{
+    frame_buffer_size = saved;
+}
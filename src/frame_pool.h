@@ -0,0 +1,89 @@
+// rife implemented with ncnn library
+
+#ifndef FRAME_POOL_H
+#define FRAME_POOL_H
+
+#include <stddef.h>
+#include <vector>
+
+// ncnn
+#include "allocator.h"
+#include "platform.h"
+
+// recycles frame sized buffers instead of returning them to the heap
+// sizes are rounded up to one of four classes per power of two, freed buffers wait in a per-class list
+// large buffers are mapped separately and advised as transparent hugepages where the os supports it
+// covers pixel data and file contents only, the paths and vectors of each task still come from the heap
+class FramePool : public ncnn::Allocator
+{
+public:
+    FramePool();
+    virtual ~FramePool();
+
+    virtual void* fastMalloc(size_t size);
+    virtual void fastFree(void* ptr);
+
+    // keeps the buffer when the new size still fits its class
+    void* fastRealloc(void* ptr, size_t size);
+
+    // return every cached buffer to the os
+    void clear();
+
+    // frame pixel buffers, from the backing allocator while one is set and from the heap otherwise
+    // fastMalloc never touches the backing, file contents and codec scratch stay in plain memory
+    void* frame_malloc(size_t size);
+
+    // hands out frame_malloc buffers, for the Mats of decoded and output frames
+    ncnn::Allocator* frame_allocator();
+
+    // frame_malloc takes its buffers from this allocator while set, such as memory the gpu can copy from directly
+    // only while no buffer from a previous backing is in use, cached ones are released first
+    void set_backing(ncnn::Allocator* allocator);
+
+private:
+    FramePool(const FramePool&);
+    FramePool& operator=(const FramePool&);
+
+    class FrameAllocator : public ncnn::Allocator
+    {
+    public:
+        FrameAllocator(FramePool* _pool) : pool(_pool) {}
+
+        virtual void* fastMalloc(size_t size) { return pool->frame_malloc(size); }
+        virtual void fastFree(void* ptr) { pool->fastFree(ptr); }
+
+    private:
+        FramePool* pool;
+    };
+
+    ncnn::Mutex lock;
+    std::vector<std::vector<void*> > freelists;
+    std::vector<std::vector<void*> > backing_freelists;
+    ncnn::Allocator* backing;
+    FrameAllocator frames;
+};
+
+// process wide pool shared by the decoders, the encoders and the pipeline
+FramePool* frame_pool();
+
+// malloc style entry points for the image codecs
+void* frame_pool_malloc(size_t size);
+void* frame_pool_realloc(void* ptr, size_t size);
+void frame_pool_free(void* ptr);
+
+// for codec hooks that only allocate the decoded pixels
+void* frame_pool_frame_malloc(size_t size);
+
+// stb allocates its decoded pixels and its scratch through the same hook,
+// while alive, frame_pool_malloc takes allocations of exactly size bytes on this thread as the decoded frame
+class FrameBufferScope
+{
+public:
+    FrameBufferScope(size_t size);
+    ~FrameBufferScope();
+
+private:
+    size_t saved;
+};
+
+#endif // FRAME_POOL_H
@@ -0,0 +1,193 @@
+// rife implemented with ncnn library
+
+#ifndef IMAGE_IO_H
+#define IMAGE_IO_H
+
+// defines the codec implementations, include from one source file of each executable
+
+#include <algorithm>
+
+// every decoder, encoder and frame buffer draws from the same pool
+// decoded pixels are frame buffers, everything else is plain pool memory
+#include "frame_pool.h"
+#define WEBP_IMAGE_MALLOC(sz) frame_pool_frame_malloc(sz)
+#define WEBP_IMAGE_FREE(p) frame_pool_free(p)
+
+#if _WIN32
+// image decoder and encoder with wic
+#define WIC_IMAGE_MALLOC(sz) frame_pool_malloc(sz)
+#define WIC_IMAGE_FRAME_MALLOC(sz) frame_pool_frame_malloc(sz)
+#define WIC_IMAGE_FREE(p) frame_pool_free(p)
+#include "wic_image.h"
+#else // _WIN32
+// image decoder and encoder with stb
+#define STBI_MALLOC(sz) frame_pool_malloc(sz)
+#define STBI_REALLOC(p, newsz) frame_pool_realloc(p, newsz)
+#define STBI_FREE(p) frame_pool_free(p)
+#define STB_IMAGE_IMPLEMENTATION
+#define STBI_NO_PSD
+#define STBI_NO_TGA
+#define STBI_NO_GIF
+#define STBI_NO_HDR
+#define STBI_NO_PIC
+#define STBI_NO_STDIO
+#include "stb_image.h"
+#define STB_IMAGE_WRITE_IMPLEMENTATION
+#define STBIW_MALLOC(sz) frame_pool_malloc(sz)
+#define STBIW_REALLOC(p, newsz) frame_pool_realloc(p, newsz)
+#define STBIW_FREE(p) frame_pool_free(p)
+#include "stb_image_write.h"
+#endif // _WIN32
+#include "webp_image.h"
+
+// ncnn
+#include "mat.h"
+
+#include "filesystem_utils.h"
+#include "trace.h"
+
+// the pixel data comes from frame_pool()->frame_malloc() and goes back with frame_pool_free()
+static int decode_image(const path_t& imagepath, ncnn::Mat& image)
+{
+    unsigned char* pixeldata = 0;
+    int w;
+    int h;
+    int c;
+
+#if _WIN32
+    FILE* fp = _wfopen(imagepath.c_str(), L"rb");
+#else
+    FILE* fp = fopen(imagepath.c_str(), "rb");
+#endif
+    if (fp)
+    {
+        // read whole file
+        unsigned char* filedata = 0;
+        int length = 0;
+        {
+            TraceScope scope("read");
+
+            fseek(fp, 0, SEEK_END);
+            length = ftell(fp);
+            rewind(fp);
+            filedata = (unsigned char*)frame_pool_malloc(length);
+            if (filedata)
+            {
+                fread(filedata, 1, length, fp);
+            }
+            fclose(fp);
+        }
+
+        if (filedata)
+        {
+            TraceScope scope("decode");
+
+            pixeldata = webp_load(filedata, length, &w, &h, &c);
+            if (!pixeldata)
+            {
+                // not webp, try jpg png etc.
+#if _WIN32
+                pixeldata = wic_decode_image(imagepath.c_str(), &w, &h, &c);
+#else // _WIN32
+                int comp;
+                if (stbi_info_from_memory(filedata, length, &w, &h, &comp))
+                {
+                    FrameBufferScope frame((size_t)w * h * 3);
+                    pixeldata = stbi_load_from_memory(filedata, length, &w, &h, &c, 3);
+                }
+                c = 3;
+#endif // _WIN32
+            }
+
+            frame_pool_free(filedata);
+        }
+    }
+
+    if (!pixeldata)
+    {
+#if _WIN32
+        fwprintf(stderr, L"decode image %ls failed\n", imagepath.c_str());
+#else // _WIN32
+        fprintf(stderr, "decode image %s failed\n", imagepath.c_str());
+#endif // _WIN32
+
+        return -1;
+    }
+
+    image = ncnn::Mat(w, h, (void*)pixeldata, (size_t)3, 3);
+
+    return 0;
+}
+
+// written under a temporary name and renamed into place, an interrupted run never leaves a partial frame behind
+static int encode_image(const path_t& imagepath, const ncnn::Mat& image)
+{
+    int success = 0;
+
+    path_t ext = get_file_extension(imagepath);
+    path_t partpath = imagepath + PATHSTR(".part");
+
+    if (ext == PATHSTR("webp") || ext == PATHSTR("WEBP"))
+    {
+        success = webp_save(partpath.c_str(), image.w, image.h, image.elempack, (const unsigned char*)image.data);
+    }
+    else if (ext == PATHSTR("png") || ext == PATHSTR("PNG"))
+    {
+#if _WIN32
+        success = wic_encode_image(partpath.c_str(), image.w, image.h, image.elempack, image.data);
+#else
+        success = stbi_write_png(partpath.c_str(), image.w, image.h, image.elempack, image.data, 0);
+#endif
+    }
+    else if (ext == PATHSTR("jpg") || ext == PATHSTR("JPG") || ext == PATHSTR("jpeg") || ext == PATHSTR("JPEG"))
+    {
+#if _WIN32
+        success = wic_encode_jpeg_image(partpath.c_str(), image.w, image.h, image.elempack, image.data);
+#else
+        success = stbi_write_jpg(partpath.c_str(), image.w, image.h, image.elempack, image.data, 100);
+#endif
+    }
+
+    if (success && replace_file(partpath, imagepath) != 0)
+        success = 0;
+
+    if (!success)
+    {
+        remove_file(partpath);
+
+#if _WIN32
+        fwprintf(stderr, L"encode image %ls failed\n", imagepath.c_str());
+#else
+        fprintf(stderr, "encode image %s failed\n", imagepath.c_str());
+#endif
+    }
+
+    return success ? 0 : -1;
+}
+
+// smooth gradients under a blocky hashed texture, shifted by dx dy so that flownet has motion to follow
+static void synthesize_frame(int w, int h, int dx, int dy, ncnn::Mat& image)
+{
+    image = ncnn::Mat(w, h, (size_t)3, 3, frame_pool()->frame_allocator());
+
+    for (int y=0; y<h; y++)
+    {
+        unsigned char* p = (unsigned char*)image.data + (size_t)y * w * 3;
+        for (int x=0; x<w; x++)
+        {
+            const int sx = x + dx;
+            const int sy = y + dy;
+
+            unsigned int n = (unsigned int)(sx >> 3) * 73856093u ^ (unsigned int)(sy >> 3) * 19349663u;
+            n = (n >> 13) ^ n;
+            const int texture = (int)(n % 64) - 32;
+
+            p[0] = (unsigned char)std::min(std::max((int)((long long)sx * 255 / w) + texture, 0), 255);
+            p[1] = (unsigned char)std::min(std::max((int)((long long)sy * 255 / h) + texture, 0), 255);
+            p[2] = (unsigned char)std::min(std::max(128 + texture * 2, 0), 255);
+            p += 3;
+        }
+    }
+}
+
+#endif // IMAGE_IO_H
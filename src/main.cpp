@@ -1,31 +1,23 @@
 // rife implemented with ncnn library
 
+#include <limits.h>
 #include <stdio.h>
 #include <algorithm>
+#include <atomic>
+#include <deque>
+#include <map>
 #include <queue>
+#include <set>
+#include <string>
+#include <utility>
 #include <vector>
 #include <clocale>
 
-#if _WIN32
-// image decoder and encoder with wic
-#include "wic_image.h"
-#else // _WIN32
-// image decoder and encoder with stb
-#define STB_IMAGE_IMPLEMENTATION
-#define STBI_NO_PSD
-#define STBI_NO_TGA
-#define STBI_NO_GIF
-#define STBI_NO_HDR
-#define STBI_NO_PIC
-#define STBI_NO_STDIO
-#include "stb_image.h"
-#define STB_IMAGE_WRITE_IMPLEMENTATION
-#include "stb_image_write.h"
-#endif // _WIN32
-#include "webp_image.h"
-
 #if _WIN32
 #include <wchar.h>
+#include <fcntl.h>
+#include <io.h>
+#include <psapi.h>
 static wchar_t* optarg = NULL;
 static int optind = 1;
 static wchar_t getopt(int argc, wchar_t* const argv[], const wchar_t* optstring)
@@ -69,8 +61,39 @@ static std::vector<int> parse_optarg_int_array(const wchar_t* optarg)
 
     return array;
 }
+
+// bytes[:count], bytes with an optional K/M/G suffix
+static int parse_optarg_queue(const wchar_t* optarg, size_t* bytes, int* count)
+{
+    wchar_t* end = 0;
+    double value = wcstod(optarg, &end);
+
+    switch (*end)
+    {
+    case L'G': case L'g': value *= 1024; // fallthrough
+    case L'M': case L'm': value *= 1024; // fallthrough
+    case L'K': case L'k': value *= 1024; end++; break;
+    default: break;
+    }
+
+    if (*end == L':')
+        *count = _wtoi(end + 1);
+    else if (*end != L'\0')
+        return -1;
+
+    *bytes = value < 0 ? 0 : (size_t)value;
+    return 0;
+}
 #else // _WIN32
 #include <unistd.h> // getopt()
+#include <errno.h>
+#include <pthread.h>
+#include <signal.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include "ndjson.h"
 
 static std::vector<int> parse_optarg_int_array(const char* optarg)
 {
@@ -87,6 +110,29 @@ static std::vector<int> parse_optarg_int_array(const char* optarg)
 
     return array;
 }
+
+// bytes[:count], bytes with an optional K/M/G suffix
+static int parse_optarg_queue(const char* optarg, size_t* bytes, int* count)
+{
+    char* end = 0;
+    double value = strtod(optarg, &end);
+
+    switch (*end)
+    {
+    case 'G': case 'g': value *= 1024; // fallthrough
+    case 'M': case 'm': value *= 1024; // fallthrough
+    case 'K': case 'k': value *= 1024; end++; break;
+    default: break;
+    }
+
+    if (*end == ':')
+        *count = atoi(end + 1);
+    else if (*end != '\0')
+        return -1;
+
+    *bytes = value < 0 ? 0 : (size_t)value;
+    return 0;
+}
 #endif // _WIN32
 
 // ncnn
@@ -96,346 +142,2648 @@ static std::vector<int> parse_optarg_int_array(const char* optarg)
 #include "benchmark.h"
 
 #include "rife.h"
+#include "spirv_cache.h"
 
 #include "filesystem_utils.h"
+#include "image_io.h"
+#include "stream_io.h"
+#include "task_queue.h"
+#include "trace.h"
 
 static void print_usage()
 {
     fprintf(stderr, "Usage: rife-ncnn-vulkan -0 infile -1 infile1 -o outfile [options]...\n");
-    fprintf(stderr, "       rife-ncnn-vulkan -i indir -o outdir [options]...\n\n");
+    fprintf(stderr, "       rife-ncnn-vulkan -i indir -o outdir [options]...\n");
+    fprintf(stderr, "       rife-ncnn-vulkan -i - -o - [options]... < in.y4m > out.y4m\n\n");
     fprintf(stderr, "  -h                   show this help\n");
     fprintf(stderr, "  -v                   verbose output\n");
     fprintf(stderr, "  -0 input0-path       input image0 path (jpg/png/webp)\n");
     fprintf(stderr, "  -1 input1-path       input image1 path (jpg/png/webp)\n");
-    fprintf(stderr, "  -i input-path        input image directory (jpg/png/webp)\n");
-    fprintf(stderr, "  -o output-path       output image path (jpg/png/webp) or directory\n");
+    fprintf(stderr, "  -i input-path        input image directory (jpg/png/webp) or - for yuv4mpeg2 on stdin, -:WxH for raw rgb24\n");
+    fprintf(stderr, "  -o output-path       output image path (jpg/png/webp) or directory, - for stdout in stream mode\n");
     fprintf(stderr, "  -n num-frame         target frame count (default=N*2)\n");
     fprintf(stderr, "  -s time-step         time step (0~1, default=0.5)\n");
     fprintf(stderr, "  -m model-path        rife model path (default=rife-v2.3)\n");
     fprintf(stderr, "  -g gpu-id            gpu device to use (-1=cpu, default=auto) can be 0,1,2 for multi-gpu\n");
+    fprintf(stderr, "  -t tile-size         tile size (0 or >=512, 0=auto, default=0) can be 0,0,0 for multi-gpu\n");
     fprintf(stderr, "  -j load:proc:save    thread count for load/proc/save (default=1:2:2) can be 1:2,2,2:2 for multi-gpu\n");
+    fprintf(stderr, "  -w tta-jobs          number of tta directions evaluated at once on cpu (1~8, default=1)\n");
+    fprintf(stderr, "  -q mem:count         task queue limit in bytes (K/M/G, 0=unlimited) and tasks (default=2G:8)\n");
+    fprintf(stderr, "  -p segment           only write output frames of segment k of N (k/N, default=0/1)\n");
+    fprintf(stderr, "  -e scene-threshold   copy the nearest frame instead of interpolating across scene cuts (0~1, 0=off, default=0)\n");
+    fprintf(stderr, "  -d dup-threshold     copy instead of interpolating pairs differing by at most this much (0~1, 0=off, default=0)\n");
+    fprintf(stderr, "  -b WxH[:warmup:pairs] benchmark synthetic WxH frame pairs, print json results (default=4 warmup, 32 pairs)\n");
+    fprintf(stderr, "  -c cache-path        directory keeping compiled shaders across runs (default=none)\n");
+    fprintf(stderr, "  -k trace-path        write a chrome trace of every stage and print per stage timings at exit (default=none)\n");
+    fprintf(stderr, "  -G golden-path       compare output frames with the same named frames here, print psnr and runtime as json\n");
+    fprintf(stderr, "  -T psnr:max-diff     golden tolerance, lowest psnr in db and largest channel difference (default=40:16)\n");
+    fprintf(stderr, "  -l listen-address    serve jobs as newline-delimited json, keeping models loaded (unix:/path/to.sock)\n");
     fprintf(stdout, "  -x                   enable spatial tta mode\n");
     fprintf(stdout, "  -z                   enable temporal tta mode\n");
     fprintf(stdout, "  -u                   enable UHD mode\n");
+    fprintf(stdout, "  -r                   resume, skip output frames finished by an earlier -r run\n");
+    fprintf(stdout, "  -y                   retime held frames, interpolate between the drawings detected with -d\n");
+    fprintf(stdout, "  -a                   enable async gpu upload, overlaps the next pair upload with inference\n");
     fprintf(stderr, "  -f pattern-format    output image filename pattern format (%%08d.jpg/png/webp, default=ext/%%08d.png)\n");
 }
 
-static int decode_image(const path_t& imagepath, ncnn::Mat& image, int* webp)
+TaskQueue toproc;
+TaskQueue tosave;
+
+// hands finished tasks to a sequential sink in id order
+// the loader waits before running more than window tasks ahead of the oldest unfinished one,
+// so out of order completion only ever holds a bounded number of tasks, kept in one preallocated slot each
+class ReorderBuffer
 {
-    *webp = 0;
+public:
+    ReorderBuffer(int _window) : window(_window), next(0), draining(false), slots(_window), filled(_window, 0)
+    {
+    }
 
-    unsigned char* pixeldata = 0;
-    int w;
-    int h;
-    int c;
+    virtual ~ReorderBuffer()
+    {
+    }
 
-#if _WIN32
-    FILE* fp = _wfopen(imagepath.c_str(), L"rb");
-#else
-    FILE* fp = fopen(imagepath.c_str(), "rb");
-#endif
-    if (fp)
+    void wait(int id)
     {
-        // read whole file
-        unsigned char* filedata = 0;
-        int length = 0;
-        {
-            fseek(fp, 0, SEEK_END);
-            length = ftell(fp);
-            rewind(fp);
-            filedata = (unsigned char*)malloc(length);
-            if (filedata)
-            {
-                fread(filedata, 1, length, fp);
-            }
-            fclose(fp);
-        }
+        lock.lock();
 
-        if (filedata)
+        while (id >= next + window)
         {
-            pixeldata = webp_load(filedata, length, &w, &h, &c);
-            if (pixeldata)
-            {
-                *webp = 1;
-            }
-            else
-            {
-                // not webp, try jpg png etc.
-#if _WIN32
-                pixeldata = wic_decode_image(imagepath.c_str(), &w, &h, &c);
-#else // _WIN32
-                pixeldata = stbi_load_from_memory(filedata, length, &w, &h, &c, 3);
-                c = 3;
-#endif // _WIN32
-            }
-
-            free(filedata);
+            condition.wait(lock);
         }
+
+        lock.unlock();
     }
 
-    if (!pixeldata)
+    // v is moved into the buffer and left empty
+    void put(Task& v)
     {
-#if _WIN32
-        fwprintf(stderr, L"decode image %ls failed\n", imagepath.c_str());
-#else // _WIN32
-        fprintf(stderr, "decode image %s failed\n", imagepath.c_str());
-#endif // _WIN32
+        insert(v.id, v);
+    }
 
-        return -1;
+    // a task dropped before the save stage, so later ones are not held back
+    void skip(int id)
+    {
+        Task v;
+        v.id = -1;
+        insert(id, v);
     }
 
-    image = ncnn::Mat(w, h, (void*)pixeldata, (size_t)3, 3);
+protected:
+    virtual void emit(const Task& v) = 0;
 
-    return 0;
-}
+private:
+    // only ids within the window of next arrive, so they never share a slot
+    void insert(int id, Task& v)
+    {
+        lock.lock();
 
-static int encode_image(const path_t& imagepath, const ncnn::Mat& image)
-{
-    int success = 0;
+        slots[id % window] = std::move(v);
+        release_task_frames(v);
+        filled[id % window] = 1;
 
-    path_t ext = get_file_extension(imagepath);
+        // whoever is draining picks this task up, only one thread talks to the sink at a time
+        if (draining)
+        {
+            lock.unlock();
+            return;
+        }
 
-    if (ext == PATHSTR("webp") || ext == PATHSTR("WEBP"))
-    {
-        success = webp_save(imagepath.c_str(), image.w, image.h, image.elempack, (const unsigned char*)image.data);
-    }
-    else if (ext == PATHSTR("png") || ext == PATHSTR("PNG"))
-    {
-#if _WIN32
-        success = wic_encode_image(imagepath.c_str(), image.w, image.h, image.elempack, image.data);
-#else
-        success = stbi_write_png(imagepath.c_str(), image.w, image.h, image.elempack, image.data, 0);
-#endif
-    }
-    else if (ext == PATHSTR("jpg") || ext == PATHSTR("JPG") || ext == PATHSTR("jpeg") || ext == PATHSTR("JPEG"))
-    {
-#if _WIN32
-        success = wic_encode_jpeg_image(imagepath.c_str(), image.w, image.h, image.elempack, image.data);
-#else
-        success = stbi_write_jpg(imagepath.c_str(), image.w, image.h, image.elempack, image.data, 100);
-#endif
-    }
+        draining = true;
 
-    if (!success)
-    {
-#if _WIN32
-        fwprintf(stderr, L"encode image %ls failed\n", imagepath.c_str());
-#else
-        fprintf(stderr, "encode image %s failed\n", imagepath.c_str());
-#endif
-    }
+        Task t;
+        while (filled[next % window])
+        {
+            t = std::move(slots[next % window]);
+            release_task_frames(slots[next % window]);
+            filled[next % window] = 0;
 
-    return success ? 0 : -1;
-}
+            lock.unlock();
 
-class Task
-{
-public:
-    int id;
-    int webp0;
-    int webp1;
-
-    path_t in0path;
-    path_t in1path;
-    path_t outpath;
-    float timestep;
-
-    ncnn::Mat in0image;
-    ncnn::Mat in1image;
-    ncnn::Mat outimage;
+            if (t.id != -1)
+                emit(t);
+
+            lock.lock();
+
+            next++;
+            condition.broadcast();
+        }
+
+        draining = false;
+
+        lock.unlock();
+    }
+
+    int window;
+    int next;
+    bool draining;
+    ncnn::Mutex lock;
+    ncnn::ConditionVariable condition;
+    std::vector<Task> slots;
+    std::vector<char> filled;
 };
 
-class TaskQueue
+// decoded source frames shared by all tasks
+// each frame is decoded exactly once and freed after the last task referencing it is saved
+class FrameWindow
 {
 public:
-    TaskQueue()
+    FrameWindow()
+    {
+    }
+
+    ~FrameWindow()
     {
+        for (size_t i=0; i<frames.size(); i++)
+        {
+            free_frame(frames[i]);
+        }
+    }
+
+    void init(const std::vector<path_t>& paths, const std::vector<int>& usecounts)
+    {
+        frames.resize(paths.size());
+        for (size_t i=0; i<paths.size(); i++)
+        {
+            frames[i].path = paths[i];
+            frames[i].usecount = usecounts[i];
+            frames[i].state = 0;
+        }
     }
 
-    void put(const Task& v)
+    int acquire(int index, ncnn::Mat& image)
     {
+        Frame& f = frames[index];
+
         lock.lock();
 
-        while (tasks.size() >= 8) // FIXME hardcode queue length
+        while (f.state == 1)
         {
+            // another load thread is decoding this frame
             condition.wait(lock);
         }
 
-        tasks.push(v);
+        if (f.state == 2)
+        {
+            image = f.image;
+
+            lock.unlock();
+
+            return f.image.empty() ? -1 : 0;
+        }
+
+        f.state = 1;
 
         lock.unlock();
 
-        condition.signal();
+        ncnn::Mat decoded;
+        int ret = decode_image(f.path, decoded);
+
+        lock.lock();
+
+        f.image = decoded;
+        f.state = 2;
+
+        lock.unlock();
+
+        condition.broadcast();
+
+        image = decoded;
+
+        return ret;
     }
 
-    void get(Task& v)
+    // a frame decoded by the caller, who keeps one reference until it calls release
+    void insert(int index, const ncnn::Mat& image)
     {
+        Frame& f = frames[index];
+
         lock.lock();
 
-        while (tasks.size() == 0)
-        {
-            condition.wait(lock);
-        }
+        f.image = image;
+        f.state = 2;
+        f.usecount++;
+
+        lock.unlock();
+    }
+
+    // one more task reads this frame
+    void add_use(int index)
+    {
+        lock.lock();
 
-        v = tasks.front();
-        tasks.pop();
+        frames[index].usecount++;
 
         lock.unlock();
+    }
 
-        condition.signal();
+    void release(int index)
+    {
+        Frame& f = frames[index];
+
+        lock.lock();
+
+        f.usecount--;
+        if (f.usecount == 0 && f.state == 2)
+        {
+            free_frame(f);
+        }
+
+        lock.unlock();
     }
 
 private:
+    class Frame
+    {
+    public:
+        path_t path;
+        int usecount;
+        int state;// 0=pending 1=decoding 2=decoded
+        ncnn::Mat image;
+    };
+
+    static void free_frame(Frame& f)
+    {
+        frame_pool_free(f.image.data);
+
+        f.image.release();
+    }
+
     ncnn::Mutex lock;
     ncnn::ConditionVariable condition;
-    std::queue<Task> tasks;
+    std::vector<Frame> frames;
 };
 
-TaskQueue toproc;
-TaskQueue tosave;
+FrameWindow framewindow;
 
-class LoadThreadParams
+// in-flight input buffers of one gpu in async mode
+// each slot owns a blob allocator so that upload and proc never share one
+class UploadSlots
 {
 public:
-    int jobs_load;
-
-    // session data
-    std::vector<path_t> input0_files;
-    std::vector<path_t> input1_files;
-    std::vector<path_t> output_files;
-    std::vector<float> timesteps;
-};
-
-void* load(void* args)
-{
-    const LoadThreadParams* ltp = (const LoadThreadParams*)args;
-    const int count = ltp->output_files.size();
+    UploadSlots()
+    {
+    }
 
-    #pragma omp parallel for schedule(static,1) num_threads(ltp->jobs_load)
-    for (int i=0; i<count; i++)
+    ~UploadSlots()
     {
-        const path_t& image0path = ltp->input0_files[i];
-        const path_t& image1path = ltp->input1_files[i];
+        for (size_t i=0; i<allocators.size(); i++)
+        {
+            delete allocators[i];
+        }
+    }
 
-        Task v;
-        v.id = i;
-        v.in0path = image0path;
-        v.in1path = image1path;
-        v.outpath = ltp->output_files[i];
-        v.timestep = ltp->timesteps[i];
+    void init(const ncnn::VulkanDevice* vkdev, int count)
+    {
+        allocators.resize(count);
+        for (int i=0; i<count; i++)
+        {
+            allocators[i] = new ncnn::VkBlobAllocator(vkdev);
+            freeslots.push(i);
+        }
+    }
 
-        int ret0 = decode_image(image0path, v.in0image, &v.webp0);
-        int ret1 = decode_image(image1path, v.in1image, &v.webp1);
+    int acquire()
+    {
+        lock.lock();
 
-        if (ret0 != 0 || ret1 != 1)
+        while (freeslots.size() == 0)
         {
-            v.outimage = ncnn::Mat(v.in0image.w, v.in0image.h, (size_t)3, 3);
-            toproc.put(v);
+            condition.wait(lock);
         }
-    }
 
-    return 0;
-}
+        int slot = freeslots.front();
+        freeslots.pop();
 
-class ProcThreadParams
-{
-public:
-    const RIFE* rife;
-};
+        lock.unlock();
 
-void* proc(void* args)
-{
-    const ProcThreadParams* ptp = (const ProcThreadParams*)args;
-    const RIFE* rife = ptp->rife;
+        return slot;
+    }
 
-    for (;;)
+    void release(int slot)
     {
-        Task v;
+        lock.lock();
 
-        toproc.get(v);
+        freeslots.push(slot);
 
-        if (v.id == -233)
-            break;
+        lock.unlock();
 
-        rife->process(v.in0image, v.in1image, v.timestep, v.outimage);
+        condition.signal();
+    }
 
-        tosave.put(v);
+    ncnn::VkAllocator* allocator(int slot) const
+    {
+        return allocators[slot];
     }
 
-    return 0;
-}
+private:
+    ncnn::Mutex lock;
+    ncnn::ConditionVariable condition;
+    std::queue<int> freeslots;
+    std::vector<ncnn::VkBlobAllocator*> allocators;
+};
 
-class SaveThreadParams
+// yuv4mpeg2 or raw rgb24 frames on stdin and stdout
+class StreamParams
 {
 public:
-    int verbose;
+    FILE* in;
+    FILE* out;
+    StreamFormat format;
 };
 
-void* save(void* args)
+// frames of two different shots have little in common, interpolating between them only ghosts
+// compares coarse luma histograms over a sparse grid of pixels, cheap next to decoding either frame
+class SceneCutDetector
 {
-    const SaveThreadParams* stp = (const SaveThreadParams*)args;
-    const int verbose = stp->verbose;
+public:
+    SceneCutDetector(float _threshold) : threshold(_threshold), detected(0), fp(0)
+    {
+    }
 
-    for (;;)
+    ~SceneCutDetector()
     {
-        Task v;
+        if (fp)
+            fclose(fp);
+    }
+
+    // also append every cut to path as soon as it is found, so a killed -r run keeps the cuts of the frames it finished
+    int append_to(const path_t& path)
+    {
+#if _WIN32
+        fp = _wfopen(path.c_str(), L"a, ccs=UTF-8");
+#else
+        fp = fopen(path.c_str(), "a");
+#endif
+        return fp ? 0 : -1;
+    }
 
-        tosave.get(v);
+    // records the pair by the path of its second frame when a and b differ by at least the threshold
+    // streams have no paths, their cuts are only counted
+    bool detect(const path_t& path, const ncnn::Mat& a, const ncnn::Mat& b)
+    {
+        const float score = difference(a, b);
+        if (score < threshold)
+            return false;
 
-        if (v.id == -233)
-            break;
+        lock.lock();
+
+        detected++;
 
-        int ret = encode_image(v.outpath, v.outimage);
+        if (!path.empty())
+            cuts[path] = score;
 
-        // free input pixel data
+        if (fp && !path.empty())
         {
-            unsigned char* pixeldata = (unsigned char*)v.in0image.data;
-            if (v.webp0 == 1)
-            {
-                free(pixeldata);
-            }
-            else
-            {
 #if _WIN32
-                free(pixeldata);
+            fwprintf(fp, L"%ls %.4f\n", path.c_str(), score);
 #else
-                stbi_image_free(pixeldata);
+            fprintf(fp, "%s %.4f\n", path.c_str(), score);
 #endif
-            }
+            fflush(fp);
         }
+
+        lock.unlock();
+
+        return true;
+    }
+
+    int count() const
+    {
+        return detected;
+    }
+
+    // one line per cut in frame order, the first frame of the new shot and its score
+    // merge keeps the cuts that earlier -r runs listed in path, each frame once
+    int save(const path_t& path, bool merge)
+    {
+        std::map<path_t, float> lines;
+        if (merge)
         {
-            unsigned char* pixeldata = (unsigned char*)v.in1image.data;
-            if (v.webp1 == 1)
-            {
-                free(pixeldata);
-            }
-            else
-            {
-#if _WIN32
-                free(pixeldata);
-#else
-                stbi_image_free(pixeldata);
-#endif
-            }
+            load(path, lines);
         }
 
-        if (ret == 0)
-        {
-            if (verbose)
-            {
+        for (std::map<path_t, float>::const_iterator it = cuts.begin(); it != cuts.end(); it++)
+        {
+            lines[it->first] = it->second;
+        }
+
+        if (fp)
+        {
+            fclose(fp);
+            fp = 0;
+        }
+
+#if _WIN32
+        FILE* out = _wfopen(path.c_str(), L"w, ccs=UTF-8");
+#else
+        FILE* out = fopen(path.c_str(), "wb");
+#endif
+        if (!out)
+            return -1;
+
+        // directory input is sorted by name, so name order is frame order
+        for (std::map<path_t, float>::const_iterator it = lines.begin(); it != lines.end(); it++)
+        {
+#if _WIN32
+            fwprintf(out, L"%ls %.4f\n", it->first.c_str(), it->second);
+#else
+            fprintf(out, "%s %.4f\n", it->first.c_str(), it->second);
+#endif
+        }
+
+        fclose(out);
+
+        return 0;
+    }
+
+private:
+    // a torn last line from a killed run is skipped
+    static void load(const path_t& path, std::map<path_t, float>& lines)
+    {
+#if _WIN32
+        FILE* in = _wfopen(path.c_str(), L"r, ccs=UTF-8");
+#else
+        FILE* in = fopen(path.c_str(), "r");
+#endif
+        if (!in)
+            return;
+
+#if _WIN32
+        wchar_t line[1024];
+        while (fgetws(line, 1024, in))
+#else
+        char line[1024];
+        while (fgets(line, 1024, in))
+#endif
+        {
+            path_t s(line);
+            const size_t space = s.rfind(PATHSTR(' '));
+            if (s.empty() || s[s.size() - 1] != PATHSTR('\n') || space == path_t::npos)
+                continue;
+
+#if _WIN32
+            lines[s.substr(0, space)] = (float)_wtof(s.c_str() + space + 1);
+#else
+            lines[s.substr(0, space)] = (float)atof(s.c_str() + space + 1);
+#endif
+        }
+
+        fclose(in);
+    }
+
+    static const int bins = 32;
+
+    static void histogram(const ncnn::Mat& image, int* hist)
+    {
+        const int stepx = std::max(image.w / 64, 1);
+        const int stepy = std::max(image.h / 64, 1);
+
+        for (int y=0; y<image.h; y+=stepy)
+        {
+            const unsigned char* row = (const unsigned char*)image.data + (size_t)y * image.w * 3;
+            for (int x=0; x<image.w; x+=stepx)
+            {
+                const unsigned char* p = row + x * 3;
+                hist[(p[0] * 77 + p[1] * 150 + p[2] * 29) >> 8 >> 3]++;
+            }
+        }
+    }
+
+    // half the l1 distance of the normalized histograms, 0 for identical and 1 for disjoint
+    static float difference(const ncnn::Mat& a, const ncnn::Mat& b)
+    {
+        if (a.data == b.data || a.w != b.w || a.h != b.h)
+            return 0.f;
+
+        int hista[bins] = {0};
+        int histb[bins] = {0};
+        histogram(a, hista);
+        histogram(b, histb);
+
+        int total = 0;
+        int diff = 0;
+        for (int i=0; i<bins; i++)
+        {
+            total += hista[i];
+            diff += abs(hista[i] - histb[i]);
+        }
+
+        return total ? diff * 0.5f / total : 0.f;
+    }
+
+    float threshold;
+    ncnn::Mutex lock;
+    int detected;
+    std::map<path_t, float> cuts;
+    FILE* fp;
+};
+
+// largest mean absolute difference over 32x32 pixel blocks, 0~1
+// a change confined to a small area such as a moving mouth still stands out from the rest of the frame
+static float frame_difference(const ncnn::Mat& a, const ncnn::Mat& b)
+{
+    if (a.data == b.data)
+        return 0.f;
+
+    if (a.w != b.w || a.h != b.h)
+        return 1.f;
+
+    const int block = 32;
+    const int blocks_x = (a.w + block - 1) / block;
+
+    std::vector<int> sums(blocks_x);
+    int maxsum = 0;
+    int maxcount = 1;
+
+    for (int y=0; y<a.h; y++)
+    {
+        const unsigned char* pa = (const unsigned char*)a.data + (size_t)y * a.w * 3;
+        const unsigned char* pb = (const unsigned char*)b.data + (size_t)y * b.w * 3;
+
+        for (int x=0; x<a.w * 3; x++)
+        {
+            sums[x / (block * 3)] += abs(pa[x] - pb[x]);
+        }
+
+        if (y % block == block - 1 || y == a.h - 1)
+        {
+            const int rows = y % block + 1;
+            for (int i=0; i<blocks_x; i++)
+            {
+                const int count = std::min(block, a.w - i * block) * rows * 3;
+                if ((long long)sums[i] * maxcount > (long long)maxsum * count)
+                {
+                    maxsum = sums[i];
+                    maxcount = count;
+                }
+
+                sums[i] = 0;
+            }
+        }
+    }
+
+    return maxsum / (maxcount * 255.f);
+}
+
+// output frames across a scene cut or between duplicates repeat the nearest source frame instead of entering rife
+static void hold_nearest_frame(Task& v)
+{
+    for (size_t i=0; i<v.timesteps.size(); i++)
+    {
+        if (v.timesteps[i] <= 0.5f)
+        {
+            v.timesteps[i] = 0.f;
+            v.outimages[i] = v.in0image;
+        }
+        else
+        {
+            v.timesteps[i] = 1.f;
+            v.outimages[i] = v.in1image;
+        }
+    }
+}
+
+// peak resident memory of the process in bytes
+static size_t peak_host_memory()
+{
+#if _WIN32
+    PROCESS_MEMORY_COUNTERS pmc;
+    if (!GetProcessMemoryInfo(GetCurrentProcess(), &pmc, sizeof(pmc)))
+        return 0;
+
+    return pmc.PeakWorkingSetSize;
+#else
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0)
+        return 0;
+
+#if __APPLE__
+    return (size_t)usage.ru_maxrss;
+#else
+    return (size_t)usage.ru_maxrss * 1024;
+#endif
+#endif
+}
+
+// device local memory this process holds on the gpu, 0 without VK_EXT_memory_budget
+static size_t gpu_memory_usage(int gpuid)
+{
+    const ncnn::GpuInfo& info = ncnn::get_gpu_info(gpuid);
+    if (!info.support_VK_EXT_memory_budget())
+        return 0;
+
+    VkPhysicalDeviceMemoryBudgetPropertiesEXT budget;
+    budget.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_BUDGET_PROPERTIES_EXT;
+    budget.pNext = 0;
+
+    VkPhysicalDeviceMemoryProperties2KHR properties;
+    properties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_PROPERTIES_2_KHR;
+    properties.pNext = &budget;
+
+    ncnn::vkGetPhysicalDeviceMemoryProperties2KHR(info.physical_device(), &properties);
+
+    size_t usage = 0;
+    for (uint32_t i=0; i<properties.memoryProperties.memoryHeapCount; i++)
+    {
+        if (properties.memoryProperties.memoryHeaps[i].flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT)
+            usage += budget.heapUsage[i];
+    }
+
+    return usage;
+}
+
+// synthetic pairs for -b, driven through the same scheduler and proc threads as a real run
+// no file, decoder or encoder is involved, outputs are dropped at save
+class BenchmarkRun
+{
+public:
+    BenchmarkRun(int _w, int _h, int _warmup, int _pairs, const std::vector<int>& _gpuid)
+        : w(_w), h(_h), warmup(_warmup), pairs(_pairs), gpuid(_gpuid), finished(0), start(0), end(0)
+    {
+        // consecutive frames alternate between the two, so a pair shares one frame with the previous like real footage
+        synthesize_frame(w, h, 0, 0, frames[0]);
+        synthesize_frame(w, h, 8, 4, frames[1]);
+
+        peak_gpu_memory.resize(gpuid.size(), 0);
+    }
+
+    int total() const
+    {
+        return warmup + pairs;
+    }
+
+    const ncnn::Mat& frame(int index) const
+    {
+        return frames[index % 2];
+    }
+
+    void begin()
+    {
+        lock.lock();
+        start = ncnn::get_current_time();
+        lock.unlock();
+    }
+
+    // throughput is measured from the point warmup pairs have finished to the last one
+    void done(int id, int device, double ms)
+    {
+        const size_t usage = gpuid[device] == -1 ? 0 : gpu_memory_usage(gpuid[device]);
+
+        lock.lock();
+
+        finished++;
+        if (finished == warmup)
+            start = ncnn::get_current_time();
+        if (finished == total())
+            end = ncnn::get_current_time();
+
+        if (id >= warmup)
+            latencies.push_back(ms);
+
+        peak_gpu_memory[device] = std::max(peak_gpu_memory[device], usage);
+
+        lock.unlock();
+    }
+
+    // the measured members of the json report
+    void report(FILE* fp)
+    {
+        std::sort(latencies.begin(), latencies.end());
+
+        const double seconds = (end - start) / 1000;
+
+        fprintf(fp, "\"width\":%d,\"height\":%d,\"warmup\":%d,\"pairs\":%d,\"seconds\":%.3f,\"pairs_per_sec\":%.3f,", w, h, warmup, pairs, seconds, seconds > 0 ? pairs / seconds : 0.0);
+        fprintf(fp, "\"latency_ms\":{\"p50\":%.2f,\"p90\":%.2f,\"p99\":%.2f,\"max\":%.2f},", percentile(0.5), percentile(0.9), percentile(0.99), latencies.empty() ? 0.0 : latencies.back());
+        fprintf(fp, "\"peak_host_bytes\":%zu,\"peak_gpu_bytes\":[", peak_host_memory());
+        for (size_t i=0; i<peak_gpu_memory.size(); i++)
+        {
+            fprintf(fp, i == 0 ? "%zu" : ",%zu", peak_gpu_memory[i]);
+        }
+        fprintf(fp, "]}\n");
+    }
+
+private:
+    // nearest rank
+    double percentile(double p) const
+    {
+        if (latencies.empty())
+            return 0.0;
+
+        size_t rank = (size_t)ceil(p * latencies.size());
+        return latencies[std::max(rank, (size_t)1) - 1];
+    }
+
+    int w;
+    int h;
+    int warmup;
+    int pairs;
+    std::vector<int> gpuid;
+    ncnn::Mat frames[2];
+
+    ncnn::Mutex lock;
+    int finished;
+    double start;
+    double end;
+    std::vector<double> latencies;
+    std::vector<size_t> peak_gpu_memory;
+};
+
+class LoadThreadParams
+{
+public:
+    int jobs_load;
+
+    // session data
+    std::vector<path_t> input_files;
+    std::vector<int> input0_indexes;
+    std::vector<int> input1_indexes;
+    std::vector<path_t> output_files;
+    std::vector<float> timesteps;
+
+    // output frames [pair_offsets[i], pair_offsets[i+1]) share the same source pair
+    std::vector<int> pair_offsets;
+
+    // read from a pipe instead, see load_stream
+    const StreamParams* stream;
+
+    // sequential sink, tasks are only loaded within its window
+    ReorderBuffer* reorder;
+
+    // pairs it flags skip proc and go straight to save
+    SceneCutDetector* scenecut;
+
+    // pairs differing by no more than this are duplicates and skip proc too, 0 for off
+    float dedup_threshold;
+
+    // generate synthetic pairs instead, see load_benchmark
+    BenchmarkRun* benchmark;
+
+    // source frames repeating the one before within dedup_threshold are held drawings, see load_retime
+    bool retime;
+    int verbose;
+};
+
+// duplicates and scene cuts hold the nearest frame and go straight to save, every other pair goes to proc
+static void put_loaded_task(const LoadThreadParams* ltp, Task& v)
+{
+    v.slot = -1;
+    v.outimages.resize(v.outpaths.size());
+
+    if ((ltp->dedup_threshold > 0.f && frame_difference(v.in0image, v.in1image) <= ltp->dedup_threshold)
+        || (ltp->scenecut && ltp->scenecut->detect(v.in1path, v.in0image, v.in1image)))
+    {
+        hold_nearest_frame(v);
+        tosave.put(v);
+        return;
+    }
+
+    for (size_t j=0; j<v.outpaths.size(); j++)
+    {
+        v.outimages[j] = ncnn::Mat(v.in0image.w, v.in0image.h, (size_t)3, 3, frame_pool()->frame_allocator());
+    }
+
+    TraceScope scope("load wait", -1, v.id);
+    toproc.put(v);
+}
+
+void* load(void* args)
+{
+    const LoadThreadParams* ltp = (const LoadThreadParams*)args;
+    const int count = (int)ltp->pair_offsets.size() - 1;
+
+    #pragma omp parallel for schedule(static,1) num_threads(ltp->jobs_load)
+    for (int i=0; i<count; i++)
+    {
+        const int begin = ltp->pair_offsets[i];
+        const int end = ltp->pair_offsets[i + 1];
+
+        if (ltp->reorder)
+        {
+            ltp->reorder->wait(i);
+        }
+
+        Task v;
+        v.id = i;
+        v.in0index = ltp->input0_indexes[begin];
+        v.in1index = ltp->input1_indexes[begin];
+        v.in0path = ltp->input_files[v.in0index];
+        v.in1path = ltp->input_files[v.in1index];
+        v.outpaths.assign(ltp->output_files.begin() + begin, ltp->output_files.begin() + end);
+        v.timesteps.assign(ltp->timesteps.begin() + begin, ltp->timesteps.begin() + end);
+
+        int ret0 = framewindow.acquire(v.in0index, v.in0image);
+        int ret1 = framewindow.acquire(v.in1index, v.in1image);
+
+        if (ret0 == 0 && ret1 == 0)
+        {
+            put_loaded_task(ltp, v);
+        }
+        else
+        {
+            framewindow.release(v.in0index);
+            framewindow.release(v.in1index);
+
+            if (ltp->reorder)
+            {
+                ltp->reorder->skip(i);
+            }
+        }
+    }
+
+    return 0;
+}
+
+// outputs [begin, end) all fall within the hold of drawing d0 and are interpolated towards drawing d1
+static void put_retimed_task(const LoadThreadParams* ltp, const std::vector<double>& times, int id, int begin, int end, int d0, const ncnn::Mat& image0, int d1, const ncnn::Mat& image1)
+{
+    // a drawing that failed to decode fails its outputs
+    if (image0.empty() || image1.empty())
+        return;
+
+    Task v;
+    v.id = id;
+    v.in0index = d0;
+    v.in1index = d1;
+    v.in0path = ltp->input_files[d0];
+    v.in1path = ltp->input_files[d1];
+    v.in0image = image0;
+    v.in1image = image1;
+    v.outpaths.assign(ltp->output_files.begin() + begin, ltp->output_files.begin() + end);
+    for (int i=begin; i<end; i++)
+    {
+        v.timesteps.push_back(d1 == d0 ? 0.f : (float)((times[i] - d0) / (d1 - d0)));
+    }
+
+    framewindow.add_use(d0);
+    framewindow.add_use(d1);
+
+    put_loaded_task(ltp, v);
+}
+
+// anime drawn on twos or threes holds every drawing for several frames
+// interpolate between the first frames of consecutive drawings instead, re-spacing each output time across the whole hold
+// source frames are decoded ahead by all load threads and compared with the one before in order
+// the outputs of a drawing are handed on as soon as the next drawing is found, outputs after the last drawing keep showing it
+void* load_retime(void* args)
+{
+    const LoadThreadParams* ltp = (const LoadThreadParams*)args;
+    const int count = (int)ltp->input_files.size();
+    const int outcount = (int)ltp->output_files.size();
+
+    if (outcount == 0)
+        return 0;
+
+    // source time of every output frame, ascending
+    std::vector<double> times(outcount);
+    for (int i=0; i<outcount; i++)
+    {
+        times[i] = ltp->input0_indexes[i] + (ltp->input1_indexes[i] - ltp->input0_indexes[i]) * (double)ltp->timesteps[i];
+    }
+
+    const float threshold = ltp->dedup_threshold;
+    int repeats = 0;
+
+    // the frame shown at the first output, compared with the next one
+    const int start = std::min(std::max((int)floor(times[0]), 0), count - 1);
+    ncnn::Mat prev;
+    decode_image(ltp->input_files[start], prev);
+
+    // the drawing held at start may have begun before it, walk back to its first frame
+    int d0 = start;
+    ncnn::Mat image0 = prev;
+    while (d0 > 0 && !image0.empty())
+    {
+        ncnn::Mat before;
+        decode_image(ltp->input_files[d0 - 1], before);
+
+        if (before.empty() || frame_difference(before, image0) > threshold)
+        {
+            frame_pool_free(before.data);
+            break;
+        }
+
+        if (image0.data != prev.data)
+            frame_pool_free(image0.data);
+
+        image0 = before;
+        d0--;
+        repeats++;
+    }
+
+    // prev is a repeat owned here unless it is the drawing itself
+    bool prev_owned = prev.data != image0.data;
+
+    framewindow.insert(d0, image0);
+
+    int next = 0;
+    int id = 0;
+    std::atomic<bool> finished(false);
+
+    #pragma omp parallel for ordered schedule(static,1) num_threads(ltp->jobs_load)
+    for (int j=start + 1; j<count; j++)
+    {
+        ncnn::Mat image;
+        if (!finished)
+        {
+            decode_image(ltp->input_files[j], image);
+        }
+
+        #pragma omp ordered
+        {
+            if (finished)
+            {
+                frame_pool_free(image.data);
+            }
+            else if (!image.empty() && !prev.empty() && frame_difference(prev, image) <= threshold)
+            {
+                if (prev_owned)
+                    frame_pool_free(prev.data);
+
+                prev = image;
+                prev_owned = true;
+                repeats++;
+            }
+            else
+            {
+                if (prev_owned)
+                    frame_pool_free(prev.data);
+
+                // j starts the next drawing
+                framewindow.insert(j, image);
+
+                int end = next;
+                while (end < outcount && times[end] < j)
+                    end++;
+
+                if (end > next)
+                {
+                    put_retimed_task(ltp, times, id++, next, end, d0, image0, j, image);
+                    next = end;
+                }
+
+                framewindow.release(d0);
+
+                d0 = j;
+                image0 = image;
+                prev = image;
+                prev_owned = false;
+
+                if (next == outcount)
+                    finished = true;
+            }
+        }
+    }
+
+    if (next < outcount)
+    {
+        put_retimed_task(ltp, times, id++, next, outcount, d0, image0, d0, image0);
+    }
+
+    framewindow.release(d0);
+
+    if (prev_owned)
+        frame_pool_free(prev.data);
+
+    if (ltp->verbose)
+    {
+        fprintf(stderr, "retime, %d source frames repeat the one before\n", repeats);
+    }
+
+    return 0;
+}
+
+// read frames one after another and emit every consecutive pair, the input frame first and then the midpoint
+// the last frame is repeated, matching the N*2 frame count of directory mode
+void* load_stream(void* args)
+{
+    const LoadThreadParams* ltp = (const LoadThreadParams*)args;
+    const StreamParams* sp = ltp->stream;
+
+    ncnn::Mat raw0;
+    ncnn::Mat image0;
+    if (stream_read_frame(sp->in, sp->format, raw0, frame_pool()) != 0)
+        return 0;
+
+    stream_frame_to_image(sp->format, raw0, image0, ltp->jobs_load, frame_pool()->frame_allocator());
+
+    for (int i=0; ; i++)
+    {
+        ltp->reorder->wait(i);
+
+        ncnn::Mat raw1;
+        ncnn::Mat image1;
+        bool last;
+        {
+            TraceScope scope("read", -1, i);
+            last = stream_read_frame(sp->in, sp->format, raw1, frame_pool()) != 0;
+        }
+        if (last)
+        {
+            raw1 = raw0;
+            image1 = image0;
+        }
+        else
+        {
+            TraceScope scope("decode", -1, i);
+            stream_frame_to_image(sp->format, raw1, image1, ltp->jobs_load, frame_pool()->frame_allocator());
+        }
+
+        Task v;
+        v.id = i;
+        v.in0index = i;
+        v.in1index = last ? i : i + 1;
+        v.outpaths.resize(2);
+        v.timesteps.resize(2);
+        v.timesteps[0] = 0.f;
+        v.timesteps[1] = last ? 0.f : 0.5f;
+        v.in0image = image0;
+        v.in1image = image1;
+        v.in0raw = raw0;
+        v.in1raw = raw1;
+        v.slot = -1;
+        v.outimages.resize(2);
+
+        if (!last && ((ltp->dedup_threshold > 0.f && frame_difference(image0, image1) <= ltp->dedup_threshold)
+            || (ltp->scenecut && ltp->scenecut->detect(path_t(), image0, image1))))
+        {
+            // the held frame is written back from its raw copy
+            hold_nearest_frame(v);
+            tosave.put(v);
+        }
+        else
+        {
+            if (!last)
+            {
+                v.outimages[1] = ncnn::Mat(image0.w, image0.h, (size_t)3, 3, frame_pool()->frame_allocator());
+            }
+
+            TraceScope scope("load wait", -1, i);
+            toproc.put(v);
+        }
+
+        if (last)
+            break;
+
+        raw0 = raw1;
+        image0 = image1;
+    }
+
+    return 0;
+}
+
+void* load_benchmark(void* args)
+{
+    const LoadThreadParams* ltp = (const LoadThreadParams*)args;
+    BenchmarkRun* bench = ltp->benchmark;
+
+    bench->begin();
+
+    for (int i=0; i<bench->total(); i++)
+    {
+        Task v;
+        v.id = i;
+        v.in0index = i;
+        v.in1index = i + 1;
+        v.timesteps.resize(1, 0.5f);
+        v.in0image = bench->frame(i);
+        v.in1image = bench->frame(i + 1);
+        v.slot = -1;
+        v.outimages.resize(1);
+        v.outimages[0] = ncnn::Mat(v.in0image.w, v.in0image.h, (size_t)3, 3, frame_pool()->frame_allocator());
+
+        toproc.put(v);
+    }
+
+    return 0;
+}
+
+// gpu memory per input pixel of one pair in flight when it cannot be measured, without VK_EXT_memory_budget
+// summing the live fp16 blobs of the rife-v4 flownet layer by layer peaks at about 80 bytes per padded pixel,
+// the older models add the contextnet pyramids of both frames and a full resolution fusionnet on top,
+// so four times that leaves room for them and the block rounding of the blob allocator
+// too large only costs parallelism, too small can exhaust the heap
+static const size_t vram_bytes_per_pixel = 320;
+
+// hands the tasks of toproc to the devices
+// each device takes a run of consecutive pairs, longer for faster devices, so that neighbouring pairs
+// share its cached frame features, and an idle device steals from the back of the longest run
+// a gpu never has more pairs in flight than its free memory holds
+// the memory of one pair is measured on its first pair, which runs alone, from the growth of the device heap usage
+class GpuScheduler
+{
+public:
+    GpuScheduler(const std::vector<int>& gpuid, const std::vector<int>& jobs_proc, const std::vector<int>& tilesize) : ended(false), refilling(false)
+    {
+        devices.resize(gpuid.size());
+        for (size_t i=0; i<gpuid.size(); i++)
+        {
+            Device& d = devices[i];
+            d.gpuid = gpuid[i];
+            d.jobs = gpuid[i] == -1 ? 1 : jobs_proc[i];
+            d.tilesize = gpuid[i] == -1 ? 0 : tilesize[i];
+            d.heap_budget = gpuid[i] == -1 ? 0 : (size_t)ncnn::get_gpu_device(gpuid[i])->get_heap_budget() * 1024 * 1024;
+            d.heap_usage = gpuid[i] == -1 ? 0 : gpu_memory_usage(gpuid[i]);
+            d.bytes_per_pixel = d.heap_usage == 0 ? vram_bytes_per_pixel : 0;
+            d.inflight = 0;
+            d.ms_per_pair = 0.0;
+        }
+    }
+
+    // the next task of device, id -233 once toproc has ended and nothing is left to steal
+    void get(int device, Task& v)
+    {
+        Device& d = devices[device];
+
+        lock.lock();
+
+        for (;;)
+        {
+            if (d.tasks.empty())
+            {
+                refill(device);
+            }
+
+            if (d.tasks.empty())
+            {
+                steal(device);
+            }
+
+            if (!d.tasks.empty())
+            {
+                if (d.inflight >= inflight_limit(device, d.tasks.front()))
+                {
+                    condition.wait(lock);
+                    continue;
+                }
+
+                v = std::move(d.tasks.front());
+                d.tasks.pop_front();
+                d.inflight++;
+                break;
+            }
+
+            if (ended)
+            {
+                v.id = -233;
+                break;
+            }
+
+            if (refilling)
+            {
+                condition.wait(lock);
+                continue;
+            }
+
+            // one thread waits on toproc for everyone, the others sleep until it brings something
+            refilling = true;
+
+            lock.unlock();
+
+            Task t;
+            toproc.get(t);
+
+            lock.lock();
+
+            refilling = false;
+
+            if (t.id == -233)
+                ended = true;
+            else
+                d.tasks.push_back(std::move(t));
+
+            condition.broadcast();
+        }
+
+        lock.unlock();
+    }
+
+    // the task v from get() has left device after ms
+    void done(int device, const Task& v, double ms)
+    {
+        Device& d = devices[device];
+
+        lock.lock();
+
+        if (d.bytes_per_pixel == 0 && !tiled(device, v))
+        {
+            // the pair ran alone and the blob allocators keep what it needed at its peak
+            lock.unlock();
+            const size_t usage = gpu_memory_usage(d.gpuid);
+            lock.lock();
+
+            const size_t pixels = (size_t)v.in0image.w * v.in0image.h;
+            d.bytes_per_pixel = usage > d.heap_usage ? std::max((usage - d.heap_usage) / std::max(pixels, (size_t)1), (size_t)1) : vram_bytes_per_pixel;
+        }
+
+        d.inflight--;
+        d.ms_per_pair = d.ms_per_pair == 0.0 ? ms : d.ms_per_pair * 0.9 + ms * 0.1;
+
+        lock.unlock();
+
+        condition.broadcast();
+    }
+
+private:
+    // pairs per second, all proc threads of the device together
+    double rate(int device) const
+    {
+        const Device& d = devices[device];
+        return d.ms_per_pair == 0.0 ? 0.0 : d.jobs * 1000.0 / d.ms_per_pair;
+    }
+
+    // two pairs per run for an average device, scaled by measured speed
+    int run_length(int device) const
+    {
+        double sum = 0.0;
+        int count = 0;
+        for (size_t i=0; i<devices.size(); i++)
+        {
+            if (rate(i) > 0.0)
+            {
+                sum += rate(i);
+                count++;
+            }
+        }
+
+        if (rate(device) == 0.0 || count == 0)
+            return 2;
+
+        int n = (int)(2.0 * rate(device) * count / sum + 0.5);
+        return std::max(1, std::min(n, 8));
+    }
+
+    bool tiled(int device, const Task& v) const
+    {
+        const int tilesize = devices[device].tilesize;
+        return tilesize > 0 && (v.in0image.w > tilesize || v.in0image.h > tilesize);
+    }
+
+    int inflight_limit(int device, const Task& v) const
+    {
+        const Device& d = devices[device];
+
+        // tiles keep the memory of a pair bounded on their own
+        if (d.heap_budget == 0 || tiled(device, v))
+            return INT_MAX;
+
+        // the first pair runs alone until its memory is known
+        if (d.bytes_per_pixel == 0)
+            return 1;
+
+        const size_t pair_bytes = (size_t)v.in0image.w * v.in0image.h * d.bytes_per_pixel;
+        return (int)std::max((size_t)1, d.heap_budget / std::max(pair_bytes, (size_t)1));
+    }
+
+    // take a run of what toproc already has, without blocking
+    // not while a thread is blocked in toproc.get, it could never wake up if the end marker were taken here
+    void refill(int device)
+    {
+        if (ended || refilling)
+            return;
+
+        Device& d = devices[device];
+
+        const int n = run_length(device);
+        for (int i=0; i<n; i++)
+        {
+            Task t;
+            if (!toproc.try_get(t))
+                break;
+
+            if (t.id == -233)
+            {
+                ended = true;
+                break;
+            }
+
+            d.tasks.push_back(std::move(t));
+        }
+    }
+
+    // the victim keeps the head of its run, unless the input is over or the victim cannot start it yet
+    void steal(int device)
+    {
+        int victim = -1;
+        size_t longest = 0;
+        for (size_t i=0; i<devices.size(); i++)
+        {
+            const Device& d = devices[i];
+            if ((int)i == device || d.tasks.empty())
+                continue;
+
+            const size_t keep = ended || d.inflight >= inflight_limit(i, d.tasks.front()) ? 0 : 1;
+            if (d.tasks.size() > keep && d.tasks.size() > longest)
+            {
+                victim = i;
+                longest = d.tasks.size();
+            }
+        }
+
+        if (victim == -1)
+            return;
+
+        devices[device].tasks.push_back(std::move(devices[victim].tasks.back()));
+        devices[victim].tasks.pop_back();
+    }
+
+    class Device
+    {
+    public:
+        std::deque<Task> tasks;
+        int gpuid;
+        int jobs;
+        int tilesize;
+        size_t heap_budget;
+        size_t heap_usage;// after the model was loaded, before the first pair
+        size_t bytes_per_pixel;// 0 until measured
+        int inflight;
+        double ms_per_pair;
+    };
+
+    ncnn::Mutex lock;
+    ncnn::ConditionVariable condition;
+    std::vector<Device> devices;
+    bool ended;
+    bool refilling;
+};
+
+class UploadThreadParams
+{
+public:
+    const RIFE* rife;
+    GpuScheduler* scheduler;
+    int device;
+    UploadSlots* slots;
+    TaskQueue* touploaded;
+    int jobs_proc;
+};
+
+void* upload(void* args)
+{
+    const UploadThreadParams* utp = (const UploadThreadParams*)args;
+    const RIFE* rife = utp->rife;
+
+    for (;;)
+    {
+        Task v;
+
+        utp->scheduler->get(utp->device, v);
+
+        if (v.id == -233)
+            break;
+
+        // blocks while all slots are in flight
+        v.slot = utp->slots->acquire();
+
+        rife->upload(v.in0image, v.in1image, v.in0_gpu, v.in1_gpu, utp->slots->allocator(v.slot));
+
+        utp->touploaded->put(v);
+    }
+
+    for (int i=0; i<utp->jobs_proc; i++)
+    {
+        Task end;
+        end.id = -233;
+        utp->touploaded->put(end);
+    }
+
+    return 0;
+}
+
+class ProcThreadParams
+{
+public:
+    const RIFE* rife;
+    bool rife_v4;
+
+    GpuScheduler* scheduler;
+    int device;
+
+    // trace events are recorded under this gpu id
+    int gpuid;
+
+    // the per-gpu queue fed by the upload thread in async mode, null to take tasks from the scheduler
+    TaskQueue* queue;
+    UploadSlots* slots;
+
+    // every finished pair is reported here in -b runs
+    BenchmarkRun* benchmark;
+};
+
+void* proc(void* args)
+{
+    const ProcThreadParams* ptp = (const ProcThreadParams*)args;
+    const RIFE* rife = ptp->rife;
+    const bool rife_v4 = ptp->rife_v4;
+
+    for (;;)
+    {
+        Task v;
+
+        {
+            TraceScope scope("proc wait", ptp->gpuid);
+
+            if (ptp->queue)
+                ptp->queue->get(v);
+            else
+                ptp->scheduler->get(ptp->device, v);
+        }
+
+        if (v.id == -233)
+            break;
+
+        const double start = ncnn::get_current_time();
+        const double trace_start = trace_now();
+
+        if (rife_v4)
+        {
+            rife->process_v4_multi(v.in0image, v.in1image, v.timesteps, v.outimages, v.in0_gpu, v.in1_gpu);
+        }
+        else
+        {
+            for (size_t i=0; i<v.timesteps.size(); i++)
+            {
+                rife->process(v.in0image, v.in1image, v.timesteps[i], v.outimages[i], v.in0index, v.in1index, v.in0_gpu, v.in1_gpu);
+            }
+        }
+
+        if (v.slot != -1)
+        {
+            // hand the slot back to the upload thread
+            v.in0_gpu.release();
+            v.in1_gpu.release();
+            ptp->slots->release(v.slot);
+            v.slot = -1;
+        }
+
+        const double ms = ncnn::get_current_time() - start;
+
+        ptp->scheduler->done(ptp->device, v, ms);
+
+        if (ptp->benchmark)
+        {
+            ptp->benchmark->done(v.id, ptp->device, ms);
+        }
+
+        if (trace_enabled())
+        {
+            trace_event("proc", ptp->gpuid, trace_start, trace_now(), v.id);
+        }
+
+        tosave.put(v);
+    }
+
+    return 0;
+}
+
+// receives every output frame as soon as it is written
+class JobEvents
+{
+public:
+    virtual ~JobEvents()
+    {
+    }
+
+    virtual void frame(const path_t& outpath, int ret) = 0;
+};
+
+// writes the frames of each task to the output stream in task order, whichever save thread finishes first
+class StreamWriter : public ReorderBuffer
+{
+public:
+    StreamWriter(const StreamParams* _sp, int window) : ReorderBuffer(window), sp(_sp)
+    {
+    }
+
+    const StreamFormat& format() const
+    {
+        return sp->format;
+    }
+
+protected:
+    virtual void emit(const Task& v)
+    {
+        for (size_t i=0; i<v.outimages.size(); i++)
+        {
+            stream_write_frame(sp->out, sp->format, v.outimages[i]);
+        }
+
+        fflush(sp->out);
+    }
+
+private:
+    const StreamParams* sp;
+};
+
+// output frames completed by -r runs, one file name per line next to the frames
+// a name is appended only after its frame was renamed into place
+class ResumeManifest
+{
+public:
+    ResumeManifest(const path_t& _dirpath) : dirpath(_dirpath), fp(0)
+    {
+        path = dirpath + PATHSTR("/.rife-ncnn-vulkan-resume");
+    }
+
+    ~ResumeManifest()
+    {
+        if (fp)
+            fclose(fp);
+    }
+
+    // a torn last line from a killed run never matches a name
+    void load(std::set<path_t>& names) const
+    {
+#if _WIN32
+        FILE* in = _wfopen(path.c_str(), L"r, ccs=UTF-8");
+#else
+        FILE* in = fopen(path.c_str(), "r");
+#endif
+        if (!in)
+            return;
+
+#if _WIN32
+        wchar_t line[1024];
+        while (fgetws(line, 1024, in))
+#else
+        char line[1024];
+        while (fgets(line, 1024, in))
+#endif
+        {
+            path_t name(line);
+            if (name.empty() || name[name.size() - 1] != PATHSTR('\n'))
+                continue;
+
+            names.insert(name.substr(0, name.size() - 1));
+        }
+
+        fclose(in);
+    }
+
+    int open()
+    {
+#if _WIN32
+        fp = _wfopen(path.c_str(), L"a, ccs=UTF-8");
+#else
+        fp = fopen(path.c_str(), "a");
+#endif
+        return fp ? 0 : -1;
+    }
+
+    void add(const path_t& filepath)
+    {
+        path_t name = filepath.substr(dirpath.size() + 1);
+
+        lock.lock();
+#if _WIN32
+        fwprintf(fp, L"%ls\n", name.c_str());
+#else
+        fprintf(fp, "%s\n", name.c_str());
+#endif
+        fflush(fp);
+        lock.unlock();
+    }
+
+    // drop output frames recorded by earlier runs that are still on disk
+    // source frames only referenced by them are never decoded
+    void skip_done(std::vector<int>& input0_indexes, std::vector<int>& input1_indexes, std::vector<path_t>& output_files, std::vector<float>& timesteps) const
+    {
+        std::set<path_t> names;
+        load(names);
+
+        int count = 0;
+        for (size_t i=0; i<output_files.size(); i++)
+        {
+            if (names.count(output_files[i].substr(dirpath.size() + 1)) && filepath_is_readable(output_files[i]))
+                continue;
+
+            input0_indexes[count] = input0_indexes[i];
+            input1_indexes[count] = input1_indexes[i];
+            output_files[count] = output_files[i];
+            timesteps[count] = timesteps[i];
+            count++;
+        }
+
+        input0_indexes.resize(count);
+        input1_indexes.resize(count);
+        output_files.resize(count);
+        timesteps.resize(count);
+    }
+
+private:
+    path_t dirpath;
+    path_t path;
+    FILE* fp;
+    ncnn::Mutex lock;
+};
+
+// output frames compared with reference frames of the same name from an earlier run, for -G
+// frames are compared as interpolated, before encoding, so the references should be lossless png
+class GoldenCheck
+{
+public:
+    GoldenCheck(const path_t& _goldenpath, float _min_psnr, int _max_diff, int _expected)
+        : goldenpath(_goldenpath), min_psnr(_min_psnr), max_diff(_max_diff), expected(_expected), frames(0), failed(0), unreadable(0), worst_psnr(100.0), worst_diff(0)
+    {
+        goldendir = path_is_directory(goldenpath);
+    }
+
+    void compare(const path_t& outpath, const ncnn::Mat& outimage)
+    {
+        path_t path = goldenpath;
+        if (goldendir)
+            path = goldenpath + PATHSTR('/') + outpath.substr(outpath.find_last_of(PATHSTR("/\\")) + 1);
+
+        double psnr = 0.0;
+        int diff = 255;
+
+        ncnn::Mat golden;
+        const bool readable = decode_image(path, golden) == 0;
+        if (readable && golden.w == outimage.w && golden.h == outimage.h && golden.elempack == outimage.elempack)
+        {
+            const unsigned char* p0 = (const unsigned char*)golden.data;
+            const unsigned char* p1 = (const unsigned char*)outimage.data;
+            const size_t size = (size_t)golden.w * golden.h * golden.elempack;
+
+            double sqsum = 0.0;
+            diff = 0;
+            for (size_t i=0; i<size; i++)
+            {
+                const int d = abs(p0[i] - p1[i]);
+                sqsum += d * d;
+                diff = std::max(diff, d);
+            }
+
+            // identical frames are reported as 100db
+            psnr = sqsum == 0.0 ? 100.0 : std::min(10.0 * log10(255.0 * 255.0 * size / sqsum), 100.0);
+        }
+
+        frame_pool_free(golden.data);
+
+        const bool pass = psnr >= min_psnr && diff <= max_diff;
+
+        lock.lock();
+        frames++;
+        if (!pass)
+            failed++;
+        if (!readable)
+            unreadable++;
+        worst_psnr = std::min(worst_psnr, psnr);
+        worst_diff = std::max(worst_diff, diff);
+        lock.unlock();
+
+        if (!readable)
+        {
+#if _WIN32
+            fwprintf(stderr, L"golden %ls decode failed\n", path.c_str());
+#else
+            fprintf(stderr, "golden %s decode failed\n", path.c_str());
+#endif
+        }
+        else if (!pass)
+        {
+#if _WIN32
+            fwprintf(stderr, L"golden %ls mismatch, psnr %.2f max diff %d\n", path.c_str(), psnr, diff);
+#else
+            fprintf(stderr, "golden %s mismatch, psnr %.2f max diff %d\n", path.c_str(), psnr, diff);
+#endif
+        }
+    }
+
+    // every output frame was written and matched a readable reference
+    bool passed() const
+    {
+        return frames == expected && failed == 0 && unreadable == 0;
+    }
+
+    // the measured members of the json report
+    void report(FILE* fp, double seconds) const
+    {
+        fprintf(fp, "\"frames\":%d,\"expected\":%d,\"failed\":%d,\"unreadable\":%d,\"min_psnr\":%.2f,\"max_diff\":%d,\"psnr_tolerance\":%.2f,\"diff_tolerance\":%d,\"seconds\":%.3f}\n", frames, expected, failed, unreadable, worst_psnr, worst_diff, min_psnr, max_diff, seconds);
+    }
+
+private:
+    path_t goldenpath;
+    bool goldendir;
+    float min_psnr;
+    int max_diff;
+    int expected;
+
+    ncnn::Mutex lock;
+    int frames;
+    int failed;
+    int unreadable;
+    double worst_psnr;
+    int worst_diff;
+};
+
+class SaveThreadParams
+{
+public:
+    int verbose;
+    JobEvents* events;
+    StreamWriter* writer;
+    ResumeManifest* manifest;
+    GoldenCheck* golden;
+
+    // benchmark outputs are dropped
+    bool discard;
+};
+
+void* save(void* args)
+{
+    const SaveThreadParams* stp = (const SaveThreadParams*)args;
+    const int verbose = stp->verbose;
+
+    for (;;)
+    {
+        Task v;
+
+        {
+            TraceScope scope("save wait");
+            tosave.get(v);
+        }
+
+        if (v.id == -233)
+            break;
+
+        if (stp->discard)
+            continue;
+
+        if (stp->writer)
+        {
+            // input frames go back out as read, only interpolated ones are converted
+            // conversion runs on every save thread, the reorder buffer only serializes the write
+            for (size_t i=0; i<v.timesteps.size(); i++)
+            {
+                ncnn::Mat frame;
+                if (v.timesteps[i] == 0.f)
+                    frame = v.in0raw;
+                else if (v.timesteps[i] == 1.f)
+                    frame = v.in1raw;
+                else
+                {
+                    TraceScope scope("encode", -1, v.id);
+                    stream_image_to_frame(stp->writer->format(), v.outimages[i], frame, frame_pool());
+                }
+
+                v.outimages[i] = frame;
+            }
+
+            stp->writer->put(v);
+            continue;
+        }
+
+        for (size_t i=0; i<v.outpaths.size(); i++)
+        {
+            if (stp->golden)
+            {
+                stp->golden->compare(v.outpaths[i], v.outimages[i]);
+            }
+
+            int ret;
+            {
+                TraceScope scope("encode", -1, v.id);
+                ret = encode_image(v.outpaths[i], v.outimages[i]);
+            }
+
+            if (stp->events)
+            {
+                stp->events->frame(v.outpaths[i], ret);
+            }
+
+            if (ret == 0)
+            {
+                if (stp->manifest)
+                {
+                    stp->manifest->add(v.outpaths[i]);
+                }
+
+                if (verbose)
+                {
+#if _WIN32
+                    fwprintf(stderr, L"%ls %ls %f -> %ls done\n", v.in0path.c_str(), v.in1path.c_str(), v.timesteps[i], v.outpaths[i].c_str());
+#else
+                    fprintf(stderr, "%s %s %f -> %s done\n", v.in0path.c_str(), v.in1path.c_str(), v.timesteps[i], v.outpaths[i].c_str());
+#endif
+                }
+            }
+        }
+
+        // free input pixel data once no other task needs it
+        framewindow.release(v.in0index);
+        framewindow.release(v.in1index);
+    }
+
+    return 0;
+}
+
+
+// "-" reads yuv4mpeg2, "-:WxH" reads raw rgb24 of the given size
+static bool parse_stream_path(const path_t& path, StreamFormat& format)
+{
+    if (path == PATHSTR("-"))
+    {
+        format.y4m = 1;
+        format.w = 0;
+        format.h = 0;
+        return true;
+    }
+
+    if (path.compare(0, 2, PATHSTR("-:")) == 0)
+    {
+        format.y4m = 0;
+        format.w = 0;
+        format.h = 0;
+#if _WIN32
+        swscanf(path.c_str() + 2, L"%dx%d", &format.w, &format.h);
+#else
+        sscanf(path.c_str() + 2, "%dx%d", &format.w, &format.h);
+#endif
+        return true;
+    }
+
+    return false;
+}
+
+// input and output frames of one interpolation run
+class Job
+{
+public:
+    std::vector<path_t> input_files;
+    std::vector<int> input0_indexes;
+    std::vector<int> input1_indexes;
+    std::vector<path_t> output_files;
+    std::vector<float> timesteps;
+
+    // frames come from a pipe instead of input_files
+    const StreamParams* stream;
+
+    // finished output frames are recorded here
+    ResumeManifest* manifest;
+
+    // where detected scene cuts are listed, empty for none
+    path_t scenecut_path;
+
+    // synthetic pairs instead of any input
+    BenchmarkRun* benchmark;
+
+    // interpolate between held drawings instead of source pairs, see load_retime
+    bool retime;
+
+    // output frames are also checked against reference frames
+    GoldenCheck* golden;
+
+    Job() : stream(0), manifest(0), benchmark(0), retime(false), golden(0)
+    {
+    }
+};
+
+static int collect_job(const path_t& input0path, const path_t& input1path, const path_t& inputpath, const path_t& outputpath, int numframe, float timestep, const path_t& pattern_format, bool rife_v4, Job& job)
+{
+    if (inputpath.empty() && (timestep <= 0.f || timestep >= 1.f))
+    {
+        fprintf(stderr, "invalid timestep argument, must be 0~1\n");
+        return -1;
+    }
+
+    if (!inputpath.empty() && numframe < 0)
+    {
+        fprintf(stderr, "invalid numframe argument, must not be negative\n");
+        return -1;
+    }
+
+    path_t pattern = get_file_name_without_extension(pattern_format);
+    path_t format = get_file_extension(pattern_format);
+
+    if (format.empty())
+    {
+        pattern = PATHSTR("%08d");
+        format = pattern_format;
+    }
+
+    if (pattern.empty())
+    {
+        pattern = PATHSTR("%08d");
+    }
+
+    if (!path_is_directory(outputpath))
+    {
+        // guess format from outputpath no matter what format argument specified
+        path_t ext = get_file_extension(outputpath);
+
+        if (ext == PATHSTR("png") || ext == PATHSTR("PNG"))
+        {
+            format = PATHSTR("png");
+        }
+        else if (ext == PATHSTR("webp") || ext == PATHSTR("WEBP"))
+        {
+            format = PATHSTR("webp");
+        }
+        else if (ext == PATHSTR("jpg") || ext == PATHSTR("JPG") || ext == PATHSTR("jpeg") || ext == PATHSTR("JPEG"))
+        {
+            format = PATHSTR("jpg");
+        }
+        else
+        {
+            fprintf(stderr, "invalid outputpath extension type\n");
+            return -1;
+        }
+    }
+
+    if (format != PATHSTR("png") && format != PATHSTR("webp") && format != PATHSTR("jpg"))
+    {
+        fprintf(stderr, "invalid format argument\n");
+        return -1;
+    }
+
+    if (!rife_v4 && (numframe != 0 || timestep != 0.5))
+    {
+        fprintf(stderr, "only rife-v4 model support custom numframe and timestep\n");
+        return -1;
+    }
+
+    // collect input and output filepath
+    std::vector<path_t>& input_files = job.input_files;
+    std::vector<int>& input0_indexes = job.input0_indexes;
+    std::vector<int>& input1_indexes = job.input1_indexes;
+    std::vector<path_t>& output_files = job.output_files;
+    std::vector<float>& timesteps = job.timesteps;
+    {
+        if (!inputpath.empty() && path_is_directory(inputpath) && path_is_directory(outputpath))
+        {
+            std::vector<path_t> filenames;
+            int lr = list_directory(inputpath, filenames);
+            if (lr != 0)
+                return -1;
+
+            const int count = filenames.size();
+            if (numframe == 0)
+                numframe = count * 2;
+
+            input_files.resize(count);
+            for (int i=0; i<count; i++)
+            {
+                input_files[i] = inputpath + PATHSTR('/') + filenames[i];
+            }
+
+            input0_indexes.resize(numframe);
+            input1_indexes.resize(numframe);
+            output_files.resize(numframe);
+            timesteps.resize(numframe);
+
+            double scale = (double)count / numframe;
+            for (int i=0; i<numframe; i++)
+            {
+                // TODO provide option to control timestep interpolate method
+//                 float fx = (float)((i + 0.5) * scale - 0.5);
+                float fx = i * scale;
+                int sx = static_cast<int>(floor(fx));
+                fx -= sx;
+
+                if (sx < 0)
+                {
+                    sx = 0;
+                    fx = 0.f;
+                }
+                if (sx >= count - 1)
+                {
+                    sx = count - 2;
+                    fx = 1.f;
+                }
+
+//                 fprintf(stderr, "%d %f %d\n", i, fx, sx);
+
+#if _WIN32
+                wchar_t tmp[256];
+                swprintf(tmp, pattern.c_str(), i+1);
+#else
+                char tmp[256];
+                sprintf(tmp, pattern.c_str(), i+1); // ffmpeg start from 1
+#endif
+                path_t output_filename = path_t(tmp) + PATHSTR('.') + format;
+
+                input0_indexes[i] = sx;
+                input1_indexes[i] = sx + 1;
+                output_files[i] = outputpath + PATHSTR('/') + output_filename;
+                timesteps[i] = fx;
+            }
+
+            job.scenecut_path = outputpath + PATHSTR("/scenecuts.txt");
+        }
+        else if (inputpath.empty() && !path_is_directory(input0path) && !path_is_directory(input1path) && !path_is_directory(outputpath))
+        {
+            input_files.push_back(input0path);
+            input_files.push_back(input1path);
+            input0_indexes.push_back(0);
+            input1_indexes.push_back(1);
+            output_files.push_back(outputpath);
+            timesteps.push_back(timestep);
+        }
+        else
+        {
+            fprintf(stderr, "input0path, input1path and outputpath must be file at the same time\n");
+            fprintf(stderr, "inputpath and outputpath must be directory at the same time\n");
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+// keep output frames [k * count / n, (k + 1) * count / n) of the full run, with the same names and timesteps
+// source frames outside the segment stay unreferenced and are never decoded
+static void segment_job(Job& job, int k, int n)
+{
+    const int count = (int)job.output_files.size();
+    const int begin = (int)((long long)count * k / n);
+    const int end = (int)((long long)count * (k + 1) / n);
+
+    job.input0_indexes.assign(job.input0_indexes.begin() + begin, job.input0_indexes.begin() + end);
+    job.input1_indexes.assign(job.input1_indexes.begin() + begin, job.input1_indexes.begin() + end);
+    job.output_files.assign(job.output_files.begin() + begin, job.output_files.begin() + end);
+    job.timesteps.assign(job.timesteps.begin() + begin, job.timesteps.begin() + end);
+
+    // each segment lists its own cuts, named by its first and last output frame counting from 1 like the frames
+    if (!job.scenecut_path.empty())
+    {
+        const path_t stem = job.scenecut_path.substr(0, job.scenecut_path.size() - 4);
+#if _WIN32
+        wchar_t range[64];
+        swprintf(range, 64, L"-%d-%d.txt", begin + 1, end);
+#else
+        char range[64];
+        sprintf(range, "-%d-%d.txt", begin + 1, end);
+#endif
+        job.scenecut_path = stem + range;
+    }
+}
+
+// gpu instances and thread counts shared by every run
+class PipelineParams
+{
+public:
+    std::vector<RIFE*> rife;
+    std::vector<int> gpuid;
+    std::vector<int> jobs_proc;
+    int jobs_load;
+    int jobs_save;
+    int total_jobs_proc;
+    int async_mode;
+    bool rife_v4;
+    int verbose;
+    int queue_count;
+    size_t queue_mem;
+    std::vector<int> tilesize;
+    float scenecut_threshold;
+    float dedup_threshold;
+};
+
+static void run_job(const PipelineParams& pp, const Job& job, JobEvents* events)
+{
+    const std::vector<path_t>& input_files = job.input_files;
+    const std::vector<int>& input0_indexes = job.input0_indexes;
+    const std::vector<int>& input1_indexes = job.input1_indexes;
+    const std::vector<path_t>& output_files = job.output_files;
+    const std::vector<float>& timesteps = job.timesteps;
+
+    const std::vector<RIFE*>& rife = pp.rife;
+    const std::vector<int>& gpuid = pp.gpuid;
+    const std::vector<int>& jobs_proc = pp.jobs_proc;
+    const int use_gpu_count = (int)rife.size();
+    const int jobs_load = pp.jobs_load;
+    const int jobs_save = pp.jobs_save;
+    const int total_jobs_proc = pp.total_jobs_proc;
+    const int async_mode = pp.async_mode;
+    const bool rife_v4 = pp.rife_v4;
+    const int verbose = pp.verbose;
+
+    // contextnet features cached by the previous job belong to different frames under the same ids
+    for (int i=0; i<use_gpu_count; i++)
+    {
+        rife[i]->clear_context_features();
+    }
+
+    // group consecutive output frames sharing the same source pair into one task
+    std::vector<int> pair_offsets;
+    for (int i=0; i<(int)output_files.size(); i++)
+    {
+        if (i == 0 || input0_indexes[i] != input0_indexes[i - 1] || input1_indexes[i] != input1_indexes[i - 1])
+            pair_offsets.push_back(i);
+    }
+    pair_offsets.push_back((int)output_files.size());
+
+    // count how many tasks reference each source frame
+    // retimed pairs are only known while loading, load_retime counts them as it goes
+    {
+        std::vector<int> usecounts(input_files.size(), 0);
+        for (int i=0; i+1<(int)pair_offsets.size() && !job.retime; i++)
+        {
+            usecounts[input0_indexes[pair_offsets[i]]]++;
+            usecounts[input1_indexes[pair_offsets[i]]]++;
+        }
+
+        framewindow.init(input_files, usecounts);
+    }
+
+    toproc.set_limits(pp.queue_count, pp.queue_mem);
+    tosave.set_limits(pp.queue_count, pp.queue_mem);
+
+    // stream output is written in task order
+    // keep every proc and save thread busy while the oldest task is still pending
+    const int reorder_window = std::max(8, (total_jobs_proc + jobs_save) * 2);
+    StreamWriter* writer = job.stream ? new StreamWriter(job.stream, reorder_window) : 0;
+
+    // load image
+    LoadThreadParams ltp;
+    ltp.jobs_load = jobs_load;
+    ltp.input_files = input_files;
+    ltp.input0_indexes = input0_indexes;
+    ltp.input1_indexes = input1_indexes;
+    ltp.output_files = output_files;
+    ltp.timesteps = timesteps;
+    ltp.pair_offsets = pair_offsets;
+    ltp.stream = job.stream;
+    ltp.reorder = writer;
+    ltp.dedup_threshold = pp.dedup_threshold;
+    ltp.benchmark = job.benchmark;
+    ltp.retime = job.retime;
+    ltp.verbose = verbose;
+    ltp.scenecut = pp.scenecut_threshold > 0.f ? new SceneCutDetector(pp.scenecut_threshold) : 0;
+
+    if (ltp.scenecut && job.manifest && !job.scenecut_path.empty() && ltp.scenecut->append_to(job.scenecut_path) != 0)
+    {
+#if _WIN32
+        fwprintf(stderr, L"open scene cuts %ls failed\n", job.scenecut_path.c_str());
+#else
+        fprintf(stderr, "open scene cuts %s failed\n", job.scenecut_path.c_str());
+#endif
+    }
+
+    ncnn::Thread load_thread(job.benchmark ? load_benchmark : job.stream ? load_stream : job.retime ? load_retime : load, (void*)&ltp);
+
+    GpuScheduler scheduler(gpuid, jobs_proc, pp.tilesize);
+
+    // async upload, one thread per gpu feeding its proc threads
+    // keep one more slot than proc threads so the next pair is always uploaded
+    std::vector<UploadSlots> upload_slots(use_gpu_count);
+    std::vector<TaskQueue> touploaded(use_gpu_count);
+    std::vector<UploadThreadParams> utp(use_gpu_count);
+    std::vector<ncnn::Thread*> upload_threads;
+    for (int i=0; i<use_gpu_count; i++)
+    {
+        if (async_mode && gpuid[i] != -1)
+        {
+            upload_slots[i].init(ncnn::get_gpu_device(gpuid[i]), jobs_proc[i] + 1);
+
+            utp[i].rife = rife[i];
+            utp[i].scheduler = &scheduler;
+            utp[i].device = i;
+            utp[i].slots = &upload_slots[i];
+            utp[i].touploaded = &touploaded[i];
+            utp[i].jobs_proc = jobs_proc[i];
+
+            upload_threads.push_back(new ncnn::Thread(upload, (void*)&utp[i]));
+        }
+    }
+
+    // rife proc
+    std::vector<ProcThreadParams> ptp(use_gpu_count);
+    for (int i=0; i<use_gpu_count; i++)
+    {
+        const bool async_gpu = async_mode && gpuid[i] != -1;
+
+        ptp[i].rife = rife[i];
+        ptp[i].rife_v4 = rife_v4;
+        ptp[i].scheduler = &scheduler;
+        ptp[i].device = i;
+        ptp[i].gpuid = gpuid[i];
+        ptp[i].benchmark = job.benchmark;
+        ptp[i].queue = async_gpu ? &touploaded[i] : 0;
+        ptp[i].slots = async_gpu ? &upload_slots[i] : 0;
+    }
+
+    std::vector<ncnn::Thread*> proc_threads(total_jobs_proc);
+    {
+        int total_jobs_proc_id = 0;
+        for (int i=0; i<use_gpu_count; i++)
+        {
+            if (gpuid[i] == -1)
+            {
+                proc_threads[total_jobs_proc_id++] = new ncnn::Thread(proc, (void*)&ptp[i]);
+            }
+            else
+            {
+                for (int j=0; j<jobs_proc[i]; j++)
+                {
+                    proc_threads[total_jobs_proc_id++] = new ncnn::Thread(proc, (void*)&ptp[i]);
+                }
+            }
+        }
+    }
+
+    // save image
+    SaveThreadParams stp;
+    stp.verbose = verbose;
+    stp.events = events;
+    stp.writer = writer;
+    stp.manifest = job.manifest;
+    stp.golden = job.golden;
+    stp.discard = job.benchmark != 0;
+
+    std::vector<ncnn::Thread*> save_threads(jobs_save);
+    for (int i=0; i<jobs_save; i++)
+    {
+        save_threads[i] = new ncnn::Thread(save, (void*)&stp);
+    }
+
+    // end
+    load_thread.join();
+
+    if (ltp.scenecut)
+    {
+        // a resumed run only sees the pairs still missing, the cuts of earlier runs stay in the list
+        if (!job.scenecut_path.empty() && ltp.scenecut->save(job.scenecut_path, job.manifest != 0) != 0)
+        {
+#if _WIN32
+            fwprintf(stderr, L"write scene cuts %ls failed\n", job.scenecut_path.c_str());
+#else
+            fprintf(stderr, "write scene cuts %s failed\n", job.scenecut_path.c_str());
+#endif
+        }
+
+        if (verbose)
+        {
+            fprintf(stderr, "%d scene cuts\n", ltp.scenecut->count());
+        }
+
+        delete ltp.scenecut;
+    }
+
+    // the scheduler ends every upload and proc thread after it
+    {
+        Task end;
+        end.id = -233;
+        toproc.put(end);
+    }
+
+    for (int i=0; i<(int)upload_threads.size(); i++)
+    {
+        upload_threads[i]->join();
+        delete upload_threads[i];
+    }
+
+    for (int i=0; i<total_jobs_proc; i++)
+    {
+        proc_threads[i]->join();
+        delete proc_threads[i];
+    }
+
+    for (int i=0; i<jobs_save; i++)
+    {
+        Task end;
+        end.id = -233;
+        tosave.put(end);
+    }
+
+    for (int i=0; i<jobs_save; i++)
+    {
+        save_threads[i]->join();
+        delete save_threads[i];
+    }
+
+    delete writer;
+}
+
+#if _WIN32
+static int serve(const PipelineParams& /*pp*/, const path_t& /*listenpath*/, const path_t& /*pattern_format*/)
+{
+    fprintf(stderr, "serve mode is not supported on windows\n");
+    return -1;
+}
+#else // _WIN32
+// one client of the job server, closed after its input ends and its last job is done
+class Connection
+{
+public:
+    int fd;
+    int pending;
+    ncnn::Mutex lock;
+    ncnn::ConditionVariable condition;
+
+    void send_line(const std::string& line)
+    {
+        std::string data = line + "\n";
+
+        lock.lock();
+
+        size_t offset = 0;
+        while (offset < data.size())
+        {
+            ssize_t n = write(fd, data.data() + offset, data.size() - offset);
+            if (n <= 0)
+                break;
+            offset += n;
+        }
+
+        lock.unlock();
+    }
+};
+
+class ConnectionEvents : public JobEvents
+{
+public:
+    Connection* conn;
+    std::string id;
+    int frames;
+    ncnn::Mutex lock;
+
+    virtual void frame(const path_t& outpath, int ret)
+    {
+        if (ret == 0)
+        {
+            lock.lock();
+            frames++;
+            lock.unlock();
+        }
+
+        conn->send_line("{\"id\":" + json_quote(id) + ",\"event\":\"frame\",\"output\":" + json_quote(outpath) + ",\"status\":\"" + (ret == 0 ? "ok" : "failed") + "\"}");
+    }
+};
+
+class JobRequest
+{
+public:
+    Connection* conn;
+    std::string id;
+    Job job;
+};
+
+class JobRequestQueue
+{
+public:
+    void put(const JobRequest& v)
+    {
+        lock.lock();
+        requests.push(v);
+        lock.unlock();
+
+        condition.signal();
+    }
+
+    void get(JobRequest& v)
+    {
+        lock.lock();
+
+        while (requests.size() == 0)
+        {
+            condition.wait(lock);
+        }
+
+        v = requests.front();
+        requests.pop();
+
+        lock.unlock();
+    }
+
+private:
+    ncnn::Mutex lock;
+    ncnn::ConditionVariable condition;
+    std::queue<JobRequest> requests;
+};
+
+class ServeParams
+{
+public:
+    int listenfd;
+    bool rife_v4;
+    path_t pattern_format;
+    JobRequestQueue* queue;
+};
+
+class ReaderParams
+{
+public:
+    const ServeParams* sp;
+    Connection* conn;
+};
+
+// turn each json line of one client into a queued job
+static void* serve_reader(void* args)
+{
+    ReaderParams* rp = (ReaderParams*)args;
+    const ServeParams* sp = rp->sp;
+    Connection* conn = rp->conn;
+    delete rp;
+
+    std::string buffer;
+    char data[4096];
+    for (;;)
+    {
+        ssize_t n = read(conn->fd, data, sizeof(data));
+        if (n <= 0)
+            break;
+
+        buffer.append(data, n);
+
+        size_t eol;
+        while ((eol = buffer.find('\n')) != std::string::npos)
+        {
+            std::string line = buffer.substr(0, eol);
+            buffer.erase(0, eol + 1);
+
+            if (line.find_first_not_of(" \t\r") == std::string::npos)
+                continue;
+
+            std::map<std::string, std::string> members;
+            if (parse_json_object(line, members) != 0)
+            {
+                conn->send_line("{\"event\":\"error\",\"message\":\"malformed json\"}");
+                continue;
+            }
+
+            JobRequest r;
+            r.conn = conn;
+            r.id = members["id"];
+
+            const int numframe = members.count("num_frame") ? atoi(members["num_frame"].c_str()) : 0;
+            const float timestep = members.count("time_step") ? (float)atof(members["time_step"].c_str()) : 0.5f;
+            const path_t pattern_format = members.count("pattern_format") ? members["pattern_format"] : sp->pattern_format;
+
+            if (((members["input0"].empty() || members["input1"].empty()) && members["input"].empty()) || members["output"].empty()
+                || collect_job(members["input0"], members["input1"], members["input"], members["output"], numframe, timestep, pattern_format, sp->rife_v4, r.job) != 0)
+            {
+                conn->send_line("{\"id\":" + json_quote(r.id) + ",\"event\":\"error\",\"message\":\"invalid job\"}");
+                continue;
+            }
+
+            conn->lock.lock();
+            conn->pending++;
+            conn->lock.unlock();
+
+            conn->send_line("{\"id\":" + json_quote(r.id) + ",\"event\":\"queued\",\"frames\":" + std::to_string(r.job.output_files.size()) + "}");
+
+            sp->queue->put(r);
+        }
+    }
+
+    // the runner still writes to this connection until its jobs are done
+    conn->lock.lock();
+    while (conn->pending > 0)
+    {
+        conn->condition.wait(conn->lock);
+    }
+    conn->lock.unlock();
+
+    close(conn->fd);
+    delete conn;
+
+    return 0;
+}
+
+static void* serve_accept(void* args)
+{
+    const ServeParams* sp = (const ServeParams*)args;
+
+    for (;;)
+    {
+        int fd = accept(sp->listenfd, NULL, NULL);
+        if (fd < 0)
+        {
+            if (errno == EINTR)
+                continue;
+
+            fprintf(stderr, "accept failed %d\n", errno);
+            break;
+        }
+
+        Connection* conn = new Connection;
+        conn->fd = fd;
+        conn->pending = 0;
+
+        ReaderParams* rp = new ReaderParams;
+        rp->sp = sp;
+        rp->conn = conn;
+
+        pthread_t t;
+        if (pthread_create(&t, NULL, serve_reader, rp) != 0)
+        {
+            close(fd);
+            delete conn;
+            delete rp;
+            continue;
+        }
+        pthread_detach(t);
+    }
+
+    return 0;
+}
+
+// accept jobs as newline-delimited json on a unix socket and run them one after another on the loaded models
+static int serve(const PipelineParams& pp, const path_t& listenpath, const path_t& pattern_format)
+{
+    const std::string prefix = "unix:";
+    if (listenpath.compare(0, prefix.size(), prefix) != 0)
+    {
+        fprintf(stderr, "invalid listen address %s, must be unix:/path/to.sock\n", listenpath.c_str());
+        return -1;
+    }
+
+    const std::string sockpath = listenpath.substr(prefix.size());
+
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (sockpath.empty() || sockpath.size() >= sizeof(addr.sun_path))
+    {
+        fprintf(stderr, "invalid socket path %s\n", sockpath.c_str());
+        return -1;
+    }
+    strcpy(addr.sun_path, sockpath.c_str());
+
+    int listenfd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (listenfd < 0)
+    {
+        fprintf(stderr, "socket failed %d\n", errno);
+        return -1;
+    }
+
+    // a stale socket file from an earlier run would make bind fail
+    unlink(sockpath.c_str());
+
+    if (bind(listenfd, (struct sockaddr*)&addr, sizeof(addr)) != 0 || listen(listenfd, 16) != 0)
+    {
+        fprintf(stderr, "listen on %s failed %d\n", sockpath.c_str(), errno);
+        close(listenfd);
+        return -1;
+    }
+
+    // clients may hang up before their events are written
+    signal(SIGPIPE, SIG_IGN);
+
+    fprintf(stderr, "listening on %s\n", sockpath.c_str());
+
+    JobRequestQueue queue;
+
+    ServeParams sp;
+    sp.listenfd = listenfd;
+    sp.rife_v4 = pp.rife_v4;
+    sp.pattern_format = pattern_format;
+    sp.queue = &queue;
+
+    ncnn::Thread accept_thread(serve_accept, (void*)&sp);
+
+    for (;;)
+    {
+        JobRequest r;
+        queue.get(r);
+
+        ConnectionEvents events;
+        events.conn = r.conn;
+        events.id = r.id;
+        events.frames = 0;
+
+        run_job(pp, r.job, &events);
+
+        const int total = (int)r.job.output_files.size();
+        r.conn->send_line("{\"id\":" + json_quote(r.id) + ",\"event\":\"done\",\"frames\":" + std::to_string(events.frames) + ",\"failed\":" + std::to_string(total - events.frames) + "}");
+
+        r.conn->lock.lock();
+        r.conn->pending--;
+        r.conn->lock.unlock();
+
+        r.conn->condition.signal();
+    }
+
+    return 0;
+}
+#endif // _WIN32
+
+
+// leading members of the json report of a -b or -G run, the model and options it ran with
+static void print_run_config(FILE* fp, const path_t& model, int tta_mode, int tta_temporal_mode, int uhd_mode, int async_mode, const std::vector<int>& gpuid, int jobs_load, const std::vector<int>& jobs_proc, int jobs_save)
+{
+    path_t model_name = model.substr(model.find_last_of(PATHSTR("/\\")) + 1);
 #if _WIN32
-                fwprintf(stderr, L"%ls %ls %f -> %ls done\n", v.in0path.c_str(), v.in1path.c_str(), v.timestep, v.outpath.c_str());
+    fwprintf(fp, L"{\"model\":\"%ls\",", model_name.c_str());
 #else
-                fprintf(stderr, "%s %s %f -> %s done\n", v.in0path.c_str(), v.in1path.c_str(), v.timestep, v.outpath.c_str());
+    fprintf(fp, "{\"model\":\"%s\",", model_name.c_str());
 #endif
-            }
-        }
+    fprintf(fp, "\"tta\":%d,\"tta_temporal\":%d,\"uhd\":%d,\"async\":%d,\"gpu\":[", tta_mode, tta_temporal_mode, uhd_mode, async_mode);
+    for (size_t i=0; i<gpuid.size(); i++)
+    {
+        fprintf(fp, i == 0 ? "%d" : ",%d", gpuid[i]);
     }
-
-    return 0;
+    fprintf(fp, "],\"jobs\":\"%d:", jobs_load);
+    for (size_t i=0; i<jobs_proc.size(); i++)
+    {
+        fprintf(fp, i == 0 ? "%d" : ",%d", jobs_proc[i]);
+    }
+    fprintf(fp, ":%d\",", jobs_save);
 }
 
-
 #if _WIN32
 int wmain(int argc, wchar_t** argv)
 #else
@@ -451,18 +2799,40 @@ int main(int argc, char** argv)
     path_t model = PATHSTR("rife-v2.3");
     std::vector<int> gpuid;
     int jobs_load = 1;
+    std::vector<int> tilesize;
     std::vector<int> jobs_proc;
     int jobs_save = 2;
     int verbose = 0;
     int tta_mode = 0;
     int tta_temporal_mode = 0;
     int uhd_mode = 0;
+    int async_mode = 0;
+    int tta_jobs = 1;
+    size_t queue_mem = (size_t)2048 * 1024 * 1024;
+    int queue_count = 8;
+    int queue_ret = 0;
+    int segment_index = 0;
+    int segment_count = 1;
+    int resume = 0;
+    float scenecut_threshold = 0.f;
+    float dedup_threshold = 0.f;
+    int retime = 0;
+    path_t cachedir;
+    path_t listenpath;
+    path_t tracepath;
+    int benchmark_w = 0;
+    int benchmark_h = 0;
+    int benchmark_warmup = 4;
+    int benchmark_pairs = 32;
+    path_t goldenpath;
+    float golden_psnr = 40.f;
+    int golden_diff = 16;
     path_t pattern_format = PATHSTR("%08d.png");
 
 #if _WIN32
     setlocale(LC_ALL, "");
     wchar_t opt;
-    while ((opt = getopt(argc, argv, L"0:1:i:o:n:s:m:g:j:f:vxzuh")) != (wchar_t)-1)
+    while ((opt = getopt(argc, argv, L"0:1:i:o:n:s:m:g:t:j:w:q:p:e:d:c:l:k:b:G:T:f:vxzuahry")) != (wchar_t)-1)
     {
         switch (opt)
         {
@@ -490,10 +2860,46 @@ int main(int argc, char** argv)
         case L'g':
             gpuid = parse_optarg_int_array(optarg);
             break;
+        case L't':
+            tilesize = parse_optarg_int_array(optarg);
+            break;
         case L'j':
             swscanf(optarg, L"%d:%*[^:]:%d", &jobs_load, &jobs_save);
             jobs_proc = parse_optarg_int_array(wcschr(optarg, L':') + 1);
             break;
+        case L'w':
+            tta_jobs = _wtoi(optarg);
+            break;
+        case L'q':
+            queue_ret = parse_optarg_queue(optarg, &queue_mem, &queue_count);
+            break;
+        case L'p':
+            swscanf(optarg, L"%d/%d", &segment_index, &segment_count);
+            break;
+        case L'e':
+            scenecut_threshold = _wtof(optarg);
+            break;
+        case L'd':
+            dedup_threshold = _wtof(optarg);
+            break;
+        case L'k':
+            tracepath = optarg;
+            break;
+        case L'G':
+            goldenpath = optarg;
+            break;
+        case L'T':
+            swscanf(optarg, L"%f:%d", &golden_psnr, &golden_diff);
+            break;
+        case L'b':
+            swscanf(optarg, L"%dx%d:%d:%d", &benchmark_w, &benchmark_h, &benchmark_warmup, &benchmark_pairs);
+            break;
+        case L'c':
+            cachedir = optarg;
+            break;
+        case L'l':
+            listenpath = optarg;
+            break;
         case L'f':
             pattern_format = optarg;
             break;
@@ -509,6 +2915,15 @@ int main(int argc, char** argv)
         case L'u':
             uhd_mode = 1;
             break;
+        case L'y':
+            retime = 1;
+            break;
+        case L'r':
+            resume = 1;
+            break;
+        case L'a':
+            async_mode = 1;
+            break;
         case L'h':
         default:
             print_usage();
@@ -517,7 +2932,7 @@ int main(int argc, char** argv)
     }
 #else // _WIN32
     int opt;
-    while ((opt = getopt(argc, argv, "0:1:i:o:n:s:m:g:j:f:vxzuh")) != -1)
+    while ((opt = getopt(argc, argv, "0:1:i:o:n:s:m:g:t:j:w:q:p:e:d:c:l:k:b:G:T:f:vxzuahry")) != -1)
     {
         switch (opt)
         {
@@ -545,10 +2960,46 @@ int main(int argc, char** argv)
         case 'g':
             gpuid = parse_optarg_int_array(optarg);
             break;
+        case 't':
+            tilesize = parse_optarg_int_array(optarg);
+            break;
         case 'j':
             sscanf(optarg, "%d:%*[^:]:%d", &jobs_load, &jobs_save);
             jobs_proc = parse_optarg_int_array(strchr(optarg, ':') + 1);
             break;
+        case 'w':
+            tta_jobs = atoi(optarg);
+            break;
+        case 'q':
+            queue_ret = parse_optarg_queue(optarg, &queue_mem, &queue_count);
+            break;
+        case 'p':
+            sscanf(optarg, "%d/%d", &segment_index, &segment_count);
+            break;
+        case 'e':
+            scenecut_threshold = atof(optarg);
+            break;
+        case 'd':
+            dedup_threshold = atof(optarg);
+            break;
+        case 'k':
+            tracepath = optarg;
+            break;
+        case 'G':
+            goldenpath = optarg;
+            break;
+        case 'T':
+            sscanf(optarg, "%f:%d", &golden_psnr, &golden_diff);
+            break;
+        case 'b':
+            sscanf(optarg, "%dx%d:%d:%d", &benchmark_w, &benchmark_h, &benchmark_warmup, &benchmark_pairs);
+            break;
+        case 'c':
+            cachedir = optarg;
+            break;
+        case 'l':
+            listenpath = optarg;
+            break;
         case 'f':
             pattern_format = optarg;
             break;
@@ -564,6 +3015,15 @@ int main(int argc, char** argv)
         case 'u':
             uhd_mode = 1;
             break;
+        case 'y':
+            retime = 1;
+            break;
+        case 'r':
+            resume = 1;
+            break;
+        case 'a':
+            async_mode = 1;
+            break;
         case 'h':
         default:
             print_usage();
@@ -572,89 +3032,96 @@ int main(int argc, char** argv)
     }
 #endif // _WIN32
 
-    if (((input0path.empty() || input1path.empty()) && inputpath.empty()) || outputpath.empty())
+    if (listenpath.empty() && benchmark_w == 0 && (((input0path.empty() || input1path.empty()) && inputpath.empty()) || outputpath.empty()))
     {
         print_usage();
         return -1;
     }
 
-    if (inputpath.empty() && (timestep <= 0.f || timestep >= 1.f))
+    if (jobs_load < 1 || jobs_save < 1)
     {
-        fprintf(stderr, "invalid timestep argument, must be 0~1\n");
+        fprintf(stderr, "invalid thread count argument\n");
         return -1;
     }
 
-    if (!inputpath.empty() && numframe < 0)
+    if (tta_jobs < 1 || tta_jobs > 8)
     {
-        fprintf(stderr, "invalid numframe argument, must not be negative\n");
+        fprintf(stderr, "invalid tta-jobs argument, must be 1~8\n");
         return -1;
     }
 
-    if (jobs_load < 1 || jobs_save < 1)
+    if (queue_ret != 0 || queue_count < 1)
     {
-        fprintf(stderr, "invalid thread count argument\n");
+        fprintf(stderr, "invalid queue argument\n");
         return -1;
     }
 
-    if (jobs_proc.size() != (gpuid.empty() ? 1 : gpuid.size()) && !jobs_proc.empty())
+    if (benchmark_w < 0 || benchmark_h < 0 || (benchmark_w > 0 && benchmark_h == 0) || benchmark_warmup < 0 || benchmark_pairs < 1)
     {
-        fprintf(stderr, "invalid jobs_proc thread count argument\n");
+        fprintf(stderr, "invalid benchmark argument, must be WxH or WxH:warmup:pairs\n");
         return -1;
     }
 
-    for (int i=0; i<(int)jobs_proc.size(); i++)
+    if (benchmark_w > 0 && !listenpath.empty())
     {
-        if (jobs_proc[i] < 1)
-        {
-            fprintf(stderr, "invalid jobs_proc thread count argument\n");
-            return -1;
-        }
+        fprintf(stderr, "benchmark and listen can not be used together\n");
+        return -1;
     }
 
-    path_t pattern = get_file_name_without_extension(pattern_format);
-    path_t format = get_file_extension(pattern_format);
+    if (golden_psnr < 0.f || golden_diff < 0 || golden_diff > 255)
+    {
+        fprintf(stderr, "invalid golden tolerance argument, must be min-psnr or min-psnr:max-diff\n");
+        return -1;
+    }
 
-    if (format.empty())
+    if (segment_count < 1 || segment_index < 0 || segment_index >= segment_count)
     {
-        pattern = PATHSTR("%08d");
-        format = pattern_format;
+        fprintf(stderr, "invalid segment argument, must be k/N with 0 <= k < N\n");
+        return -1;
     }
 
-    if (pattern.empty())
+    if (scenecut_threshold < 0.f || scenecut_threshold > 1.f)
     {
-        pattern = PATHSTR("%08d");
+        fprintf(stderr, "invalid scene cut threshold argument, must be 0~1\n");
+        return -1;
     }
 
-    if (!path_is_directory(outputpath))
+    if (dedup_threshold < 0.f || dedup_threshold > 1.f)
     {
-        // guess format from outputpath no matter what format argument specified
-        path_t ext = get_file_extension(outputpath);
+        fprintf(stderr, "invalid duplicate threshold argument, must be 0~1\n");
+        return -1;
+    }
 
-        if (ext == PATHSTR("png") || ext == PATHSTR("PNG"))
-        {
-            format = PATHSTR("png");
-        }
-        else if (ext == PATHSTR("webp") || ext == PATHSTR("WEBP"))
-        {
-            format = PATHSTR("webp");
-        }
-        else if (ext == PATHSTR("jpg") || ext == PATHSTR("JPG") || ext == PATHSTR("jpeg") || ext == PATHSTR("JPEG"))
-        {
-            format = PATHSTR("jpg");
-        }
-        else
+    if (tilesize.size() != (gpuid.empty() ? 1 : gpuid.size()) && !tilesize.empty())
+    {
+        fprintf(stderr, "invalid tilesize argument\n");
+        return -1;
+    }
+
+    for (int i=0; i<(int)tilesize.size(); i++)
+    {
+        if (tilesize[i] != 0 && tilesize[i] < 512)
         {
-            fprintf(stderr, "invalid outputpath extension type\n");
+            fprintf(stderr, "invalid tilesize argument, must be 0 or >= 512\n");
             return -1;
         }
     }
 
-    if (format != PATHSTR("png") && format != PATHSTR("webp") && format != PATHSTR("jpg"))
+    if (jobs_proc.size() != (gpuid.empty() ? 1 : gpuid.size()) && !jobs_proc.empty())
     {
-        fprintf(stderr, "invalid format argument\n");
+        fprintf(stderr, "invalid jobs_proc thread count argument\n");
         return -1;
     }
 
+    for (int i=0; i<(int)jobs_proc.size(); i++)
+    {
+        if (jobs_proc[i] < 1)
+        {
+            fprintf(stderr, "invalid jobs_proc thread count argument\n");
+            return -1;
+        }
+    }
+
     bool rife_v2 = false;
     bool rife_v4 = false;
     if (model.find(PATHSTR("rife-v2")) != path_t::npos)
@@ -682,89 +3149,117 @@ int main(int argc, char** argv)
         return -1;
     }
 
-    if (!rife_v4 && (numframe != 0 || timestep != 0.5))
+    StreamParams stream;
+    const bool stream_mode = listenpath.empty() && benchmark_w == 0 && parse_stream_path(inputpath, stream.format);
+    if (stream_mode)
     {
-        fprintf(stderr, "only rife-v4 model support custom numframe and timestep\n");
+        if (outputpath != PATHSTR("-"))
+        {
+            fprintf(stderr, "stream input needs -o -\n");
+            return -1;
+        }
+
+        if (numframe != 0)
+        {
+            fprintf(stderr, "stream mode only doubles the frame rate, num-frame is not supported\n");
+            return -1;
+        }
+
+#if _WIN32
+        _setmode(_fileno(stdin), _O_BINARY);
+        _setmode(_fileno(stdout), _O_BINARY);
+#endif
+
+        stream.in = stdin;
+        stream.out = stdout;
+
+        if (stream_read_header(stream.in, stream.format) != 0)
+        {
+            fprintf(stderr, "invalid input stream\n");
+            return -1;
+        }
+
+        stream_write_header(stream.out, stream.format);
+    }
+
+    if (retime && (stream_mode || !listenpath.empty() || inputpath.empty() || dedup_threshold == 0.f || !rife_v4))
+    {
+        fprintf(stderr, "retime is only supported for directory input with -d and rife-v4 models\n");
         return -1;
     }
 
-    // collect input and output filepath
-    std::vector<path_t> input0_files;
-    std::vector<path_t> input1_files;
-    std::vector<path_t> output_files;
-    std::vector<float> timesteps;
+    if (segment_count > 1 && (stream_mode || !listenpath.empty()))
     {
-        if (!inputpath.empty() && path_is_directory(inputpath) && path_is_directory(outputpath))
-        {
-            std::vector<path_t> filenames;
-            int lr = list_directory(inputpath, filenames);
-            if (lr != 0)
-                return -1;
+        fprintf(stderr, "segment is only supported for directory and file input\n");
+        return -1;
+    }
 
-            const int count = filenames.size();
-            if (numframe == 0)
-                numframe = count * 2;
+    if (resume && (stream_mode || !listenpath.empty() || inputpath.empty()))
+    {
+        fprintf(stderr, "resume is only supported for directory input\n");
+        return -1;
+    }
 
-            input0_files.resize(numframe);
-            input1_files.resize(numframe);
-            output_files.resize(numframe);
-            timesteps.resize(numframe);
+    if (!goldenpath.empty() && (stream_mode || !listenpath.empty() || benchmark_w > 0))
+    {
+        fprintf(stderr, "golden is only supported for directory and file input\n");
+        return -1;
+    }
 
-            double scale = (double)count / numframe;
-            for (int i=0; i<numframe; i++)
-            {
-                // TODO provide option to control timestep interpolate method
-//                 float fx = (float)((i + 0.5) * scale - 0.5);
-                float fx = i * scale;
-                int sx = static_cast<int>(floor(fx));
-                fx -= sx;
+    Job job;
+    if (stream_mode)
+    {
+        job.stream = &stream;
+    }
+    else if (listenpath.empty() && benchmark_w == 0 && collect_job(input0path, input1path, inputpath, outputpath, numframe, timestep, pattern_format, rife_v4, job) != 0)
+        return -1;
 
-                if (sx < 0)
-                {
-                    sx = 0;
-                    fx = 0.f;
-                }
-                if (sx >= count - 1)
-                {
-                    sx = count - 2;
-                    fx = 1.f;
-                }
+    job.retime = retime != 0;
 
-//                 fprintf(stderr, "%d %f %d\n", i, fx, sx);
+    if (segment_count > 1)
+    {
+        segment_job(job, segment_index, segment_count);
 
-                path_t filename0 = filenames[sx];
-                path_t filename1 = filenames[sx + 1];
+        if (verbose)
+        {
+            fprintf(stderr, "segment %d/%d, %d output frames\n", segment_index, segment_count, (int)job.output_files.size());
+        }
+    }
 
-#if _WIN32
-                wchar_t tmp[256];
-                swprintf(tmp, pattern.c_str(), i+1);
-#else
-                char tmp[256];
-                sprintf(tmp, pattern.c_str(), i+1); // ffmpeg start from 1
-#endif
-                path_t output_filename = path_t(tmp) + PATHSTR('.') + format;
+    ResumeManifest manifest(outputpath);
+    if (resume)
+    {
+        const int total = (int)job.output_files.size();
+        manifest.skip_done(job.input0_indexes, job.input1_indexes, job.output_files, job.timesteps);
 
-                input0_files[i] = inputpath + PATHSTR('/') + filename0;
-                input1_files[i] = inputpath + PATHSTR('/') + filename1;
-                output_files[i] = outputpath + PATHSTR('/') + output_filename;
-                timesteps[i] = fx;
-            }
-        }
-        else if (inputpath.empty() && !path_is_directory(input0path) && !path_is_directory(input1path) && !path_is_directory(outputpath))
+        if (manifest.open() != 0)
         {
-            input0_files.push_back(input0path);
-            input1_files.push_back(input1path);
-            output_files.push_back(outputpath);
-            timesteps.push_back(timestep);
+            fprintf(stderr, "open resume manifest failed\n");
+            return -1;
         }
-        else
+
+        job.manifest = &manifest;
+
+        if (verbose)
         {
-            fprintf(stderr, "input0path, input1path and outputpath must be file at the same time\n");
-            fprintf(stderr, "inputpath and outputpath must be directory at the same time\n");
-            return -1;
+            fprintf(stderr, "resume, %d of %d output frames done\n", total - (int)job.output_files.size(), total);
         }
     }
 
+    // frames whose source failed to load never reach compare, so the count is checked as well
+    GoldenCheck golden(goldenpath, golden_psnr, golden_diff, (int)job.output_files.size());
+    if (!goldenpath.empty())
+    {
+        job.golden = &golden;
+    }
+
+    if (!tracepath.empty())
+    {
+        trace_enable();
+    }
+
+    int ret = 0;
+
     path_t modeldir = sanitize_dirpath(model);
 
 #if _WIN32
@@ -773,6 +3268,11 @@ int main(int argc, char** argv)
 
     ncnn::create_gpu_instance();
 
+    if (!cachedir.empty())
+    {
+        set_spirv_cache_dir(cachedir);
+    }
+
     if (gpuid.empty())
     {
         gpuid.push_back(ncnn::get_default_gpu_index());
@@ -785,6 +3285,11 @@ int main(int argc, char** argv)
         jobs_proc.resize(use_gpu_count, 2);
     }
 
+    if (tilesize.empty())
+    {
+        tilesize.resize(use_gpu_count, 0);
+    }
+
     int cpu_count = std::max(1, ncnn::get_cpu_count());
     jobs_load = std::min(jobs_load, cpu_count);
     jobs_save = std::min(jobs_save, cpu_count);
@@ -801,6 +3306,30 @@ int main(int argc, char** argv)
         }
     }
 
+    for (int i=0; i<use_gpu_count; i++)
+    {
+        if (tilesize[i] != 0)
+            continue;
+
+        // cpu interpolates the whole frame
+        if (gpuid[i] == -1)
+            continue;
+
+        uint32_t heap_budget = ncnn::get_gpu_device(gpuid[i])->get_heap_budget();
+
+        // only frames that would not fit the device are tiled
+        if (heap_budget > 15600)
+            tilesize[i] = 8192;
+        else if (heap_budget > 7800)
+            tilesize[i] = 4096;
+        else if (heap_budget > 3900)
+            tilesize[i] = 2560;
+        else if (heap_budget > 1900)
+            tilesize[i] = 1920;
+        else
+            tilesize[i] = 1280;
+    }
+
     int total_jobs_proc = 0;
     for (int i=0; i<use_gpu_count; i++)
     {
@@ -822,88 +3351,96 @@ int main(int argc, char** argv)
         {
             int num_threads = gpuid[i] == -1 ? jobs_proc[i] : 1;
 
-            rife[i] = new RIFE(gpuid[i], tta_mode, tta_temporal_mode, uhd_mode, num_threads, rife_v2, rife_v4);
+            rife[i] = new RIFE(gpuid[i], tta_mode, tta_temporal_mode, uhd_mode, num_threads, rife_v2, rife_v4, tta_jobs, tilesize[i]);
 
             rife[i]->load(modeldir);
         }
 
-        // main routine
+        // decode and encode in mapped memory of the first gpu, frames there skip the staging copy
+        // only that gpu, a frame is decoded before the scheduler picks the gpu of its pairs,
+        // so the other gpus still take frames through their own staging buffers at one memcpy each
+        for (int i=0; i<use_gpu_count; i++)
         {
-            // load image
-            LoadThreadParams ltp;
-            ltp.jobs_load = jobs_load;
-            ltp.input0_files = input0_files;
-            ltp.input1_files = input1_files;
-            ltp.output_files = output_files;
-            ltp.timesteps = timesteps;
-
-            ncnn::Thread load_thread(load, (void*)&ltp);
-
-            // rife proc
-            std::vector<ProcThreadParams> ptp(use_gpu_count);
-            for (int i=0; i<use_gpu_count; i++)
-            {
-                ptp[i].rife = rife[i];
-            }
-
-            std::vector<ncnn::Thread*> proc_threads(total_jobs_proc);
+            if (rife[i]->frame_allocator())
             {
-                int total_jobs_proc_id = 0;
-                for (int i=0; i<use_gpu_count; i++)
-                {
-                    if (gpuid[i] == -1)
-                    {
-                        proc_threads[total_jobs_proc_id++] = new ncnn::Thread(proc, (void*)&ptp[i]);
-                    }
-                    else
-                    {
-                        for (int j=0; j<jobs_proc[i]; j++)
-                        {
-                            proc_threads[total_jobs_proc_id++] = new ncnn::Thread(proc, (void*)&ptp[i]);
-                        }
-                    }
-                }
+                frame_pool()->set_backing(rife[i]->frame_allocator());
+                break;
             }
+        }
 
-            // save image
-            SaveThreadParams stp;
-            stp.verbose = verbose;
+        PipelineParams pp;
+        pp.rife = rife;
+        pp.gpuid = gpuid;
+        pp.jobs_proc = jobs_proc;
+        pp.jobs_load = jobs_load;
+        pp.jobs_save = jobs_save;
+        pp.total_jobs_proc = total_jobs_proc;
+        pp.async_mode = async_mode;
+        pp.rife_v4 = rife_v4;
+        pp.verbose = verbose;
+        pp.queue_count = queue_count;
+        pp.queue_mem = queue_mem;
+        pp.tilesize = tilesize;
+        pp.scenecut_threshold = scenecut_threshold;
+        pp.dedup_threshold = dedup_threshold;
+
+        if (!listenpath.empty())
+        {
+            serve(pp, listenpath, pattern_format);
+        }
+        else if (benchmark_w > 0)
+        {
+            BenchmarkRun bench(benchmark_w, benchmark_h, benchmark_warmup, benchmark_pairs, gpuid);
 
-            std::vector<ncnn::Thread*> save_threads(jobs_save);
-            for (int i=0; i<jobs_save; i++)
-            {
-                save_threads[i] = new ncnn::Thread(save, (void*)&stp);
-            }
+            Job benchmark_job;
+            benchmark_job.benchmark = &bench;
+            run_job(pp, benchmark_job, 0);
 
-            // end
-            load_thread.join();
+            // one json object per run, the configuration first
+            print_run_config(stdout, model, tta_mode, tta_temporal_mode, uhd_mode, async_mode, gpuid, jobs_load, jobs_proc, jobs_save);
+            bench.report(stdout);
+        }
+        else
+        {
+            double start = ncnn::get_current_time();
 
-            Task end;
-            end.id = -233;
+            run_job(pp, job, 0);
 
-            for (int i=0; i<total_jobs_proc; i++)
+            if (job.golden)
             {
-                toproc.put(end);
-            }
+                print_run_config(stdout, model, tta_mode, tta_temporal_mode, uhd_mode, async_mode, gpuid, jobs_load, jobs_proc, jobs_save);
+                golden.report(stdout, (ncnn::get_current_time() - start) / 1000);
 
-            for (int i=0; i<total_jobs_proc; i++)
-            {
-                proc_threads[i]->join();
-                delete proc_threads[i];
+                if (!golden.passed())
+                    ret = -1;
             }
+        }
 
-            for (int i=0; i<jobs_save; i++)
+        if (!tracepath.empty())
+        {
+#if _WIN32
+            FILE* fp = _wfopen(tracepath.c_str(), L"wb");
+#else
+            FILE* fp = fopen(tracepath.c_str(), "wb");
+#endif
+            if (!fp || trace_write(fp) != 0)
             {
-                tosave.put(end);
+#if _WIN32
+                fwprintf(stderr, L"write trace %ls failed\n", tracepath.c_str());
+#else
+                fprintf(stderr, "write trace %s failed\n", tracepath.c_str());
+#endif
             }
 
-            for (int i=0; i<jobs_save; i++)
-            {
-                save_threads[i]->join();
-                delete save_threads[i];
-            }
+            if (fp)
+                fclose(fp);
+
+            trace_summary(stderr);
         }
 
+        // every frame is back in the pool once the run is over
+        frame_pool()->set_backing(0);
+
         for (int i=0; i<use_gpu_count; i++)
         {
             delete rife[i];
@@ -913,5 +3450,5 @@ int main(int argc, char** argv)
 
     ncnn::destroy_gpu_instance();
 
-    return 0;
+    return ret;
 }
@@ -0,0 +1,175 @@
+#ifndef NDJSON_H
+#define NDJSON_H
+
+#include <stdio.h>
+#include <map>
+#include <string>
+
+// minimal reader and writer for the newline-delimited json of the job server
+// only flat objects are understood, every member value is kept as its text
+
+static void json_skip_space(const std::string& s, size_t& i)
+{
+    while (i < s.size() && (s[i] == ' ' || s[i] == '\t' || s[i] == '\r' || s[i] == '\n'))
+        i++;
+}
+
+static void json_append_utf8(std::string& out, unsigned int cp)
+{
+    if (cp < 0x80)
+    {
+        out += (char)cp;
+    }
+    else if (cp < 0x800)
+    {
+        out += (char)(0xc0 | (cp >> 6));
+        out += (char)(0x80 | (cp & 0x3f));
+    }
+    else
+    {
+        out += (char)(0xe0 | (cp >> 12));
+        out += (char)(0x80 | ((cp >> 6) & 0x3f));
+        out += (char)(0x80 | (cp & 0x3f));
+    }
+}
+
+static int json_parse_string(const std::string& s, size_t& i, std::string& out)
+{
+    if (i >= s.size() || s[i] != '"')
+        return -1;
+
+    i++;
+    out.clear();
+
+    while (i < s.size() && s[i] != '"')
+    {
+        char c = s[i++];
+        if (c != '\\')
+        {
+            out += c;
+            continue;
+        }
+
+        if (i >= s.size())
+            return -1;
+
+        c = s[i++];
+        switch (c)
+        {
+        case '"': out += '"'; break;
+        case '\\': out += '\\'; break;
+        case '/': out += '/'; break;
+        case 'b': out += '\b'; break;
+        case 'f': out += '\f'; break;
+        case 'n': out += '\n'; break;
+        case 'r': out += '\r'; break;
+        case 't': out += '\t'; break;
+        case 'u':
+        {
+            if (i + 4 > s.size())
+                return -1;
+
+            unsigned int cp = 0;
+            if (sscanf(s.substr(i, 4).c_str(), "%4x", &cp) != 1)
+                return -1;
+            i += 4;
+
+            json_append_utf8(out, cp);
+            break;
+        }
+        default:
+            return -1;
+        }
+    }
+
+    if (i >= s.size())
+        return -1;
+
+    i++;
+    return 0;
+}
+
+static int parse_json_object(const std::string& s, std::map<std::string, std::string>& members)
+{
+    members.clear();
+
+    size_t i = 0;
+    json_skip_space(s, i);
+    if (i >= s.size() || s[i] != '{')
+        return -1;
+    i++;
+
+    json_skip_space(s, i);
+    if (i < s.size() && s[i] == '}')
+        return 0;
+
+    for (;;)
+    {
+        std::string key;
+        json_skip_space(s, i);
+        if (json_parse_string(s, i, key) != 0)
+            return -1;
+
+        json_skip_space(s, i);
+        if (i >= s.size() || s[i] != ':')
+            return -1;
+        i++;
+
+        json_skip_space(s, i);
+        std::string value;
+        if (i < s.size() && s[i] == '"')
+        {
+            if (json_parse_string(s, i, value) != 0)
+                return -1;
+        }
+        else
+        {
+            // number, true, false or null
+            size_t begin = i;
+            while (i < s.size() && s[i] != ',' && s[i] != '}' && s[i] != ' ' && s[i] != '\t' && s[i] != '\r' && s[i] != '\n')
+                i++;
+            if (i == begin)
+                return -1;
+            value = s.substr(begin, i - begin);
+        }
+
+        members[key] = value;
+
+        json_skip_space(s, i);
+        if (i >= s.size())
+            return -1;
+        if (s[i] == '}')
+            return 0;
+        if (s[i] != ',')
+            return -1;
+        i++;
+    }
+}
+
+static std::string json_quote(const std::string& s)
+{
+    std::string out = "\"";
+    for (size_t i = 0; i < s.size(); i++)
+    {
+        unsigned char c = s[i];
+        if (c == '"' || c == '\\')
+        {
+            out += '\\';
+            out += (char)c;
+        }
+        else if (c < 0x20)
+        {
+            char tmp[8];
+            sprintf(tmp, "\\u%04x", c);
+            out += tmp;
+        }
+        else
+        {
+            out += (char)c;
+        }
+    }
+    out += "\"";
+    return out;
+}
+
+#endif // NDJSON_H
@@ -2,9 +2,13 @@
 
 #include "rife.h"
 
+#include <stdio.h>
+#include <string.h>
 #include <algorithm>
+#include <map>
 #include <vector>
 #include "benchmark.h"
+#include "trace.h"
 
 #include "rife_preproc.comp.hex.h"
 #include "rife_postproc.comp.hex.h"
@@ -20,13 +24,270 @@
 #include "rife_v4_timestep.comp.hex.h"
 #include "rife_v4_timestep_tta.comp.hex.h"
 
+#include "rife_cpu.h"
 #include "rife_ops.h"
+#include "spirv_cache.h"
 
 DEFINE_LAYER_CREATOR(Warp)
 
-RIFE::RIFE(int gpuid, bool _tta_mode, bool _tta_temporal_mode, bool _uhd_mode, int _num_threads, bool _rife_v2, bool _rife_v4)
+// blob allocator shared by all proc threads for the cached contextnet features
+class ContextFeatureVkAllocator : public ncnn::VkBlobAllocator
+{
+public:
+    ContextFeatureVkAllocator(const ncnn::VulkanDevice* _vkdev) : ncnn::VkBlobAllocator(_vkdev)
+    {
+    }
+
+    virtual ncnn::VkBufferMemory* fastMalloc(size_t size)
+    {
+        ncnn::MutexLockGuard guard(lock);
+        return ncnn::VkBlobAllocator::fastMalloc(size);
+    }
+
+    virtual void fastFree(ncnn::VkBufferMemory* ptr)
+    {
+        ncnn::MutexLockGuard guard(lock);
+        ncnn::VkBlobAllocator::fastFree(ptr);
+    }
+
+private:
+    ncnn::Mutex lock;
+};
+
+// host visible staging memory of one gpu handed out as plain host pointers
+// frames decoded into it reach the gpu with a buffer copy instead of a memcpy into staging first,
+// and output frames are downloaded straight into it for the encoder
+class MappedFrameAllocator : public ncnn::Allocator
+{
+public:
+    MappedFrameAllocator(const ncnn::VulkanDevice* _vkdev) : vkallocator(_vkdev)
+    {
+    }
+
+    virtual ~MappedFrameAllocator()
+    {
+        ncnn::MutexLockGuard guard(lock);
+
+        std::map<const unsigned char*, ncnn::VkBufferMemory*>::iterator it = buffers.begin();
+        for (; it != buffers.end(); it++)
+        {
+            vkallocator.fastFree(it->second);
+        }
+        buffers.clear();
+    }
+
+    virtual void* fastMalloc(size_t size)
+    {
+        ncnn::MutexLockGuard guard(lock);
+
+        ncnn::VkBufferMemory* data = vkallocator.fastMalloc(size);
+        if (!data)
+            return 0;
+
+        if (!data->mapped_ptr)
+        {
+            vkallocator.fastFree(data);
+            return 0;
+        }
+
+        buffers[(const unsigned char*)data->mapped_ptr] = data;
+        return data->mapped_ptr;
+    }
+
+    virtual void fastFree(void* ptr)
+    {
+        ncnn::MutexLockGuard guard(lock);
+
+        std::map<const unsigned char*, ncnn::VkBufferMemory*>::iterator it = buffers.find((const unsigned char*)ptr);
+        if (it == buffers.end())
+            return;
+
+        vkallocator.fastFree(it->second);
+        buffers.erase(it);
+    }
+
+    // describe [ptr, ptr + size) as a range of the buffer holding it, false for memory from elsewhere
+    bool view(const void* ptr, size_t size, ncnn::VkBufferMemory* range) const
+    {
+        ncnn::MutexLockGuard guard(lock);
+
+        const unsigned char* p = (const unsigned char*)ptr;
+        std::map<const unsigned char*, ncnn::VkBufferMemory*>::const_iterator it = buffers.upper_bound(p);
+        if (!p || it == buffers.begin())
+            return false;
+
+        it--;
+
+        const ncnn::VkBufferMemory* data = it->second;
+        const size_t offset = p - it->first;
+        if (offset + size > data->capacity)
+            return false;
+
+        *range = *data;
+        range->offset = data->offset + offset;
+        range->capacity = size;
+        range->mapped_ptr = (unsigned char*)data->mapped_ptr + offset;
+        range->access_flags = 0;
+        range->stage_flags = VK_PIPELINE_STAGE_HOST_BIT;
+        range->refcount = 0;
+        return true;
+    }
+
+    int flush(ncnn::VkBufferMemory* range)
+    {
+        return vkallocator.flush(range);
+    }
+
+    int invalidate(ncnn::VkBufferMemory* range)
+    {
+        return vkallocator.invalidate(range);
+    }
+
+private:
+    mutable ncnn::Mutex lock;
+    ncnn::VkStagingAllocator vkallocator;
+    std::map<const unsigned char*, ncnn::VkBufferMemory*> buffers;
+};
+
+// packed uint8 frame to gpu, through a mapped view when the frame lives in allocator memory
+static void record_upload_frame(MappedFrameAllocator* allocator, const unsigned char* pixeldata, int w, int h, int channels, ncnn::VkBufferMemory* view, ncnn::VkMat& in_gpu, ncnn::VkCompute& cmd, const ncnn::Option& opt)
+{
+    if (allocator && allocator->view(pixeldata, (size_t)w * h * channels, view))
+    {
+        allocator->flush(view);
+        cmd.record_clone(ncnn::VkMat(w, h, view, (size_t)channels, 1, opt.staging_vkallocator), in_gpu, opt);
+        return;
+    }
+
+    cmd.record_clone(ncnn::Mat(w, h, (unsigned char*)pixeldata, (size_t)channels, 1), in_gpu, opt);
+}
+
+// whether out_gpu can be downloaded straight into the mapped memory behind pixeldata
+static bool view_download_frame(MappedFrameAllocator* allocator, const ncnn::VkMat& out_gpu, const unsigned char* pixeldata, int channels, ncnn::VkBufferMemory* view)
+{
+    if (!allocator || out_gpu.dims != 2 || out_gpu.elemsize != (size_t)channels || out_gpu.elempack != 1)
+        return false;
+
+    return allocator->view(pixeldata, (size_t)out_gpu.w * out_gpu.h * channels, view);
+}
+
+// record the copy of out_gpu into a view from view_download_frame, out_gpu_mapped must outlive cmd
+// record_clone writes into the view only while create_like keeps it, which needs the same shape and opt.blob_vkallocator
+// otherwise it allocates a buffer of its own and the frame would stay unwritten,
+// so that case is reported and the frame downloaded into out as usual
+static bool record_download_frame(const ncnn::VkMat& out_gpu, ncnn::VkBufferMemory* view, int channels, ncnn::VkMat& out_gpu_mapped, ncnn::Mat& out, ncnn::VkCompute& cmd, const ncnn::Option& opt)
+{
+    out_gpu_mapped = ncnn::VkMat(out_gpu.w, out_gpu.h, view, (size_t)channels, 1, opt.blob_vkallocator);
+    cmd.record_clone(out_gpu, out_gpu_mapped, opt);
+
+    if (out_gpu_mapped.data == view)
+        return true;
+
+    fprintf(stderr, "download missed the mapped frame memory, copying through staging\n");
+    cmd.record_clone(out_gpu, out, opt);
+    return false;
+}
+
+// keep the features of the last two source frames, the next pair usually shares one of them
+static const int context_feature_cache_frames = 2;
+
+// trace names of the rife-v4 flownet stages
+static const char* const v4_flow_stages[4] = {"flownet flow0", "flownet flow1", "flownet flow2", "flownet flow3"};
+
+// overlap around every tile core, wide enough for the flownet receptive field and large motion
+static const int tile_pad = 128;
+
+// half width of the band across each seam where neighbouring tiles are cross-faded
+static const int tile_blend = 32;
+
+// blend weight out of 256 rising across the seam at c
+static int tile_ramp(int x, int c)
+{
+    int v = ((x - (c - tile_blend)) * 2 + 1) * 256 / (4 * tile_blend);
+    return std::max(0, std::min(v, 256));
+}
+
+// blend weight out of 256 at x for the tile with core [c0, c1), weights of all tiles add up to exactly 256
+static int tile_weight(int x, int c0, int c1, int size)
+{
+    int v = 256;
+    if (c0 > 0)
+        v = tile_ramp(x, c0);
+    if (c1 < size)
+        v = std::min(v, 256 - tile_ramp(x, c1));
+    return v;
+}
+
+// temporal tta, average the forward flow with the backward flow
+// the output of timestep 0 or 1 is a copy of that input, into the caller's buffer when it has a matching one
+// so an output never shares pixels with an input frame
+static void copy_input_frame(const ncnn::Mat& inimage, ncnn::Mat& outimage)
+{
+    if (outimage.data && outimage.w == inimage.w && outimage.h == inimage.h && outimage.elemsize == inimage.elemsize)
+    {
+        memcpy(outimage.data, inimage.data, (size_t)inimage.w * inimage.h * inimage.elemsize);
+        return;
+    }
+
+    outimage = inimage.clone();
+}
+
+static void merge_flow_reversed(ncnn::Mat& flow, ncnn::Mat& flow_reversed, bool rife_v2)
+{
+    float* flow_x = flow.channel(0);
+    float* flow_y = flow.channel(1);
+    float* flow_reversed_x = flow_reversed.channel(0);
+    float* flow_reversed_y = flow_reversed.channel(1);
+
+    if (rife_v2)
+    {
+        float* flow_z = flow.channel(2);
+        float* flow_w = flow.channel(3);
+        float* flow_reversed_z = flow_reversed.channel(2);
+        float* flow_reversed_w = flow_reversed.channel(3);
+
+        for (int i = 0; i < flow.h; i++)
+        {
+            for (int j = 0; j < flow.w; j++)
+            {
+                float x = (*flow_x + *flow_reversed_z) * 0.5f;
+                float y = (*flow_y + *flow_reversed_w) * 0.5f;
+                float z = (*flow_z + *flow_reversed_x) * 0.5f;
+                float w = (*flow_w + *flow_reversed_y) * 0.5f;
+
+                *flow_x++ = x;
+                *flow_y++ = y;
+                *flow_z++ = z;
+                *flow_w++ = w;
+                *flow_reversed_x++ = z;
+                *flow_reversed_y++ = w;
+                *flow_reversed_z++ = x;
+                *flow_reversed_w++ = y;
+            }
+        }
+    }
+    else
+    {
+        for (int i = 0; i < flow.h; i++)
+        {
+            for (int j = 0; j < flow.w; j++)
+            {
+                float x = (*flow_x - *flow_reversed_x) * 0.5f;
+                float y = (*flow_y - *flow_reversed_y) * 0.5f;
+
+                *flow_x++ = x;
+                *flow_y++ = y;
+                *flow_reversed_x++ = -x;
+                *flow_reversed_y++ = -y;
+            }
+        }
+    }
+}
+
+RIFE::RIFE(int gpuid, bool _tta_mode, bool _tta_temporal_mode, bool _uhd_mode, int _num_threads, bool _rife_v2, bool _rife_v4, int _tta_jobs, int _tilesize)
 {
     vkdev = gpuid == -1 ? 0 : ncnn::get_gpu_device(gpuid);
+    trace_device = gpuid;
 
     rife_preproc = 0;
     rife_postproc = 0;
@@ -38,12 +299,16 @@ RIFE::RIFE(int gpuid, bool _tta_mode, bool _tta_temporal_mode, bool _uhd_mode, i
     rife_uhd_upscale_flow = 0;
     rife_uhd_double_flow = 0;
     rife_v2_slice_flow = 0;
+    context_feature_vkallocator = 0;
+    frame_vkallocator = vkdev ? new MappedFrameAllocator(vkdev) : 0;
     tta_mode = _tta_mode;
     tta_temporal_mode = _tta_temporal_mode;
     uhd_mode = _uhd_mode;
     num_threads = _num_threads;
     rife_v2 = _rife_v2;
     rife_v4 = _rife_v4;
+    tta_jobs = std::max(1, std::min(_tta_jobs, 8));
+    tilesize = _tilesize;
 }
 
 RIFE::~RIFE()
@@ -75,6 +340,21 @@ RIFE::~RIFE()
         rife_v2_slice_flow->destroy_pipeline(flownet.opt);
         delete rife_v2_slice_flow;
     }
+
+    context_feature_cache.clear();
+    delete context_feature_vkallocator;
+    delete frame_vkallocator;
+}
+
+ncnn::Allocator* RIFE::frame_allocator() const
+{
+    return frame_vkallocator;
+}
+
+void RIFE::clear_context_features() const
+{
+    ncnn::MutexLockGuard guard(context_feature_lock);
+    context_feature_cache.clear();
 }
 
 #if _WIN32
@@ -163,6 +443,30 @@ int RIFE::load(const std::string& modeldir)
     }
 #endif
 
+    if (!rife_v4)
+    {
+        // the image branch of each warp layer only depends on input.1
+        const std::vector<ncnn::Layer*>& layers = contextnet.layers();
+        const std::vector<ncnn::Blob>& blobs = contextnet.blobs();
+        for (size_t i = 0; i < layers.size(); i++)
+        {
+            const ncnn::Layer* layer = layers[i];
+            if (layer->type != "rife.Warp")
+                continue;
+
+            const std::string& top = blobs[layer->tops[0]].name;
+            if (top.size() == 2 && top[0] == 'f' && top[1] >= '1' && top[1] <= '4')
+            {
+                context_feature_blobs[top[1] - '1'] = blobs[layer->bottoms[0]].name;
+            }
+        }
+
+        if (vkdev)
+        {
+            context_feature_vkallocator = new ContextFeatureVkAllocator(vkdev);
+        }
+    }
+
     // initialize preprocess and postprocess pipeline
     if (vkdev)
     {
@@ -181,9 +485,9 @@ int RIFE::load(const std::string& modeldir)
                 if (spirv.empty())
                 {
                     if (tta_mode)
-                        compile_spirv_module(rife_preproc_tta_comp_data, sizeof(rife_preproc_tta_comp_data), opt, spirv);
+                        compile_spirv_module_cached(vkdev, rife_preproc_tta_comp_data, sizeof(rife_preproc_tta_comp_data), opt, spirv);
                     else
-                        compile_spirv_module(rife_preproc_comp_data, sizeof(rife_preproc_comp_data), opt, spirv);
+                        compile_spirv_module_cached(vkdev, rife_preproc_comp_data, sizeof(rife_preproc_comp_data), opt, spirv);
                 }
             }
 
@@ -200,9 +504,9 @@ int RIFE::load(const std::string& modeldir)
                 if (spirv.empty())
                 {
                     if (tta_mode)
-                        compile_spirv_module(rife_postproc_tta_comp_data, sizeof(rife_postproc_tta_comp_data), opt, spirv);
+                        compile_spirv_module_cached(vkdev, rife_postproc_tta_comp_data, sizeof(rife_postproc_tta_comp_data), opt, spirv);
                     else
-                        compile_spirv_module(rife_postproc_comp_data, sizeof(rife_postproc_comp_data), opt, spirv);
+                        compile_spirv_module_cached(vkdev, rife_postproc_comp_data, sizeof(rife_postproc_comp_data), opt, spirv);
                 }
             }
 
@@ -222,15 +526,15 @@ int RIFE::load(const std::string& modeldir)
             {
                 if (rife_v4)
                 {
-                    compile_spirv_module(rife_v4_flow_tta_avg_comp_data, sizeof(rife_v4_flow_tta_avg_comp_data), opt, spirv);
+                    compile_spirv_module_cached(vkdev, rife_v4_flow_tta_avg_comp_data, sizeof(rife_v4_flow_tta_avg_comp_data), opt, spirv);
                 }
                 else if (rife_v2)
                 {
-                    compile_spirv_module(rife_v2_flow_tta_avg_comp_data, sizeof(rife_v2_flow_tta_avg_comp_data), opt, spirv);
+                    compile_spirv_module_cached(vkdev, rife_v2_flow_tta_avg_comp_data, sizeof(rife_v2_flow_tta_avg_comp_data), opt, spirv);
                 }
                 else
                 {
-                    compile_spirv_module(rife_flow_tta_avg_comp_data, sizeof(rife_flow_tta_avg_comp_data), opt, spirv);
+                    compile_spirv_module_cached(vkdev, rife_flow_tta_avg_comp_data, sizeof(rife_flow_tta_avg_comp_data), opt, spirv);
                 }
             }
         }
@@ -252,15 +556,15 @@ int RIFE::load(const std::string& modeldir)
             {
                 if (rife_v4)
                 {
-                    compile_spirv_module(rife_v4_flow_tta_temporal_avg_comp_data, sizeof(rife_v4_flow_tta_temporal_avg_comp_data), opt, spirv);
+                    compile_spirv_module_cached(vkdev, rife_v4_flow_tta_temporal_avg_comp_data, sizeof(rife_v4_flow_tta_temporal_avg_comp_data), opt, spirv);
                 }
                 else if (rife_v2)
                 {
-                    compile_spirv_module(rife_v2_flow_tta_temporal_avg_comp_data, sizeof(rife_v2_flow_tta_temporal_avg_comp_data), opt, spirv);
+                    compile_spirv_module_cached(vkdev, rife_v2_flow_tta_temporal_avg_comp_data, sizeof(rife_v2_flow_tta_temporal_avg_comp_data), opt, spirv);
                 }
                 else
                 {
-                    compile_spirv_module(rife_flow_tta_temporal_avg_comp_data, sizeof(rife_flow_tta_temporal_avg_comp_data), opt, spirv);
+                    compile_spirv_module_cached(vkdev, rife_flow_tta_temporal_avg_comp_data, sizeof(rife_flow_tta_temporal_avg_comp_data), opt, spirv);
                 }
             }
         }
@@ -280,7 +584,7 @@ int RIFE::load(const std::string& modeldir)
             ncnn::MutexLockGuard guard(lock);
             if (spirv.empty())
             {
-                compile_spirv_module(rife_out_tta_temporal_avg_comp_data, sizeof(rife_out_tta_temporal_avg_comp_data), opt, spirv);
+                compile_spirv_module_cached(vkdev, rife_out_tta_temporal_avg_comp_data, sizeof(rife_out_tta_temporal_avg_comp_data), opt, spirv);
             }
         }
 
@@ -361,9 +665,9 @@ int RIFE::load(const std::string& modeldir)
                 if (spirv.empty())
                 {
                     if (tta_mode)
-                        compile_spirv_module(rife_v4_timestep_tta_comp_data, sizeof(rife_v4_timestep_tta_comp_data), opt, spirv);
+                        compile_spirv_module_cached(vkdev, rife_v4_timestep_tta_comp_data, sizeof(rife_v4_timestep_tta_comp_data), opt, spirv);
                     else
-                        compile_spirv_module(rife_v4_timestep_comp_data, sizeof(rife_v4_timestep_comp_data), opt, spirv);
+                        compile_spirv_module_cached(vkdev, rife_v4_timestep_comp_data, sizeof(rife_v4_timestep_comp_data), opt, spirv);
                 }
             }
 
@@ -378,62 +682,194 @@ int RIFE::load(const std::string& modeldir)
     return 0;
 }
 
-int RIFE::process(const ncnn::Mat& in0image, const ncnn::Mat& in1image, float timestep, ncnn::Mat& outimage) const
+void RIFE::extract_context_features(const ncnn::VkMat& in_gpu_padded, ncnn::VkMat features[4], bool cache, ncnn::VkCompute& cmd, const ncnn::Option& opt) const
 {
-    if (!vkdev)
+    ncnn::Extractor ex = contextnet.create_extractor();
+    ex.set_blob_vkallocator(opt.blob_vkallocator);
+    ex.set_workspace_vkallocator(opt.workspace_vkallocator);
+    ex.set_staging_vkallocator(opt.staging_vkallocator);
+
+    ex.input("input.1", in_gpu_padded);
+
+    for (int i = 0; i < 4; i++)
     {
-        // cpu only
-        if (rife_v4)
-            return process_v4_cpu(in0image, in1image, timestep, outimage);
+        if (cache)
+        {
+            // move to the shared allocator so the features outlive this command
+            ncnn::VkMat feature;
+            ex.extract(context_feature_blobs[i].c_str(), feature, cmd);
+
+            ncnn::Option opt_cache = opt;
+            opt_cache.blob_vkallocator = context_feature_vkallocator;
+            cmd.record_clone(feature, features[i], opt_cache);
+        }
         else
-            return process_cpu(in0image, in1image, timestep, outimage);
+        {
+            ex.extract(context_feature_blobs[i].c_str(), features[i], cmd);
+        }
     }
+}
 
-    if (rife_v4)
-        return process_v4(in0image, in1image, timestep, outimage);
+void RIFE::extract_context_features(const ncnn::Mat& in_padded, ncnn::Mat features[4]) const
+{
+    ncnn::Extractor ex = contextnet.create_extractor();
 
-    if (timestep == 0.f)
+    ex.input("input.1", in_padded);
+
+    for (int i = 0; i < 4; i++)
     {
-        outimage = in0image;
-        return 0;
+        ex.extract(context_feature_blobs[i].c_str(), features[i]);
     }
+}
 
-    if (timestep == 1.f)
+void RIFE::warp_context_features(const ncnn::VkMat features[4], const char* flowname, const ncnn::VkMat& flow, ncnn::VkMat ctx[4], ncnn::VkCompute& cmd, const ncnn::Option& opt) const
+{
+    ncnn::Extractor ex = contextnet.create_extractor();
+    ex.set_blob_vkallocator(opt.blob_vkallocator);
+    ex.set_workspace_vkallocator(opt.workspace_vkallocator);
+    ex.set_staging_vkallocator(opt.staging_vkallocator);
+
+    ex.input(context_feature_blobs[0].c_str(), features[0]);
+    ex.input(context_feature_blobs[1].c_str(), features[1]);
+    ex.input(context_feature_blobs[2].c_str(), features[2]);
+    ex.input(context_feature_blobs[3].c_str(), features[3]);
+    ex.input(flowname, flow);
+
+    ex.extract("f1", ctx[0], cmd);
+    ex.extract("f2", ctx[1], cmd);
+    ex.extract("f3", ctx[2], cmd);
+    ex.extract("f4", ctx[3], cmd);
+}
+
+void RIFE::warp_context_features(const ncnn::Mat features[4], const char* flowname, const ncnn::Mat& flow, ncnn::Mat ctx[4]) const
+{
+    ncnn::Extractor ex = contextnet.create_extractor();
+
+    ex.input(context_feature_blobs[0].c_str(), features[0]);
+    ex.input(context_feature_blobs[1].c_str(), features[1]);
+    ex.input(context_feature_blobs[2].c_str(), features[2]);
+    ex.input(context_feature_blobs[3].c_str(), features[3]);
+    ex.input(flowname, flow);
+
+    ex.extract("f1", ctx[0]);
+    ex.extract("f2", ctx[1]);
+    ex.extract("f3", ctx[2]);
+    ex.extract("f4", ctx[3]);
+}
+
+bool RIFE::find_context_features(int frameid, int ti, ncnn::VkMat features[4]) const
+{
+    if (frameid == -1)
+        return false;
+
+    ncnn::MutexLockGuard guard(context_feature_lock);
+
+    std::list<ContextFeatures>::iterator it = context_feature_cache.begin();
+    for (; it != context_feature_cache.end(); it++)
     {
-        outimage = in1image;
-        return 0;
+        if (it->frameid == frameid && it->ti == ti)
+        {
+            features[0] = it->features_gpu[0];
+            features[1] = it->features_gpu[1];
+            features[2] = it->features_gpu[2];
+            features[3] = it->features_gpu[3];
+
+            context_feature_cache.splice(context_feature_cache.begin(), context_feature_cache, it);
+            return true;
+        }
     }
 
-    const unsigned char* pixel0data = (const unsigned char*)in0image.data;
-    const unsigned char* pixel1data = (const unsigned char*)in1image.data;
-    const int w = in0image.w;
-    const int h = in0image.h;
-    const int channels = 3;//in0image.elempack;
+    return false;
+}
 
-//     fprintf(stderr, "%d x %d\n", w, h);
+bool RIFE::find_context_features(int frameid, int ti, ncnn::Mat features[4]) const
+{
+    if (frameid == -1)
+        return false;
 
-    ncnn::VkAllocator* blob_vkallocator = vkdev->acquire_blob_allocator();
-    ncnn::VkAllocator* staging_vkallocator = vkdev->acquire_staging_allocator();
+    ncnn::MutexLockGuard guard(context_feature_lock);
 
-    ncnn::Option opt = flownet.opt;
-    opt.blob_vkallocator = blob_vkallocator;
-    opt.workspace_vkallocator = blob_vkallocator;
-    opt.staging_vkallocator = staging_vkallocator;
+    std::list<ContextFeatures>::iterator it = context_feature_cache.begin();
+    for (; it != context_feature_cache.end(); it++)
+    {
+        if (it->frameid == frameid && it->ti == ti)
+        {
+            features[0] = it->features[0];
+            features[1] = it->features[1];
+            features[2] = it->features[2];
+            features[3] = it->features[3];
 
-    // pad to 32n
-    int w_padded = (w + 31) / 32 * 32;
-    int h_padded = (h + 31) / 32 * 32;
+            context_feature_cache.splice(context_feature_cache.begin(), context_feature_cache, it);
+            return true;
+        }
+    }
 
-    const size_t in_out_tile_elemsize = opt.use_fp16_storage ? 2u : 4u;
+    return false;
+}
+
+void RIFE::cache_context_features(int frameid, int ti, const ncnn::VkMat features[4]) const
+{
+    if (frameid == -1)
+        return;
+
+    ncnn::MutexLockGuard guard(context_feature_lock);
+
+    ContextFeatures cf;
+    cf.frameid = frameid;
+    cf.ti = ti;
+    cf.features_gpu[0] = features[0];
+    cf.features_gpu[1] = features[1];
+    cf.features_gpu[2] = features[2];
+    cf.features_gpu[3] = features[3];
+    context_feature_cache.push_front(cf);
+
+    const size_t capacity = context_feature_cache_frames * (tta_mode ? 8 : 1);
+    while (context_feature_cache.size() > capacity)
+    {
+        context_feature_cache.pop_back();
+    }
+}
+
+void RIFE::cache_context_features(int frameid, int ti, const ncnn::Mat features[4]) const
+{
+    if (frameid == -1)
+        return;
+
+    ncnn::MutexLockGuard guard(context_feature_lock);
+
+    ContextFeatures cf;
+    cf.frameid = frameid;
+    cf.ti = ti;
+    cf.features[0] = features[0];
+    cf.features[1] = features[1];
+    cf.features[2] = features[2];
+    cf.features[3] = features[3];
+    context_feature_cache.push_front(cf);
+
+    const size_t capacity = context_feature_cache_frames * (tta_mode ? 8 : 1);
+    while (context_feature_cache.size() > capacity)
+    {
+        context_feature_cache.pop_back();
+    }
+}
+
+void RIFE::record_upload(const ncnn::Mat& in0image, const ncnn::Mat& in1image, ncnn::VkMat& in0_gpu, ncnn::VkMat& in1_gpu, ncnn::VkCompute& cmd, const ncnn::Option& opt, ncnn::VkBufferMemory views[2]) const
+{
+    const unsigned char* pixel0data = (const unsigned char*)in0image.data;
+    const unsigned char* pixel1data = (const unsigned char*)in1image.data;
+    const int w = in0image.w;
+    const int h = in0image.h;
+    const int channels = 3;//in0image.elempack;
 
-    ncnn::Mat in0;
-    ncnn::Mat in1;
     if (opt.use_fp16_storage && opt.use_int8_storage)
     {
-        in0 = ncnn::Mat(w, h, (unsigned char*)pixel0data, (size_t)channels, 1);
-        in1 = ncnn::Mat(w, h, (unsigned char*)pixel1data, (size_t)channels, 1);
+        record_upload_frame(frame_vkallocator, pixel0data, w, h, channels, &views[0], in0_gpu, cmd, opt);
+        record_upload_frame(frame_vkallocator, pixel1data, w, h, channels, &views[1], in1_gpu, cmd, opt);
+        return;
     }
-    else
+
+    ncnn::Mat in0;
+    ncnn::Mat in1;
     {
 #if _WIN32
         in0 = ncnn::Mat::from_pixels(pixel0data, ncnn::Mat::PIXEL_BGR2RGB, w, h);
@@ -444,40 +880,265 @@ int RIFE::process(const ncnn::Mat& in0image, const ncnn::Mat& in1image, float ti
 #endif
     }
 
+    cmd.record_clone(in0, in0_gpu, opt);
+    cmd.record_clone(in1, in1_gpu, opt);
+}
+
+int RIFE::upload(const ncnn::Mat& in0image, const ncnn::Mat& in1image, ncnn::VkMat& in0_gpu, ncnn::VkMat& in1_gpu, ncnn::VkAllocator* blob_vkallocator) const
+{
+    if (!vkdev)
+        return -1;
+
+    // tiled frames are uploaded tile by tile in process()
+    if (tiled(in0image.w, in0image.h))
+        return 0;
+
+    ncnn::VkAllocator* staging_vkallocator = vkdev->acquire_staging_allocator();
+
+    ncnn::Option opt = flownet.opt;
+    opt.blob_vkallocator = blob_vkallocator;
+    opt.workspace_vkallocator = blob_vkallocator;
+    opt.staging_vkallocator = staging_vkallocator;
+
     ncnn::VkCompute cmd(vkdev);
 
-    // upload
-    ncnn::VkMat in0_gpu;
-    ncnn::VkMat in1_gpu;
+    // must outlive the command, recorded copies refer to them
+    ncnn::VkBufferMemory in_views[2];
+
+    record_upload(in0image, in1image, in0_gpu, in1_gpu, cmd, opt, in_views);
+
+    trace_submit(cmd, "upload");
+    cmd.submit_and_wait();
+
+    vkdev->reclaim_staging_allocator(staging_vkallocator);
+
+    return 0;
+}
+
+void RIFE::trace_submit(ncnn::VkCompute& cmd, const char* stage) const
+{
+    if (!trace_enabled())
+        return;
+
+    const double start = trace_now();
+    cmd.submit_and_wait();
+    trace_event(stage, trace_device, start, trace_now());
+    cmd.reset();
+}
+
+bool RIFE::tiled(int w, int h) const
+{
+    return tilesize > 0 && (w > tilesize || h > tilesize);
+}
+
+int RIFE::process_tiled(const ncnn::Mat& in0image, const ncnn::Mat& in1image, const std::vector<float>& timesteps, std::vector<ncnn::Mat>& outimages) const
+{
+    const int w = in0image.w;
+    const int h = in0image.h;
+    const int channels = 3;//in0image.elempack;
+
+    const int count = (int)timesteps.size();
+
+    // balanced cores, each grown by tile_pad on every side still fits in tilesize
+    const int tile_core = tilesize - tile_pad * 2;
+    const int xtiles = (w + tile_core - 1) / tile_core;
+    const int ytiles = (h + tile_core - 1) / tile_core;
+    const int core_w = (w + xtiles - 1) / xtiles;
+    const int core_h = (h + ytiles - 1) / ytiles;
+
+    // weighted sum of the tile outputs in 8.8 fixed point
+    std::vector<std::vector<unsigned short> > accum(count);
+    for (int k = 0; k < count; k++)
     {
-        cmd.record_clone(in0, in0_gpu, opt);
-        cmd.record_clone(in1, in1_gpu, opt);
+        accum[k].resize((size_t)w * h * channels, 0);
     }
 
-    ncnn::VkMat out_gpu;
-
-    if (tta_mode)
+    for (int yi = 0; yi < ytiles; yi++)
     {
-        // preproc
-        ncnn::VkMat in0_gpu_padded[8];
-        ncnn::VkMat in1_gpu_padded[8];
+        const int cy0 = yi * core_h;
+        const int cy1 = std::min(cy0 + core_h, h);
+        const int ty0 = std::max(cy0 - tile_pad, 0);
+        const int ty1 = std::min(cy1 + tile_pad, h);
+        const int th = ty1 - ty0;
+
+        for (int xi = 0; xi < xtiles; xi++)
         {
-            in0_gpu_padded[0].create(w_padded, h_padded, 3, in_out_tile_elemsize, 1, blob_vkallocator);
-            in0_gpu_padded[1].create(w_padded, h_padded, 3, in_out_tile_elemsize, 1, blob_vkallocator);
-            in0_gpu_padded[2].create(w_padded, h_padded, 3, in_out_tile_elemsize, 1, blob_vkallocator);
-            in0_gpu_padded[3].create(w_padded, h_padded, 3, in_out_tile_elemsize, 1, blob_vkallocator);
-            in0_gpu_padded[4].create(h_padded, w_padded, 3, in_out_tile_elemsize, 1, blob_vkallocator);
-            in0_gpu_padded[5].create(h_padded, w_padded, 3, in_out_tile_elemsize, 1, blob_vkallocator);
-            in0_gpu_padded[6].create(h_padded, w_padded, 3, in_out_tile_elemsize, 1, blob_vkallocator);
-            in0_gpu_padded[7].create(h_padded, w_padded, 3, in_out_tile_elemsize, 1, blob_vkallocator);
+            const int cx0 = xi * core_w;
+            const int cx1 = std::min(cx0 + core_w, w);
+            const int tx0 = std::max(cx0 - tile_pad, 0);
+            const int tx1 = std::min(cx1 + tile_pad, w);
+            const int tw = tx1 - tx0;
+
+            ncnn::Mat in0tile(tw, th, (size_t)channels, channels);
+            ncnn::Mat in1tile(tw, th, (size_t)channels, channels);
+            for (int i = 0; i < th; i++)
+            {
+                const size_t offset = ((size_t)(ty0 + i) * w + tx0) * channels;
+                memcpy((unsigned char*)in0tile.data + (size_t)i * tw * channels, (const unsigned char*)in0image.data + offset, tw * channels);
+                memcpy((unsigned char*)in1tile.data + (size_t)i * tw * channels, (const unsigned char*)in1image.data + offset, tw * channels);
+            }
 
-            std::vector<ncnn::VkMat> bindings(9);
-            bindings[0] = in0_gpu;
-            bindings[1] = in0_gpu_padded[0];
-            bindings[2] = in0_gpu_padded[1];
-            bindings[3] = in0_gpu_padded[2];
-            bindings[4] = in0_gpu_padded[3];
-            bindings[5] = in0_gpu_padded[4];
+            std::vector<ncnn::Mat> outtiles(count);
+            for (int k = 0; k < count; k++)
+            {
+                outtiles[k] = ncnn::Mat(tw, th, (size_t)channels, channels);
+            }
+
+            // tiles are never larger than tilesize, so this does not tile again
+            int ret = 0;
+            if (rife_v4)
+            {
+                ret = process_v4_multi(in0tile, in1tile, timesteps, outtiles);
+            }
+            else
+            {
+                for (int k = 0; k < count && ret == 0; k++)
+                {
+                    ret = process(in0tile, in1tile, timesteps[k], outtiles[k]);
+                }
+            }
+            if (ret != 0)
+                return ret;
+
+            // cross-fade into the neighbouring tiles
+            for (int k = 0; k < count; k++)
+            {
+                for (int i = 0; i < th; i++)
+                {
+                    const int wy = tile_weight(ty0 + i, cy0, cy1, h);
+                    if (wy == 0)
+                        continue;
+
+                    const unsigned char* ptr = (const unsigned char*)outtiles[k].data + (size_t)i * tw * channels;
+                    unsigned short* accptr = &accum[k][((size_t)(ty0 + i) * w + tx0) * channels];
+
+                    for (int j = 0; j < tw; j++)
+                    {
+                        const int wxy = tile_weight(tx0 + j, cx0, cx1, w) * wy;
+
+                        for (int c = 0; c < channels; c++)
+                        {
+                            accptr[c] += (ptr[c] * wxy + 128) >> 8;
+                        }
+
+                        ptr += channels;
+                        accptr += channels;
+                    }
+                }
+            }
+        }
+    }
+
+    for (int k = 0; k < count; k++)
+    {
+        const unsigned short* accptr = &accum[k][0];
+        unsigned char* outptr = (unsigned char*)outimages[k].data;
+
+        for (size_t i = 0; i < accum[k].size(); i++)
+        {
+            outptr[i] = (accptr[i] + 128) >> 8;
+        }
+    }
+
+    return 0;
+}
+
+int RIFE::process(const ncnn::Mat& in0image, const ncnn::Mat& in1image, float timestep, ncnn::Mat& outimage, int in0id, int in1id, const ncnn::VkMat& in0_gpu_uploaded, const ncnn::VkMat& in1_gpu_uploaded) const
+{
+    if (tiled(in0image.w, in0image.h) && timestep != 0.f && timestep != 1.f)
+    {
+        std::vector<float> timesteps(1, timestep);
+        std::vector<ncnn::Mat> outimages(1, outimage);
+        return process_tiled(in0image, in1image, timesteps, outimages);
+    }
+
+    if (!vkdev)
+    {
+        // cpu only
+        if (rife_v4)
+            return process_v4_cpu(in0image, in1image, timestep, outimage);
+        else
+            return process_cpu(in0image, in1image, timestep, outimage, in0id, in1id);
+    }
+
+    if (rife_v4)
+        return process_v4(in0image, in1image, timestep, outimage);
+
+    if (timestep == 0.f)
+    {
+        outimage = in0image;
+        return 0;
+    }
+
+    if (timestep == 1.f)
+    {
+        outimage = in1image;
+        return 0;
+    }
+
+    const int w = in0image.w;
+    const int h = in0image.h;
+    const int channels = 3;//in0image.elempack;
+
+//     fprintf(stderr, "%d x %d\n", w, h);
+
+    ncnn::VkAllocator* blob_vkallocator = vkdev->acquire_blob_allocator();
+    ncnn::VkAllocator* staging_vkallocator = vkdev->acquire_staging_allocator();
+
+    ncnn::Option opt = flownet.opt;
+    opt.blob_vkallocator = blob_vkallocator;
+    opt.workspace_vkallocator = blob_vkallocator;
+    opt.staging_vkallocator = staging_vkallocator;
+
+    // pad to 32n
+    int w_padded = (w + 31) / 32 * 32;
+    int h_padded = (h + 31) / 32 * 32;
+
+    const size_t in_out_tile_elemsize = opt.use_fp16_storage ? 2u : 4u;
+
+    ncnn::VkCompute cmd(vkdev);
+
+    // upload, unless the caller has already done it ahead of time
+    // the mapped views must outlive the command, recorded copies refer to them
+    ncnn::VkBufferMemory in_views[2];
+    ncnn::VkMat in0_gpu = in0_gpu_uploaded;
+    ncnn::VkMat in1_gpu = in1_gpu_uploaded;
+    if (in0_gpu.empty() || in1_gpu.empty())
+    {
+        record_upload(in0image, in1image, in0_gpu, in1_gpu, cmd, opt, in_views);
+        trace_submit(cmd, "upload");
+    }
+
+    ncnn::VkMat out_gpu;
+
+    // contextnet features of in0 and in1 for each tta direction
+    ncnn::VkMat feat0[8][4];
+    ncnn::VkMat feat1[8][4];
+    bool feat0_cached[8] = {false};
+    bool feat1_cached[8] = {false};
+
+    if (tta_mode)
+    {
+        // preproc
+        ncnn::VkMat in0_gpu_padded[8];
+        ncnn::VkMat in1_gpu_padded[8];
+        {
+            in0_gpu_padded[0].create(w_padded, h_padded, 3, in_out_tile_elemsize, 1, blob_vkallocator);
+            in0_gpu_padded[1].create(w_padded, h_padded, 3, in_out_tile_elemsize, 1, blob_vkallocator);
+            in0_gpu_padded[2].create(w_padded, h_padded, 3, in_out_tile_elemsize, 1, blob_vkallocator);
+            in0_gpu_padded[3].create(w_padded, h_padded, 3, in_out_tile_elemsize, 1, blob_vkallocator);
+            in0_gpu_padded[4].create(h_padded, w_padded, 3, in_out_tile_elemsize, 1, blob_vkallocator);
+            in0_gpu_padded[5].create(h_padded, w_padded, 3, in_out_tile_elemsize, 1, blob_vkallocator);
+            in0_gpu_padded[6].create(h_padded, w_padded, 3, in_out_tile_elemsize, 1, blob_vkallocator);
+            in0_gpu_padded[7].create(h_padded, w_padded, 3, in_out_tile_elemsize, 1, blob_vkallocator);
+
+            std::vector<ncnn::VkMat> bindings(9);
+            bindings[0] = in0_gpu;
+            bindings[1] = in0_gpu_padded[0];
+            bindings[2] = in0_gpu_padded[1];
+            bindings[3] = in0_gpu_padded[2];
+            bindings[4] = in0_gpu_padded[3];
+            bindings[5] = in0_gpu_padded[4];
             bindings[6] = in0_gpu_padded[5];
             bindings[7] = in0_gpu_padded[6];
             bindings[8] = in0_gpu_padded[7];
@@ -680,53 +1341,42 @@ int RIFE::process(const ncnn::Mat& in0image, const ncnn::Mat& in1image, float ti
             }
         }
 
+        trace_submit(cmd, "flownet");
+
+        for (int ti = 0; ti < 8; ti++)
+        {
+            feat0_cached[ti] = find_context_features(in0id, ti, feat0[ti]);
+            feat1_cached[ti] = find_context_features(in1id, ti, feat1[ti]);
+        }
+
         ncnn::VkMat out_gpu_padded[8];
         for (int ti = 0; ti < 8; ti++)
         {
             // contextnet
+            if (!feat0_cached[ti])
+            {
+                extract_context_features(in0_gpu_padded[ti], feat0[ti], in0id != -1, cmd, opt);
+            }
+            if (!feat1_cached[ti])
+            {
+                extract_context_features(in1_gpu_padded[ti], feat1[ti], in1id != -1, cmd, opt);
+            }
+
             ncnn::VkMat ctx0[4];
             ncnn::VkMat ctx1[4];
+            if (rife_v2)
             {
-                ncnn::Extractor ex = contextnet.create_extractor();
-                ex.set_blob_vkallocator(blob_vkallocator);
-                ex.set_workspace_vkallocator(blob_vkallocator);
-                ex.set_staging_vkallocator(staging_vkallocator);
-
-                ex.input("input.1", in0_gpu_padded[ti]);
-                if (rife_v2)
-                {
-                    ex.input("flow.0", flow0[ti]);
-                }
-                else
-                {
-                    ex.input("flow.0", flow[ti]);
-                }
-                ex.extract("f1", ctx0[0], cmd);
-                ex.extract("f2", ctx0[1], cmd);
-                ex.extract("f3", ctx0[2], cmd);
-                ex.extract("f4", ctx0[3], cmd);
+                warp_context_features(feat0[ti], "flow.0", flow0[ti], ctx0, cmd, opt);
+                warp_context_features(feat1[ti], "flow.0", flow1[ti], ctx1, cmd, opt);
             }
+            else
             {
-                ncnn::Extractor ex = contextnet.create_extractor();
-                ex.set_blob_vkallocator(blob_vkallocator);
-                ex.set_workspace_vkallocator(blob_vkallocator);
-                ex.set_staging_vkallocator(staging_vkallocator);
-
-                ex.input("input.1", in1_gpu_padded[ti]);
-                if (rife_v2)
-                {
-                    ex.input("flow.0", flow1[ti]);
-                }
-                else
-                {
-                    ex.input("flow.1", flow[ti]);
-                }
-                ex.extract("f1", ctx1[0], cmd);
-                ex.extract("f2", ctx1[1], cmd);
-                ex.extract("f3", ctx1[2], cmd);
-                ex.extract("f4", ctx1[3], cmd);
+                warp_context_features(feat0[ti], "flow.0", flow[ti], ctx0, cmd, opt);
+                warp_context_features(feat1[ti], "flow.1", flow[ti], ctx1, cmd, opt);
             }
 
+            trace_submit(cmd, "contextnet");
+
             // fusionnet
             {
                 ncnn::Extractor ex = fusionnet.create_extractor();
@@ -840,6 +1490,8 @@ int RIFE::process(const ncnn::Mat& in0image, const ncnn::Mat& in1image, float ti
                     cmd.record_pipeline(rife_out_tta_temporal_avg, bindings, constants, dispatcher);
                 }
             }
+
+            trace_submit(cmd, "fusionnet");
         }
 
         if (opt.use_fp16_storage && opt.use_int8_storage)
@@ -1015,50 +1667,35 @@ int RIFE::process(const ncnn::Mat& in0image, const ncnn::Mat& in1image, float ti
             flow1 = outputs[1];
         }
 
+        trace_submit(cmd, "flownet");
+
         // contextnet
+        feat0_cached[0] = find_context_features(in0id, 0, feat0[0]);
+        feat1_cached[0] = find_context_features(in1id, 0, feat1[0]);
+        if (!feat0_cached[0])
+        {
+            extract_context_features(in0_gpu_padded, feat0[0], in0id != -1, cmd, opt);
+        }
+        if (!feat1_cached[0])
+        {
+            extract_context_features(in1_gpu_padded, feat1[0], in1id != -1, cmd, opt);
+        }
+
         ncnn::VkMat ctx0[4];
         ncnn::VkMat ctx1[4];
+        if (rife_v2)
         {
-            ncnn::Extractor ex = contextnet.create_extractor();
-            ex.set_blob_vkallocator(blob_vkallocator);
-            ex.set_workspace_vkallocator(blob_vkallocator);
-            ex.set_staging_vkallocator(staging_vkallocator);
-
-            ex.input("input.1", in0_gpu_padded);
-            if (rife_v2)
-            {
-                ex.input("flow.0", flow0);
-            }
-            else
-            {
-                ex.input("flow.0", flow);
-            }
-            ex.extract("f1", ctx0[0], cmd);
-            ex.extract("f2", ctx0[1], cmd);
-            ex.extract("f3", ctx0[2], cmd);
-            ex.extract("f4", ctx0[3], cmd);
+            warp_context_features(feat0[0], "flow.0", flow0, ctx0, cmd, opt);
+            warp_context_features(feat1[0], "flow.0", flow1, ctx1, cmd, opt);
         }
+        else
         {
-            ncnn::Extractor ex = contextnet.create_extractor();
-            ex.set_blob_vkallocator(blob_vkallocator);
-            ex.set_workspace_vkallocator(blob_vkallocator);
-            ex.set_staging_vkallocator(staging_vkallocator);
-
-            ex.input("input.1", in1_gpu_padded);
-            if (rife_v2)
-            {
-                ex.input("flow.0", flow1);
-            }
-            else
-            {
-                ex.input("flow.1", flow);
-            }
-            ex.extract("f1", ctx1[0], cmd);
-            ex.extract("f2", ctx1[1], cmd);
-            ex.extract("f3", ctx1[2], cmd);
-            ex.extract("f4", ctx1[3], cmd);
+            warp_context_features(feat0[0], "flow.0", flow, ctx0, cmd, opt);
+            warp_context_features(feat1[0], "flow.1", flow, ctx1, cmd, opt);
         }
 
+        trace_submit(cmd, "contextnet");
+
         // fusionnet
         ncnn::VkMat out_gpu_padded;
         {
@@ -1155,6 +1792,8 @@ int RIFE::process(const ncnn::Mat& in0image, const ncnn::Mat& in1image, float ti
             }
         }
 
+        trace_submit(cmd, "fusionnet");
+
         if (opt.use_fp16_storage && opt.use_int8_storage)
         {
             out_gpu.create(w, h, (size_t)channels, 1, blob_vkallocator);
@@ -1185,16 +1824,33 @@ int RIFE::process(const ncnn::Mat& in0image, const ncnn::Mat& in1image, float ti
     // download
     {
         ncnn::Mat out;
+        ncnn::VkBufferMemory out_view;
+        ncnn::VkMat out_gpu_mapped;
+        bool out_mapped = false;
 
         if (opt.use_fp16_storage && opt.use_int8_storage)
         {
+            out_mapped = view_download_frame(frame_vkallocator, out_gpu, (const unsigned char*)outimage.data, channels, &out_view);
             out = ncnn::Mat(out_gpu.w, out_gpu.h, (unsigned char*)outimage.data, (size_t)channels, 1);
         }
 
-        cmd.record_clone(out_gpu, out, opt);
+        if (out_mapped)
+        {
+            out_mapped = record_download_frame(out_gpu, &out_view, channels, out_gpu_mapped, out, cmd, opt);
+        }
+        else
+        {
+            cmd.record_clone(out_gpu, out, opt);
+        }
 
+        trace_submit(cmd, "download");
         cmd.submit_and_wait();
 
+        if (out_mapped)
+        {
+            frame_vkallocator->invalidate(&out_view);
+        }
+
         if (!(opt.use_fp16_storage && opt.use_int8_storage))
         {
 #if _WIN32
@@ -1205,13 +1861,52 @@ int RIFE::process(const ncnn::Mat& in0image, const ncnn::Mat& in1image, float ti
         }
     }
 
+    // the features are ready for other pairs only after the command completes
+    for (int ti = 0; ti < (tta_mode ? 8 : 1); ti++)
+    {
+        if (!feat0_cached[ti])
+            cache_context_features(in0id, ti, feat0[ti]);
+        if (!feat1_cached[ti])
+            cache_context_features(in1id, ti, feat1[ti]);
+    }
+
     vkdev->reclaim_blob_allocator(blob_vkallocator);
     vkdev->reclaim_staging_allocator(staging_vkallocator);
 
     return 0;
 }
 
-int RIFE::process_cpu(const ncnn::Mat& in0image, const ncnn::Mat& in1image, float timestep, ncnn::Mat& outimage) const
+void RIFE::extract_flow(const ncnn::Mat& in0_padded, const ncnn::Mat& in1_padded, ncnn::Mat& flow, const ncnn::Option& opt) const
+{
+    ncnn::Extractor ex = flownet.create_extractor();
+
+    if (uhd_mode)
+    {
+        ncnn::Mat in0_padded_downscaled;
+        ncnn::Mat in1_padded_downscaled;
+        rife_uhd_downscale_image->forward(in0_padded, in0_padded_downscaled, opt);
+        rife_uhd_downscale_image->forward(in1_padded, in1_padded_downscaled, opt);
+
+        ex.input("input0", in0_padded_downscaled);
+        ex.input("input1", in1_padded_downscaled);
+
+        ncnn::Mat flow_downscaled;
+        ex.extract("flow", flow_downscaled);
+
+        ncnn::Mat flow_half;
+        rife_uhd_upscale_flow->forward(flow_downscaled, flow_half, opt);
+
+        rife_uhd_double_flow->forward(flow_half, flow, opt);
+    }
+    else
+    {
+        ex.input("input0", in0_padded);
+        ex.input("input1", in1_padded);
+        ex.extract("flow", flow);
+    }
+}
+
+int RIFE::process_cpu(const ncnn::Mat& in0image, const ncnn::Mat& in1image, float timestep, ncnn::Mat& outimage, int in0id, int in1id) const
 {
     if (timestep == 0.f)
     {
@@ -1239,799 +1934,184 @@ int RIFE::process_cpu(const ncnn::Mat& in0image, const ncnn::Mat& in1image, floa
     int w_padded = (w + 31) / 32 * 32;
     int h_padded = (h + 31) / 32 * 32;
 
-    ncnn::Mat in0;
-    ncnn::Mat in1;
-    {
-#if _WIN32
-        in0 = ncnn::Mat::from_pixels(pixel0data, ncnn::Mat::PIXEL_BGR2RGB, w, h);
-        in1 = ncnn::Mat::from_pixels(pixel1data, ncnn::Mat::PIXEL_BGR2RGB, w, h);
-#else
-        in0 = ncnn::Mat::from_pixels(pixel0data, ncnn::Mat::PIXEL_RGB, w, h);
-        in1 = ncnn::Mat::from_pixels(pixel1data, ncnn::Mat::PIXEL_RGB, w, h);
-#endif
-    }
-
     ncnn::Mat out;
 
     if (tta_mode)
     {
-        // preproc and border padding
-        ncnn::Mat in0_padded[8];
-        ncnn::Mat in1_padded[8];
+        // evaluate the directions one at a time and accumulate in the canonical orientation
+        // so that memory does not grow with the number of directions
+        // directions of one batch run in parallel, the sums are still taken in direction order
+        const int flow_channels = rife_v2 ? 4 : 2;
+
+        ncnn::Mat flow_avg(w_padded, h_padded, flow_channels);
+        ncnn::Mat flow_reversed_avg;
+        flow_avg.fill(0.f);
+        if (tta_temporal_mode)
         {
-            in0_padded[0].create(w_padded, h_padded, 3);
-            for (int q = 0; q < 3; q++)
+            flow_reversed_avg.create(w_padded, h_padded, flow_channels);
+            flow_reversed_avg.fill(0.f);
+        }
+
+        for (int tb = 0; tb < 8; tb += tta_jobs)
+        {
+            const int tcount = std::min(tta_jobs, 8 - tb);
+
+            std::vector<ncnn::Mat> flow(tcount);
+            std::vector<ncnn::Mat> flow_reversed(tcount);
+
+            #pragma omp parallel for num_threads(tcount)
+            for (int k = 0; k < tcount; k++)
             {
-                float* outptr = in0_padded[0].channel(q);
+                const int ti = tb + k;
 
-                int i = 0;
-                for (; i < h; i++)
-                {
-                    const float* ptr = in0.channel(q).row(i);
+                // preproc and border padding
+                ncnn::Mat in0_padded;
+                ncnn::Mat in1_padded;
+                preproc_cpu_direction(pixel0data, w, h, w_padded, h_padded, ti, in0_padded, opt.num_threads);
+                preproc_cpu_direction(pixel1data, w, h, w_padded, h_padded, ti, in1_padded, opt.num_threads);
 
-                    int j = 0;
-                    for (; j < w; j++)
-                    {
-                        *outptr++ = *ptr++ * (1 / 255.f);
-                    }
-                    for (; j < w_padded; j++)
-                    {
-                        *outptr++ = 0.f;
-                    }
-                }
-                for (; i < h_padded; i++)
+                // flownet
+                extract_flow(in0_padded, in1_padded, flow[k], opt);
+
+                if (tta_temporal_mode)
                 {
-                    for (int j = 0; j < w_padded; j++)
-                    {
-                        *outptr++ = 0.f;
-                    }
+                    extract_flow(in1_padded, in0_padded, flow_reversed[k], opt);
+
+                    merge_flow_reversed(flow[k], flow_reversed[k], rife_v2);
                 }
             }
-        }
-        {
-            in1_padded[0].create(w_padded, h_padded, 3);
-            for (int q = 0; q < 3; q++)
-            {
-                float* outptr = in1_padded[0].channel(q);
 
-                int i = 0;
-                for (; i < h; i++)
-                {
-                    const float* ptr = in1.channel(q).row(i);
+            for (int k = 0; k < tcount; k++)
+            {
+                tta_flow_accumulate(flow[k], tb + k, flow_avg, opt.num_threads);
 
-                    int j = 0;
-                    for (; j < w; j++)
-                    {
-                        *outptr++ = *ptr++ * (1 / 255.f);
-                    }
-                    for (; j < w_padded; j++)
-                    {
-                        *outptr++ = 0.f;
-                    }
-                }
-                for (; i < h_padded; i++)
+                if (tta_temporal_mode)
                 {
-                    for (int j = 0; j < w_padded; j++)
-                    {
-                        *outptr++ = 0.f;
-                    }
+                    tta_flow_accumulate(flow_reversed[k], tb + k, flow_reversed_avg, opt.num_threads);
                 }
             }
         }
 
-        // the other 7 directions
+        // avg flow
         {
-            in0_padded[1].create(w_padded, h_padded, 3);
-            in0_padded[2].create(w_padded, h_padded, 3);
-            in0_padded[3].create(w_padded, h_padded, 3);
-            in0_padded[4].create(h_padded, w_padded, 3);
-            in0_padded[5].create(h_padded, w_padded, 3);
-            in0_padded[6].create(h_padded, w_padded, 3);
-            in0_padded[7].create(h_padded, w_padded, 3);
-
-            for (int q = 0; q < 3; q++)
+            float* ptr = flow_avg;
+            for (size_t i = 0; i < flow_avg.total(); i++)
             {
-                const ncnn::Mat in0_padded_0 = in0_padded[0].channel(q);
-                ncnn::Mat in0_padded_1 = in0_padded[1].channel(q);
-                ncnn::Mat in0_padded_2 = in0_padded[2].channel(q);
-                ncnn::Mat in0_padded_3 = in0_padded[3].channel(q);
-                ncnn::Mat in0_padded_4 = in0_padded[4].channel(q);
-                ncnn::Mat in0_padded_5 = in0_padded[5].channel(q);
-                ncnn::Mat in0_padded_6 = in0_padded[6].channel(q);
-                ncnn::Mat in0_padded_7 = in0_padded[7].channel(q);
-
-                for (int i = 0; i < h_padded; i++)
-                {
-                    const float* outptr0 = in0_padded_0.row(i);
-                    float* outptr1 = in0_padded_1.row(i) + w_padded - 1;
-                    float* outptr2 = in0_padded_2.row(h_padded - 1 - i) + w_padded - 1;
-                    float* outptr3 = in0_padded_3.row(h_padded - 1 - i);
-
-                    for (int j = 0; j < w_padded; j++)
-                    {
-                        float* outptr4 = in0_padded_4.row(j) + i;
-                        float* outptr5 = in0_padded_5.row(j) + h_padded - 1 - i;
-                        float* outptr6 = in0_padded_6.row(w_padded - 1 - j) + h_padded - 1 - i;
-                        float* outptr7 = in0_padded_7.row(w_padded - 1 - j) + i;
-
-                        float v = *outptr0++;
-
-                        *outptr1-- = v;
-                        *outptr2-- = v;
-                        *outptr3++ = v;
-                        *outptr4 = v;
-                        *outptr5 = v;
-                        *outptr6 = v;
-                        *outptr7 = v;
-                    }
-                }
+                ptr[i] *= 0.125f;
             }
         }
+        if (tta_temporal_mode)
         {
-            in1_padded[1].create(w_padded, h_padded, 3);
-            in1_padded[2].create(w_padded, h_padded, 3);
-            in1_padded[3].create(w_padded, h_padded, 3);
-            in1_padded[4].create(h_padded, w_padded, 3);
-            in1_padded[5].create(h_padded, w_padded, 3);
-            in1_padded[6].create(h_padded, w_padded, 3);
-            in1_padded[7].create(h_padded, w_padded, 3);
-
-            for (int q = 0; q < 3; q++)
+            float* ptr = flow_reversed_avg;
+            for (size_t i = 0; i < flow_reversed_avg.total(); i++)
             {
-                const ncnn::Mat in1_padded_0 = in1_padded[0].channel(q);
-                ncnn::Mat in1_padded_1 = in1_padded[1].channel(q);
-                ncnn::Mat in1_padded_2 = in1_padded[2].channel(q);
-                ncnn::Mat in1_padded_3 = in1_padded[3].channel(q);
-                ncnn::Mat in1_padded_4 = in1_padded[4].channel(q);
-                ncnn::Mat in1_padded_5 = in1_padded[5].channel(q);
-                ncnn::Mat in1_padded_6 = in1_padded[6].channel(q);
-                ncnn::Mat in1_padded_7 = in1_padded[7].channel(q);
-
-                for (int i = 0; i < h_padded; i++)
-                {
-                    const float* outptr0 = in1_padded_0.row(i);
-                    float* outptr1 = in1_padded_1.row(i) + w_padded - 1;
-                    float* outptr2 = in1_padded_2.row(h_padded - 1 - i) + w_padded - 1;
-                    float* outptr3 = in1_padded_3.row(h_padded - 1 - i);
-
-                    for (int j = 0; j < w_padded; j++)
-                    {
-                        float* outptr4 = in1_padded_4.row(j) + i;
-                        float* outptr5 = in1_padded_5.row(j) + h_padded - 1 - i;
-                        float* outptr6 = in1_padded_6.row(w_padded - 1 - j) + h_padded - 1 - i;
-                        float* outptr7 = in1_padded_7.row(w_padded - 1 - j) + i;
-
-                        float v = *outptr0++;
-
-                        *outptr1-- = v;
-                        *outptr2-- = v;
-                        *outptr3++ = v;
-                        *outptr4 = v;
-                        *outptr5 = v;
-                        *outptr6 = v;
-                        *outptr7 = v;
-                    }
-                }
+                ptr[i] *= 0.125f;
             }
-        }
-
-        ncnn::Mat flow[8];
-        for (int ti = 0; ti < 8; ti++)
-        {
-            // flownet
-            {
-                ncnn::Extractor ex = flownet.create_extractor();
-
-                if (uhd_mode)
-                {
-                    ncnn::Mat in0_padded_downscaled;
-                    ncnn::Mat in1_padded_downscaled;
-                    rife_uhd_downscale_image->forward(in0_padded[ti], in0_padded_downscaled, opt);
-                    rife_uhd_downscale_image->forward(in1_padded[ti], in1_padded_downscaled, opt);
-
-                    ex.input("input0", in0_padded_downscaled);
-                    ex.input("input1", in1_padded_downscaled);
-
-                    ncnn::Mat flow_downscaled;
-                    ex.extract("flow", flow_downscaled);
-
-                    ncnn::Mat flow_half;
-                    rife_uhd_upscale_flow->forward(flow_downscaled, flow_half, opt);
 
-                    rife_uhd_double_flow->forward(flow_half, flow[ti], opt);
-                }
-                else
-                {
-                    ex.input("input0", in0_padded[ti]);
-                    ex.input("input1", in1_padded[ti]);
-                    ex.extract("flow", flow[ti]);
-                }
-            }
+            merge_flow_reversed(flow_avg, flow_reversed_avg, rife_v2);
         }
 
-        ncnn::Mat flow_reversed[8];
+        ncnn::Mat out_sum(w, h, 3);
+        ncnn::Mat out_reversed_sum;
+        out_sum.fill(0.f);
         if (tta_temporal_mode)
         {
-            for (int ti = 0; ti < 8; ti++)
-            {
-                // flownet
-                {
-                    ncnn::Extractor ex = flownet.create_extractor();
-
-                    if (uhd_mode)
-                    {
-                        ncnn::Mat in0_padded_downscaled;
-                        ncnn::Mat in1_padded_downscaled;
-                        rife_uhd_downscale_image->forward(in0_padded[ti], in0_padded_downscaled, opt);
-                        rife_uhd_downscale_image->forward(in1_padded[ti], in1_padded_downscaled, opt);
-
-                        ex.input("input0", in1_padded_downscaled);
-                        ex.input("input1", in0_padded_downscaled);
-
-                        ncnn::Mat flow_downscaled;
-                        ex.extract("flow", flow_downscaled);
-
-                        ncnn::Mat flow_half;
-                        rife_uhd_upscale_flow->forward(flow_downscaled, flow_half, opt);
-
-                        rife_uhd_double_flow->forward(flow_half, flow_reversed[ti], opt);
-                    }
-                    else
-                    {
-                        ex.input("input0", in1_padded[ti]);
-                        ex.input("input1", in0_padded[ti]);
-                        ex.extract("flow", flow_reversed[ti]);
-                    }
-                }
-
-                // merge flow and flow_reversed
-                {
-                    float* flow_x = flow[ti].channel(0);
-                    float* flow_y = flow[ti].channel(1);
-                    float* flow_reversed_x = flow_reversed[ti].channel(0);
-                    float* flow_reversed_y = flow_reversed[ti].channel(1);
-
-                    if (rife_v2)
-                    {
-                        float* flow_z = flow[ti].channel(2);
-                        float* flow_w = flow[ti].channel(3);
-                        float* flow_reversed_z = flow_reversed[ti].channel(2);
-                        float* flow_reversed_w = flow_reversed[ti].channel(3);
-
-                        for (int i = 0; i < flow[ti].h; i++)
-                        {
-                            for (int j = 0; j < flow[ti].w; j++)
-                            {
-                                float x = (*flow_x + *flow_reversed_z) * 0.5f;
-                                float y = (*flow_y + *flow_reversed_w) * 0.5f;
-                                float z = (*flow_z + *flow_reversed_x) * 0.5f;
-                                float w = (*flow_w + *flow_reversed_y) * 0.5f;
-
-                                *flow_x++ = x;
-                                *flow_y++ = y;
-                                *flow_z++ = z;
-                                *flow_w++ = w;
-                                *flow_reversed_x++ = z;
-                                *flow_reversed_y++ = w;
-                                *flow_reversed_z++ = x;
-                                *flow_reversed_w++ = y;
-                            }
-                        }
-                    }
-                    else
-                    {
-                        for (int i = 0; i < flow[ti].h; i++)
-                        {
-                            for (int j = 0; j < flow[ti].w; j++)
-                            {
-                                float x = (*flow_x - *flow_reversed_x) * 0.5f;
-                                float y = (*flow_y - *flow_reversed_y) * 0.5f;
-
-                                *flow_x++ = x;
-                                *flow_y++ = y;
-                                *flow_reversed_x++ = -x;
-                                *flow_reversed_y++ = -y;
-                            }
-                        }
-                    }
-                }
-            }
+            out_reversed_sum.create(w, h, 3);
+            out_reversed_sum.fill(0.f);
         }
 
-        // avg flow
-        ncnn::Mat flow0[8];
-        ncnn::Mat flow1[8];
+        for (int tb = 0; tb < 8; tb += tta_jobs)
         {
-            ncnn::Mat flow_x0 = flow[0].channel(0);
-            ncnn::Mat flow_x1 = flow[1].channel(0);
-            ncnn::Mat flow_x2 = flow[2].channel(0);
-            ncnn::Mat flow_x3 = flow[3].channel(0);
-            ncnn::Mat flow_x4 = flow[4].channel(0);
-            ncnn::Mat flow_x5 = flow[5].channel(0);
-            ncnn::Mat flow_x6 = flow[6].channel(0);
-            ncnn::Mat flow_x7 = flow[7].channel(0);
-
-            ncnn::Mat flow_y0 = flow[0].channel(1);
-            ncnn::Mat flow_y1 = flow[1].channel(1);
-            ncnn::Mat flow_y2 = flow[2].channel(1);
-            ncnn::Mat flow_y3 = flow[3].channel(1);
-            ncnn::Mat flow_y4 = flow[4].channel(1);
-            ncnn::Mat flow_y5 = flow[5].channel(1);
-            ncnn::Mat flow_y6 = flow[6].channel(1);
-            ncnn::Mat flow_y7 = flow[7].channel(1);
+            const int tcount = std::min(tta_jobs, 8 - tb);
 
-            if (rife_v2)
-            {
-                ncnn::Mat flow_z0 = flow[0].channel(2);
-                ncnn::Mat flow_z1 = flow[1].channel(2);
-                ncnn::Mat flow_z2 = flow[2].channel(2);
-                ncnn::Mat flow_z3 = flow[3].channel(2);
-                ncnn::Mat flow_z4 = flow[4].channel(2);
-                ncnn::Mat flow_z5 = flow[5].channel(2);
-                ncnn::Mat flow_z6 = flow[6].channel(2);
-                ncnn::Mat flow_z7 = flow[7].channel(2);
-
-                ncnn::Mat flow_w0 = flow[0].channel(3);
-                ncnn::Mat flow_w1 = flow[1].channel(3);
-                ncnn::Mat flow_w2 = flow[2].channel(3);
-                ncnn::Mat flow_w3 = flow[3].channel(3);
-                ncnn::Mat flow_w4 = flow[4].channel(3);
-                ncnn::Mat flow_w5 = flow[5].channel(3);
-                ncnn::Mat flow_w6 = flow[6].channel(3);
-                ncnn::Mat flow_w7 = flow[7].channel(3);
-
-                for (int i = 0; i < flow_x0.h; i++)
-                {
-                    float* x0 = flow_x0.row(i);
-                    float* x1 = flow_x1.row(i) + flow_x0.w - 1;
-                    float* x2 = flow_x2.row(flow_x0.h - 1 - i) + flow_x0.w - 1;
-                    float* x3 = flow_x3.row(flow_x0.h - 1 - i);
-
-                    float* y0 = flow_y0.row(i);
-                    float* y1 = flow_y1.row(i) + flow_x0.w - 1;
-                    float* y2 = flow_y2.row(flow_x0.h - 1 - i) + flow_x0.w - 1;
-                    float* y3 = flow_y3.row(flow_x0.h - 1 - i);
-
-                    float* z0 = flow_z0.row(i);
-                    float* z1 = flow_z1.row(i) + flow_x0.w - 1;
-                    float* z2 = flow_z2.row(flow_x0.h - 1 - i) + flow_x0.w - 1;
-                    float* z3 = flow_z3.row(flow_x0.h - 1 - i);
-
-                    float* w0 = flow_w0.row(i);
-                    float* w1 = flow_w1.row(i) + flow_x0.w - 1;
-                    float* w2 = flow_w2.row(flow_x0.h - 1 - i) + flow_x0.w - 1;
-                    float* w3 = flow_w3.row(flow_x0.h - 1 - i);
-
-                    for (int j = 0; j < flow_x0.w; j++)
-                    {
-                        float* x4 = flow_x4.row(j) + i;
-                        float* x5 = flow_x5.row(j) + flow_x0.h - 1 - i;
-                        float* x6 = flow_x6.row(flow_x0.w - 1 - j) + flow_x0.h - 1 - i;
-                        float* x7 = flow_x7.row(flow_x0.w - 1 - j) + i;
-
-                        float* y4 = flow_y4.row(j) + i;
-                        float* y5 = flow_y5.row(j) + flow_x0.h - 1 - i;
-                        float* y6 = flow_y6.row(flow_x0.w - 1 - j) + flow_x0.h - 1 - i;
-                        float* y7 = flow_y7.row(flow_x0.w - 1 - j) + i;
-
-                        float* z4 = flow_z4.row(j) + i;
-                        float* z5 = flow_z5.row(j) + flow_x0.h - 1 - i;
-                        float* z6 = flow_z6.row(flow_x0.w - 1 - j) + flow_x0.h - 1 - i;
-                        float* z7 = flow_z7.row(flow_x0.w - 1 - j) + i;
-
-                        float* w4 = flow_w4.row(j) + i;
-                        float* w5 = flow_w5.row(j) + flow_x0.h - 1 - i;
-                        float* w6 = flow_w6.row(flow_x0.w - 1 - j) + flow_x0.h - 1 - i;
-                        float* w7 = flow_w7.row(flow_x0.w - 1 - j) + i;
-
-                        float x = (*x0 + -*x1 + -*x2 + *x3 + *y4 + *y5 + -*y6 + -*y7) * 0.125f;
-                        float y = (*y0 + *y1 + -*y2 + -*y3 + *x4 + -*x5 + -*x6 + *x7) * 0.125f;
-                        float z = (*z0 + -*z1 + -*z2 + *z3 + *w4 + *w5 + -*w6 + -*w7) * 0.125f;
-                        float w = (*w0 + *w1 + -*w2 + -*w3 + *z4 + -*z5 + -*z6 + *z7) * 0.125f;
-
-                        *x0++ = x;
-                        *x1-- = -x;
-                        *x2-- = -x;
-                        *x3++ = x;
-                        *x4 = y;
-                        *x5 = -y;
-                        *x6 = -y;
-                        *x7 = y;
-
-                        *y0++ = y;
-                        *y1-- = y;
-                        *y2-- = -y;
-                        *y3++ = -y;
-                        *y4 = x;
-                        *y5 = x;
-                        *y6 = -x;
-                        *y7 = -x;
-
-                        *z0++ = z;
-                        *z1-- = -z;
-                        *z2-- = -z;
-                        *z3++ = z;
-                        *z4 = w;
-                        *z5 = -w;
-                        *z6 = -w;
-                        *z7 = w;
-
-                        *w0++ = w;
-                        *w1-- = w;
-                        *w2-- = -w;
-                        *w3++ = -w;
-                        *w4 = z;
-                        *w5 = z;
-                        *w6 = -z;
-                        *w7 = -z;
-                    }
-                }
-            }
-            else
-            {
-                for (int i = 0; i < flow_x0.h; i++)
-                {
-                    float* x0 = flow_x0.row(i);
-                    float* x1 = flow_x1.row(i) + flow_x0.w - 1;
-                    float* x2 = flow_x2.row(flow_x0.h - 1 - i) + flow_x0.w - 1;
-                    float* x3 = flow_x3.row(flow_x0.h - 1 - i);
-
-                    float* y0 = flow_y0.row(i);
-                    float* y1 = flow_y1.row(i) + flow_x0.w - 1;
-                    float* y2 = flow_y2.row(flow_x0.h - 1 - i) + flow_x0.w - 1;
-                    float* y3 = flow_y3.row(flow_x0.h - 1 - i);
+            std::vector<ncnn::Mat> out_padded(tcount);
+            std::vector<ncnn::Mat> out_padded_reversed(tcount);
 
-                    for (int j = 0; j < flow_x0.w; j++)
-                    {
-                        float* x4 = flow_x4.row(j) + i;
-                        float* x5 = flow_x5.row(j) + flow_x0.h - 1 - i;
-                        float* x6 = flow_x6.row(flow_x0.w - 1 - j) + flow_x0.h - 1 - i;
-                        float* x7 = flow_x7.row(flow_x0.w - 1 - j) + i;
-
-                        float* y4 = flow_y4.row(j) + i;
-                        float* y5 = flow_y5.row(j) + flow_x0.h - 1 - i;
-                        float* y6 = flow_y6.row(flow_x0.w - 1 - j) + flow_x0.h - 1 - i;
-                        float* y7 = flow_y7.row(flow_x0.w - 1 - j) + i;
-
-                        float x = (*x0 + -*x1 + -*x2 + *x3 + *y4 + *y5 + -*y6 + -*y7) * 0.125f;
-                        float y = (*y0 + *y1 + -*y2 + -*y3 + *x4 + -*x5 + -*x6 + *x7) * 0.125f;
-
-                        *x0++ = x;
-                        *x1-- = -x;
-                        *x2-- = -x;
-                        *x3++ = x;
-                        *x4 = y;
-                        *x5 = -y;
-                        *x6 = -y;
-                        *x7 = y;
-
-                        *y0++ = y;
-                        *y1-- = y;
-                        *y2-- = -y;
-                        *y3++ = -y;
-                        *y4 = x;
-                        *y5 = x;
-                        *y6 = -x;
-                        *y7 = -x;
-                    }
-                }
-            }
-        }
-
-        if (tta_temporal_mode)
-        {
-            ncnn::Mat flow_x0 = flow_reversed[0].channel(0);
-            ncnn::Mat flow_x1 = flow_reversed[1].channel(0);
-            ncnn::Mat flow_x2 = flow_reversed[2].channel(0);
-            ncnn::Mat flow_x3 = flow_reversed[3].channel(0);
-            ncnn::Mat flow_x4 = flow_reversed[4].channel(0);
-            ncnn::Mat flow_x5 = flow_reversed[5].channel(0);
-            ncnn::Mat flow_x6 = flow_reversed[6].channel(0);
-            ncnn::Mat flow_x7 = flow_reversed[7].channel(0);
-
-            ncnn::Mat flow_y0 = flow_reversed[0].channel(1);
-            ncnn::Mat flow_y1 = flow_reversed[1].channel(1);
-            ncnn::Mat flow_y2 = flow_reversed[2].channel(1);
-            ncnn::Mat flow_y3 = flow_reversed[3].channel(1);
-            ncnn::Mat flow_y4 = flow_reversed[4].channel(1);
-            ncnn::Mat flow_y5 = flow_reversed[5].channel(1);
-            ncnn::Mat flow_y6 = flow_reversed[6].channel(1);
-            ncnn::Mat flow_y7 = flow_reversed[7].channel(1);
-
-            if (rife_v2)
-            {
-                ncnn::Mat flow_z0 = flow_reversed[0].channel(2);
-                ncnn::Mat flow_z1 = flow_reversed[1].channel(2);
-                ncnn::Mat flow_z2 = flow_reversed[2].channel(2);
-                ncnn::Mat flow_z3 = flow_reversed[3].channel(2);
-                ncnn::Mat flow_z4 = flow_reversed[4].channel(2);
-                ncnn::Mat flow_z5 = flow_reversed[5].channel(2);
-                ncnn::Mat flow_z6 = flow_reversed[6].channel(2);
-                ncnn::Mat flow_z7 = flow_reversed[7].channel(2);
-
-                ncnn::Mat flow_w0 = flow_reversed[0].channel(3);
-                ncnn::Mat flow_w1 = flow_reversed[1].channel(3);
-                ncnn::Mat flow_w2 = flow_reversed[2].channel(3);
-                ncnn::Mat flow_w3 = flow_reversed[3].channel(3);
-                ncnn::Mat flow_w4 = flow_reversed[4].channel(3);
-                ncnn::Mat flow_w5 = flow_reversed[5].channel(3);
-                ncnn::Mat flow_w6 = flow_reversed[6].channel(3);
-                ncnn::Mat flow_w7 = flow_reversed[7].channel(3);
-
-                for (int i = 0; i < flow_x0.h; i++)
-                {
-                    float* x0 = flow_x0.row(i);
-                    float* x1 = flow_x1.row(i) + flow_x0.w - 1;
-                    float* x2 = flow_x2.row(flow_x0.h - 1 - i) + flow_x0.w - 1;
-                    float* x3 = flow_x3.row(flow_x0.h - 1 - i);
-
-                    float* y0 = flow_y0.row(i);
-                    float* y1 = flow_y1.row(i) + flow_x0.w - 1;
-                    float* y2 = flow_y2.row(flow_x0.h - 1 - i) + flow_x0.w - 1;
-                    float* y3 = flow_y3.row(flow_x0.h - 1 - i);
-
-                    float* z0 = flow_z0.row(i);
-                    float* z1 = flow_z1.row(i) + flow_x0.w - 1;
-                    float* z2 = flow_z2.row(flow_x0.h - 1 - i) + flow_x0.w - 1;
-                    float* z3 = flow_z3.row(flow_x0.h - 1 - i);
-
-                    float* w0 = flow_w0.row(i);
-                    float* w1 = flow_w1.row(i) + flow_x0.w - 1;
-                    float* w2 = flow_w2.row(flow_x0.h - 1 - i) + flow_x0.w - 1;
-                    float* w3 = flow_w3.row(flow_x0.h - 1 - i);
-
-                    for (int j = 0; j < flow_x0.w; j++)
-                    {
-                        float* x4 = flow_x4.row(j) + i;
-                        float* x5 = flow_x5.row(j) + flow_x0.h - 1 - i;
-                        float* x6 = flow_x6.row(flow_x0.w - 1 - j) + flow_x0.h - 1 - i;
-                        float* x7 = flow_x7.row(flow_x0.w - 1 - j) + i;
-
-                        float* y4 = flow_y4.row(j) + i;
-                        float* y5 = flow_y5.row(j) + flow_x0.h - 1 - i;
-                        float* y6 = flow_y6.row(flow_x0.w - 1 - j) + flow_x0.h - 1 - i;
-                        float* y7 = flow_y7.row(flow_x0.w - 1 - j) + i;
-
-                        float* z4 = flow_z4.row(j) + i;
-                        float* z5 = flow_z5.row(j) + flow_x0.h - 1 - i;
-                        float* z6 = flow_z6.row(flow_x0.w - 1 - j) + flow_x0.h - 1 - i;
-                        float* z7 = flow_z7.row(flow_x0.w - 1 - j) + i;
-
-                        float* w4 = flow_w4.row(j) + i;
-                        float* w5 = flow_w5.row(j) + flow_x0.h - 1 - i;
-                        float* w6 = flow_w6.row(flow_x0.w - 1 - j) + flow_x0.h - 1 - i;
-                        float* w7 = flow_w7.row(flow_x0.w - 1 - j) + i;
-
-                        float x = (*x0 + -*x1 + -*x2 + *x3 + *y4 + *y5 + -*y6 + -*y7) * 0.125f;
-                        float y = (*y0 + *y1 + -*y2 + -*y3 + *x4 + -*x5 + -*x6 + *x7) * 0.125f;
-                        float z = (*z0 + -*z1 + -*z2 + *z3 + *w4 + *w5 + -*w6 + -*w7) * 0.125f;
-                        float w = (*w0 + *w1 + -*w2 + -*w3 + *z4 + -*z5 + -*z6 + *z7) * 0.125f;
-
-                        *x0++ = x;
-                        *x1-- = -x;
-                        *x2-- = -x;
-                        *x3++ = x;
-                        *x4 = y;
-                        *x5 = -y;
-                        *x6 = -y;
-                        *x7 = y;
-
-                        *y0++ = y;
-                        *y1-- = y;
-                        *y2-- = -y;
-                        *y3++ = -y;
-                        *y4 = x;
-                        *y5 = x;
-                        *y6 = -x;
-                        *y7 = -x;
-
-                        *z0++ = z;
-                        *z1-- = -z;
-                        *z2-- = -z;
-                        *z3++ = z;
-                        *z4 = w;
-                        *z5 = -w;
-                        *z6 = -w;
-                        *z7 = w;
-
-                        *w0++ = w;
-                        *w1-- = w;
-                        *w2-- = -w;
-                        *w3++ = -w;
-                        *w4 = z;
-                        *w5 = z;
-                        *w6 = -z;
-                        *w7 = -z;
-                    }
-                }
-            }
-            else
+            #pragma omp parallel for num_threads(tcount)
+            for (int k = 0; k < tcount; k++)
             {
-                for (int i = 0; i < flow_x0.h; i++)
+                const int ti = tb + k;
+
+                // preproc and border padding
+                ncnn::Mat in0_padded;
+                ncnn::Mat in1_padded;
+                preproc_cpu_direction(pixel0data, w, h, w_padded, h_padded, ti, in0_padded, opt.num_threads);
+                preproc_cpu_direction(pixel1data, w, h, w_padded, h_padded, ti, in1_padded, opt.num_threads);
+
+                ncnn::Mat flow;
+                ncnn::Mat flow_reversed;
+                tta_flow_transform(flow_avg, ti, flow, opt.num_threads);
+                if (tta_temporal_mode)
                 {
-                    float* x0 = flow_x0.row(i);
-                    float* x1 = flow_x1.row(i) + flow_x0.w - 1;
-                    float* x2 = flow_x2.row(flow_x0.h - 1 - i) + flow_x0.w - 1;
-                    float* x3 = flow_x3.row(flow_x0.h - 1 - i);
-
-                    float* y0 = flow_y0.row(i);
-                    float* y1 = flow_y1.row(i) + flow_x0.w - 1;
-                    float* y2 = flow_y2.row(flow_x0.h - 1 - i) + flow_x0.w - 1;
-                    float* y3 = flow_y3.row(flow_x0.h - 1 - i);
-
-                    for (int j = 0; j < flow_x0.w; j++)
-                    {
-                        float* x4 = flow_x4.row(j) + i;
-                        float* x5 = flow_x5.row(j) + flow_x0.h - 1 - i;
-                        float* x6 = flow_x6.row(flow_x0.w - 1 - j) + flow_x0.h - 1 - i;
-                        float* x7 = flow_x7.row(flow_x0.w - 1 - j) + i;
-
-                        float* y4 = flow_y4.row(j) + i;
-                        float* y5 = flow_y5.row(j) + flow_x0.h - 1 - i;
-                        float* y6 = flow_y6.row(flow_x0.w - 1 - j) + flow_x0.h - 1 - i;
-                        float* y7 = flow_y7.row(flow_x0.w - 1 - j) + i;
-
-                        float x = (*x0 + -*x1 + -*x2 + *x3 + *y4 + *y5 + -*y6 + -*y7) * 0.125f;
-                        float y = (*y0 + *y1 + -*y2 + -*y3 + *x4 + -*x5 + -*x6 + *x7) * 0.125f;
-
-                        *x0++ = x;
-                        *x1-- = -x;
-                        *x2-- = -x;
-                        *x3++ = x;
-                        *x4 = y;
-                        *x5 = -y;
-                        *x6 = -y;
-                        *x7 = y;
-
-                        *y0++ = y;
-                        *y1-- = y;
-                        *y2-- = -y;
-                        *y3++ = -y;
-                        *y4 = x;
-                        *y5 = x;
-                        *y6 = -x;
-                        *y7 = -x;
-                    }
+                    tta_flow_transform(flow_reversed_avg, ti, flow_reversed, opt.num_threads);
                 }
-            }
-
-            // merge flow and flow_reversed
-            for (int ti = 0; ti < 8; ti++)
-            {
-                float* flow_x = flow[ti].channel(0);
-                float* flow_y = flow[ti].channel(1);
-                float* flow_reversed_x = flow_reversed[ti].channel(0);
-                float* flow_reversed_y = flow_reversed[ti].channel(1);
 
+                ncnn::Mat flow0;
+                ncnn::Mat flow1;
                 if (rife_v2)
                 {
-                    float* flow_z = flow[ti].channel(2);
-                    float* flow_w = flow[ti].channel(3);
-                    float* flow_reversed_z = flow_reversed[ti].channel(2);
-                    float* flow_reversed_w = flow_reversed[ti].channel(3);
-
-                    for (int i = 0; i < flow[ti].h; i++)
-                    {
-                        for (int j = 0; j < flow[ti].w; j++)
-                        {
-                            float x = (*flow_x + *flow_reversed_z) * 0.5f;
-                            float y = (*flow_y + *flow_reversed_w) * 0.5f;
-                            float z = (*flow_z + *flow_reversed_x) * 0.5f;
-                            float w = (*flow_w + *flow_reversed_y) * 0.5f;
-
-                            *flow_x++ = x;
-                            *flow_y++ = y;
-                            *flow_z++ = z;
-                            *flow_w++ = w;
-                            *flow_reversed_x++ = z;
-                            *flow_reversed_y++ = w;
-                            *flow_reversed_z++ = x;
-                            *flow_reversed_w++ = y;
-                        }
-                    }
+                    std::vector<ncnn::Mat> inputs(1);
+                    inputs[0] = flow;
+                    std::vector<ncnn::Mat> outputs(2);
+                    rife_v2_slice_flow->forward(inputs, outputs, opt);
+                    flow0 = outputs[0];
+                    flow1 = outputs[1];
                 }
-                else
-                {
-                    for (int i = 0; i < flow[ti].h; i++)
-                    {
-                        for (int j = 0; j < flow[ti].w; j++)
-                        {
-                            float x = (*flow_x - *flow_reversed_x) * 0.5f;
-                            float y = (*flow_y - *flow_reversed_y) * 0.5f;
-
-                            *flow_x++ = x;
-                            *flow_y++ = y;
-                            *flow_reversed_x++ = -x;
-                            *flow_reversed_y++ = -y;
-                        }
-                    }
-                }
-            }
-        }
-
-        if (rife_v2)
-        {
-            for (int ti = 0; ti < 8; ti++)
-            {
-                std::vector<ncnn::Mat> inputs(1);
-                inputs[0] = flow[ti];
-                std::vector<ncnn::Mat> outputs(2);
-                rife_v2_slice_flow->forward(inputs, outputs, opt);
-                flow0[ti] = outputs[0];
-                flow1[ti] = outputs[1];
-            }
-        }
-
-        ncnn::Mat out_padded[8];
-        ncnn::Mat out_padded_reversed[8];
-        for (int ti = 0; ti < 8; ti++)
-        {
-            // contextnet
-            ncnn::Mat ctx0[4];
-            ncnn::Mat ctx1[4];
-            {
-                ncnn::Extractor ex = contextnet.create_extractor();
 
-                ex.input("input.1", in0_padded[ti]);
-                if (rife_v2)
+                // contextnet
+                ncnn::Mat feat0[4];
+                ncnn::Mat feat1[4];
+                if (!find_context_features(in0id, ti, feat0))
                 {
-                    ex.input("flow.0", flow0[ti]);
+                    extract_context_features(in0_padded, feat0);
+                    cache_context_features(in0id, ti, feat0);
                 }
-                else
+                if (!find_context_features(in1id, ti, feat1))
                 {
-                    ex.input("flow.0", flow[ti]);
+                    extract_context_features(in1_padded, feat1);
+                    cache_context_features(in1id, ti, feat1);
                 }
-                ex.extract("f1", ctx0[0]);
-                ex.extract("f2", ctx0[1]);
-                ex.extract("f3", ctx0[2]);
-                ex.extract("f4", ctx0[3]);
-            }
-            {
-                ncnn::Extractor ex = contextnet.create_extractor();
 
-                ex.input("input.1", in1_padded[ti]);
+                ncnn::Mat ctx0[4];
+                ncnn::Mat ctx1[4];
                 if (rife_v2)
                 {
-                    ex.input("flow.0", flow1[ti]);
+                    warp_context_features(feat0, "flow.0", flow0, ctx0);
+                    warp_context_features(feat1, "flow.0", flow1, ctx1);
                 }
                 else
                 {
-                    ex.input("flow.1", flow[ti]);
+                    warp_context_features(feat0, "flow.0", flow, ctx0);
+                    warp_context_features(feat1, "flow.1", flow, ctx1);
                 }
-                ex.extract("f1", ctx1[0]);
-                ex.extract("f2", ctx1[1]);
-                ex.extract("f3", ctx1[2]);
-                ex.extract("f4", ctx1[3]);
-            }
 
-            // fusionnet
-            {
-                ncnn::Extractor ex = fusionnet.create_extractor();
-
-                ex.input("img0", in0_padded[ti]);
-                ex.input("img1", in1_padded[ti]);
-                ex.input("flow", flow[ti]);
-                ex.input("3", ctx0[0]);
-                ex.input("4", ctx0[1]);
-                ex.input("5", ctx0[2]);
-                ex.input("6", ctx0[3]);
-                ex.input("7", ctx1[0]);
-                ex.input("8", ctx1[1]);
-                ex.input("9", ctx1[2]);
-                ex.input("10", ctx1[3]);
+                // fusionnet
+                {
+                    ncnn::Extractor ex = fusionnet.create_extractor();
 
-                ex.extract("output", out_padded[ti]);
-            }
+                    ex.input("img0", in0_padded);
+                    ex.input("img1", in1_padded);
+                    ex.input("flow", flow);
+                    ex.input("3", ctx0[0]);
+                    ex.input("4", ctx0[1]);
+                    ex.input("5", ctx0[2]);
+                    ex.input("6", ctx0[3]);
+                    ex.input("7", ctx1[0]);
+                    ex.input("8", ctx1[1]);
+                    ex.input("9", ctx1[2]);
+                    ex.input("10", ctx1[3]);
+
+                    ex.extract("output", out_padded[k]);
+                }
 
-            if (tta_temporal_mode)
-            {
-                // fusionnet
+                if (tta_temporal_mode)
                 {
+                    // fusionnet
                     ncnn::Extractor ex = fusionnet.create_extractor();
 
-                    ex.input("img0", in1_padded[ti]);
-                    ex.input("img1", in0_padded[ti]);
-                    ex.input("flow", flow_reversed[ti]);
+                    ex.input("img0", in1_padded);
+                    ex.input("img1", in0_padded);
+                    ex.input("flow", flow_reversed);
                     ex.input("3", ctx1[0]);
                     ex.input("4", ctx1[1]);
                     ex.input("5", ctx1[2]);
@@ -2041,97 +2121,41 @@ int RIFE::process_cpu(const ncnn::Mat& in0image, const ncnn::Mat& in1image, floa
                     ex.input("9", ctx0[2]);
                     ex.input("10", ctx0[3]);
 
-                    ex.extract("output", out_padded_reversed[ti]);
+                    ex.extract("output", out_padded_reversed[k]);
                 }
             }
-        }
 
-        // cut padding and postproc
-        out.create(w, h, 3);
-        if (tta_temporal_mode)
-        {
-            for (int q = 0; q < 3; q++)
+            for (int k = 0; k < tcount; k++)
             {
-                const ncnn::Mat out_padded_0 = out_padded[0].channel(q);
-                const ncnn::Mat out_padded_1 = out_padded[1].channel(q);
-                const ncnn::Mat out_padded_2 = out_padded[2].channel(q);
-                const ncnn::Mat out_padded_3 = out_padded[3].channel(q);
-                const ncnn::Mat out_padded_4 = out_padded[4].channel(q);
-                const ncnn::Mat out_padded_5 = out_padded[5].channel(q);
-                const ncnn::Mat out_padded_6 = out_padded[6].channel(q);
-                const ncnn::Mat out_padded_7 = out_padded[7].channel(q);
-                const ncnn::Mat out_padded_reversed_0 = out_padded_reversed[0].channel(q);
-                const ncnn::Mat out_padded_reversed_1 = out_padded_reversed[1].channel(q);
-                const ncnn::Mat out_padded_reversed_2 = out_padded_reversed[2].channel(q);
-                const ncnn::Mat out_padded_reversed_3 = out_padded_reversed[3].channel(q);
-                const ncnn::Mat out_padded_reversed_4 = out_padded_reversed[4].channel(q);
-                const ncnn::Mat out_padded_reversed_5 = out_padded_reversed[5].channel(q);
-                const ncnn::Mat out_padded_reversed_6 = out_padded_reversed[6].channel(q);
-                const ncnn::Mat out_padded_reversed_7 = out_padded_reversed[7].channel(q);
-                float* outptr = out.channel(q);
+                tta_out_accumulate(out_padded[k], tb + k, w_padded, h_padded, out_sum, opt.num_threads);
 
-                for (int i = 0; i < h; i++)
+                if (tta_temporal_mode)
                 {
-                    const float* ptr0 = out_padded_0.row(i);
-                    const float* ptr1 = out_padded_1.row(i) + w_padded - 1;
-                    const float* ptr2 = out_padded_2.row(h_padded - 1 - i) + w_padded - 1;
-                    const float* ptr3 = out_padded_3.row(h_padded - 1 - i);
-                    const float* ptrr0 = out_padded_reversed_0.row(i);
-                    const float* ptrr1 = out_padded_reversed_1.row(i) + w_padded - 1;
-                    const float* ptrr2 = out_padded_reversed_2.row(h_padded - 1 - i) + w_padded - 1;
-                    const float* ptrr3 = out_padded_reversed_3.row(h_padded - 1 - i);
-
-                    for (int j = 0; j < w; j++)
-                    {
-                        const float* ptr4 = out_padded_4.row(j) + i;
-                        const float* ptr5 = out_padded_5.row(j) + h_padded - 1 - i;
-                        const float* ptr6 = out_padded_6.row(w_padded - 1 - j) + h_padded - 1 - i;
-                        const float* ptr7 = out_padded_7.row(w_padded - 1 - j) + i;
-                        const float* ptrr4 = out_padded_reversed_4.row(j) + i;
-                        const float* ptrr5 = out_padded_reversed_5.row(j) + h_padded - 1 - i;
-                        const float* ptrr6 = out_padded_reversed_6.row(w_padded - 1 - j) + h_padded - 1 - i;
-                        const float* ptrr7 = out_padded_reversed_7.row(w_padded - 1 - j) + i;
-
-                        float v = (*ptr0++ + *ptr1-- + *ptr2-- + *ptr3++ + *ptr4 + *ptr5 + *ptr6 + *ptr7) / 8;
-                        float vr = (*ptrr0++ + *ptrr1-- + *ptrr2-- + *ptrr3++ + *ptrr4 + *ptrr5 + *ptrr6 + *ptrr7) / 8;
-
-                        *outptr++ = (v + vr) * 0.5f * 255.f + 0.5f;
-                    }
+                    tta_out_accumulate(out_padded_reversed[k], tb + k, w_padded, h_padded, out_reversed_sum, opt.num_threads);
                 }
             }
         }
-        else
+
+        // postproc
+        out.create(w, h, 3);
         {
-            for (int q = 0; q < 3; q++)
+            const float* ptr = out_sum;
+            const float* ptrr = out_reversed_sum;
+            float* outptr = out;
+
+            for (size_t i = 0; i < out.total(); i++)
             {
-                const ncnn::Mat out_padded_0 = out_padded[0].channel(q);
-                const ncnn::Mat out_padded_1 = out_padded[1].channel(q);
-                const ncnn::Mat out_padded_2 = out_padded[2].channel(q);
-                const ncnn::Mat out_padded_3 = out_padded[3].channel(q);
-                const ncnn::Mat out_padded_4 = out_padded[4].channel(q);
-                const ncnn::Mat out_padded_5 = out_padded[5].channel(q);
-                const ncnn::Mat out_padded_6 = out_padded[6].channel(q);
-                const ncnn::Mat out_padded_7 = out_padded[7].channel(q);
-                float* outptr = out.channel(q);
+                float v = ptr[i] / 8;
 
-                for (int i = 0; i < h; i++)
+                if (tta_temporal_mode)
                 {
-                    const float* ptr0 = out_padded_0.row(i);
-                    const float* ptr1 = out_padded_1.row(i) + w_padded - 1;
-                    const float* ptr2 = out_padded_2.row(h_padded - 1 - i) + w_padded - 1;
-                    const float* ptr3 = out_padded_3.row(h_padded - 1 - i);
-
-                    for (int j = 0; j < w; j++)
-                    {
-                        const float* ptr4 = out_padded_4.row(j) + i;
-                        const float* ptr5 = out_padded_5.row(j) + h_padded - 1 - i;
-                        const float* ptr6 = out_padded_6.row(w_padded - 1 - j) + h_padded - 1 - i;
-                        const float* ptr7 = out_padded_7.row(w_padded - 1 - j) + i;
-
-                        float v = (*ptr0++ + *ptr1-- + *ptr2-- + *ptr3++ + *ptr4 + *ptr5 + *ptr6 + *ptr7) / 8;
+                    float vr = ptrr[i] / 8;
 
-                        *outptr++ = v * 255.f + 0.5f;
-                    }
+                    outptr[i] = (v + vr) * 0.5f * 255.f + 0.5f;
+                }
+                else
+                {
+                    outptr[i] = v * 255.f + 0.5f;
                 }
             }
         }
@@ -2141,66 +2165,8 @@ int RIFE::process_cpu(const ncnn::Mat& in0image, const ncnn::Mat& in1image, floa
         // preproc and border padding
         ncnn::Mat in0_padded;
         ncnn::Mat in1_padded;
-        {
-            in0_padded.create(w_padded, h_padded, 3);
-            for (int q = 0; q < 3; q++)
-            {
-                float* outptr = in0_padded.channel(q);
-
-                int i = 0;
-                for (; i < h; i++)
-                {
-                    const float* ptr = in0.channel(q).row(i);
-
-                    int j = 0;
-                    for (; j < w; j++)
-                    {
-                        *outptr++ = *ptr++ * (1 / 255.f);
-                    }
-                    for (; j < w_padded; j++)
-                    {
-                        *outptr++ = 0.f;
-                    }
-                }
-                for (; i < h_padded; i++)
-                {
-                    for (int j = 0; j < w_padded; j++)
-                    {
-                        *outptr++ = 0.f;
-                    }
-                }
-            }
-        }
-        {
-            in1_padded.create(w_padded, h_padded, 3);
-            for (int q = 0; q < 3; q++)
-            {
-                float* outptr = in1_padded.channel(q);
-
-                int i = 0;
-                for (; i < h; i++)
-                {
-                    const float* ptr = in1.channel(q).row(i);
-
-                    int j = 0;
-                    for (; j < w; j++)
-                    {
-                        *outptr++ = *ptr++ * (1 / 255.f);
-                    }
-                    for (; j < w_padded; j++)
-                    {
-                        *outptr++ = 0.f;
-                    }
-                }
-                for (; i < h_padded; i++)
-                {
-                    for (int j = 0; j < w_padded; j++)
-                    {
-                        *outptr++ = 0.f;
-                    }
-                }
-            }
-        }
+        preproc_cpu(pixel0data, w, h, w_padded, h_padded, &in0_padded, 1, opt.num_threads);
+        preproc_cpu(pixel1data, w, h, w_padded, h_padded, &in1_padded, 1, opt.num_threads);
 
         // flownet
         ncnn::Mat flow;
@@ -2330,41 +2296,30 @@ int RIFE::process_cpu(const ncnn::Mat& in0image, const ncnn::Mat& in1image, floa
         }
 
         // contextnet
+        ncnn::Mat feat0[4];
+        ncnn::Mat feat1[4];
+        if (!find_context_features(in0id, 0, feat0))
+        {
+            extract_context_features(in0_padded, feat0);
+            cache_context_features(in0id, 0, feat0);
+        }
+        if (!find_context_features(in1id, 0, feat1))
+        {
+            extract_context_features(in1_padded, feat1);
+            cache_context_features(in1id, 0, feat1);
+        }
+
         ncnn::Mat ctx0[4];
         ncnn::Mat ctx1[4];
+        if (rife_v2)
         {
-            ncnn::Extractor ex = contextnet.create_extractor();
-
-            ex.input("input.1", in0_padded);
-            if (rife_v2)
-            {
-                ex.input("flow.0", flow0);
-            }
-            else
-            {
-                ex.input("flow.0", flow);
-            }
-            ex.extract("f1", ctx0[0]);
-            ex.extract("f2", ctx0[1]);
-            ex.extract("f3", ctx0[2]);
-            ex.extract("f4", ctx0[3]);
+            warp_context_features(feat0, "flow.0", flow0, ctx0);
+            warp_context_features(feat1, "flow.0", flow1, ctx1);
         }
+        else
         {
-            ncnn::Extractor ex = contextnet.create_extractor();
-
-            ex.input("input.1", in1_padded);
-            if (rife_v2)
-            {
-                ex.input("flow.0", flow1);
-            }
-            else
-            {
-                ex.input("flow.1", flow);
-            }
-            ex.extract("f1", ctx1[0]);
-            ex.extract("f2", ctx1[1]);
-            ex.extract("f3", ctx1[2]);
-            ex.extract("f4", ctx1[3]);
+            warp_context_features(feat0, "flow.0", flow, ctx0);
+            warp_context_features(feat1, "flow.1", flow, ctx1);
         }
 
         // fusionnet
@@ -2461,26 +2416,79 @@ int RIFE::process_cpu(const ncnn::Mat& in0image, const ncnn::Mat& in1image, floa
 
 int RIFE::process_v4(const ncnn::Mat& in0image, const ncnn::Mat& in1image, float timestep, ncnn::Mat& outimage) const
 {
-    if (!vkdev)
+    std::vector<float> timesteps(1, timestep);
+    std::vector<ncnn::Mat> outimages(1, outimage);
+
+    int ret = process_v4_multi(in0image, in1image, timesteps, outimages);
+
+    outimage = outimages[0];
+
+    return ret;
+}
+
+int RIFE::process_v4_multi(const ncnn::Mat& in0image, const ncnn::Mat& in1image, const std::vector<float>& timesteps, std::vector<ncnn::Mat>& outimages, const ncnn::VkMat& in0_gpu_uploaded, const ncnn::VkMat& in1_gpu_uploaded) const
+{
+    if (tiled(in0image.w, in0image.h))
     {
-        // cpu only
-        return process_cpu(in0image, in1image, timestep, outimage);
+        std::vector<float> tiled_timesteps;
+        std::vector<ncnn::Mat> tiled_outimages;
+        for (size_t k = 0; k < timesteps.size(); k++)
+        {
+            if (timesteps[k] == 0.f)
+            {
+                copy_input_frame(in0image, outimages[k]);
+            }
+            else if (timesteps[k] == 1.f)
+            {
+                copy_input_frame(in1image, outimages[k]);
+            }
+            else
+            {
+                tiled_timesteps.push_back(timesteps[k]);
+                tiled_outimages.push_back(outimages[k]);
+            }
+        }
+
+        if (tiled_timesteps.empty())
+            return 0;
+
+        return process_tiled(in0image, in1image, tiled_timesteps, tiled_outimages);
     }
 
-    if (timestep == 0.f)
+    if (!vkdev)
     {
-        outimage = in0image;
+        // cpu only
+        for (size_t k = 0; k < timesteps.size(); k++)
+        {
+            int ret = process_v4_cpu(in0image, in1image, timesteps[k], outimages[k]);
+            if (ret != 0)
+                return ret;
+        }
+
         return 0;
     }
 
-    if (timestep == 1.f)
+    // timesteps that actually need inference, the others are plain copies of the inputs
+    std::vector<int> todo;
+    for (size_t k = 0; k < timesteps.size(); k++)
     {
-        outimage = in1image;
-        return 0;
+        if (timesteps[k] == 0.f)
+        {
+            outimages[k] = in0image;
+        }
+        else if (timesteps[k] == 1.f)
+        {
+            outimages[k] = in1image;
+        }
+        else
+        {
+            todo.push_back((int)k);
+        }
     }
 
-    const unsigned char* pixel0data = (const unsigned char*)in0image.data;
-    const unsigned char* pixel1data = (const unsigned char*)in1image.data;
+    if (todo.empty())
+        return 0;
+
     const int w = in0image.w;
     const int h = in0image.h;
     const int channels = 3;//in0image.elempack;
@@ -2501,42 +2509,27 @@ int RIFE::process_v4(const ncnn::Mat& in0image, const ncnn::Mat& in1image, float
 
     const size_t in_out_tile_elemsize = opt.use_fp16_storage ? 2u : 4u;
 
-    ncnn::Mat in0;
-    ncnn::Mat in1;
-    if (opt.use_fp16_storage && opt.use_int8_storage)
-    {
-        in0 = ncnn::Mat(w, h, (unsigned char*)pixel0data, (size_t)channels, 1);
-        in1 = ncnn::Mat(w, h, (unsigned char*)pixel1data, (size_t)channels, 1);
-    }
-    else
-    {
-#if _WIN32
-        in0 = ncnn::Mat::from_pixels(pixel0data, ncnn::Mat::PIXEL_BGR2RGB, w, h);
-        in1 = ncnn::Mat::from_pixels(pixel1data, ncnn::Mat::PIXEL_BGR2RGB, w, h);
-#else
-        in0 = ncnn::Mat::from_pixels(pixel0data, ncnn::Mat::PIXEL_RGB, w, h);
-        in1 = ncnn::Mat::from_pixels(pixel1data, ncnn::Mat::PIXEL_RGB, w, h);
-#endif
-    }
-
     ncnn::VkCompute cmd(vkdev);
 
-    // upload
-    ncnn::VkMat in0_gpu;
-    ncnn::VkMat in1_gpu;
+    // upload, unless the caller has already done it ahead of time
+    // the mapped views must outlive the command, recorded copies refer to them
+    ncnn::VkBufferMemory in_views[2];
+    ncnn::VkMat in0_gpu = in0_gpu_uploaded;
+    ncnn::VkMat in1_gpu = in1_gpu_uploaded;
+    if (in0_gpu.empty() || in1_gpu.empty())
     {
-        cmd.record_clone(in0, in0_gpu, opt);
-        cmd.record_clone(in1, in1_gpu, opt);
+        record_upload(in0image, in1image, in0_gpu, in1_gpu, cmd, opt, in_views);
+        trace_submit(cmd, "upload");
     }
 
-    ncnn::VkMat out_gpu;
+    // all timesteps share the uploaded and preprocessed inputs and go into one submission
+    std::vector<ncnn::VkMat> out_gpu(todo.size());
 
     if (tta_mode)
     {
         // preproc
         ncnn::VkMat in0_gpu_padded[8];
         ncnn::VkMat in1_gpu_padded[8];
-        ncnn::VkMat timestep_gpu_padded[2];
         {
             in0_gpu_padded[0].create(w_padded, h_padded, 3, in_out_tile_elemsize, 1, blob_vkallocator);
             in0_gpu_padded[1].create(w_padded, h_padded, 3, in_out_tile_elemsize, 1, blob_vkallocator);
@@ -2599,52 +2592,179 @@ int RIFE::process_v4(const ncnn::Mat& in0image, const ncnn::Mat& in1image, float
 
             cmd.record_pipeline(rife_preproc, bindings, constants, in1_gpu_padded[0]);
         }
+
+        for (size_t k = 0; k < todo.size(); k++)
         {
-            timestep_gpu_padded[0].create(w_padded, h_padded, 1, in_out_tile_elemsize, 1, blob_vkallocator);
-            timestep_gpu_padded[1].create(h_padded, w_padded, 1, in_out_tile_elemsize, 1, blob_vkallocator);
+            const float timestep = timesteps[todo[k]];
+
+            ncnn::VkMat timestep_gpu_padded[2];
+            {
+                timestep_gpu_padded[0].create(w_padded, h_padded, 1, in_out_tile_elemsize, 1, blob_vkallocator);
+                timestep_gpu_padded[1].create(h_padded, w_padded, 1, in_out_tile_elemsize, 1, blob_vkallocator);
+
+                std::vector<ncnn::VkMat> bindings(2);
+                bindings[0] = timestep_gpu_padded[0];
+                bindings[1] = timestep_gpu_padded[1];
+
+                std::vector<ncnn::vk_constant_type> constants(4);
+                constants[0].i = timestep_gpu_padded[0].w;
+                constants[1].i = timestep_gpu_padded[0].h;
+                constants[2].i = timestep_gpu_padded[0].cstep;
+                constants[3].f = timestep;
+
+                cmd.record_pipeline(rife_v4_timestep, bindings, constants, timestep_gpu_padded[0]);
+            }
+
+            ncnn::VkMat out_gpu_padded[8];
+            if (tta_temporal_mode)
+            {
+                ncnn::VkMat timestep_gpu_padded_reversed[2];
+                {
+                    timestep_gpu_padded_reversed[0].create(w_padded, h_padded, 1, in_out_tile_elemsize, 1, blob_vkallocator);
+                    timestep_gpu_padded_reversed[1].create(h_padded, w_padded, 1, in_out_tile_elemsize, 1, blob_vkallocator);
+
+                    std::vector<ncnn::VkMat> bindings(2);
+                    bindings[0] = timestep_gpu_padded_reversed[0];
+                    bindings[1] = timestep_gpu_padded_reversed[1];
+
+                    std::vector<ncnn::vk_constant_type> constants(4);
+                    constants[0].i = timestep_gpu_padded_reversed[0].w;
+                    constants[1].i = timestep_gpu_padded_reversed[0].h;
+                    constants[2].i = timestep_gpu_padded_reversed[0].cstep;
+                    constants[3].f = 1.f - timestep;
+
+                    cmd.record_pipeline(rife_v4_timestep, bindings, constants, timestep_gpu_padded_reversed[0]);
+                }
+
+                ncnn::VkMat flow[4][8];
+                ncnn::VkMat flow_reversed[4][8];
+                for (int fi = 0; fi < 4; fi++)
+                {
+                    for (int ti = 0; ti < 8; ti++)
+                    {
+                        {
+                            // flownet flow mask
+                            ncnn::Extractor ex = flownet.create_extractor();
+                            ex.set_blob_vkallocator(blob_vkallocator);
+                            ex.set_workspace_vkallocator(blob_vkallocator);
+                            ex.set_staging_vkallocator(staging_vkallocator);
+
+                            ex.input("in0", in0_gpu_padded[ti]);
+                            ex.input("in1", in1_gpu_padded[ti]);
+                            ex.input("in2", timestep_gpu_padded[ti / 4]);
+
+                            // intentional fall through
+                            switch (fi)
+                            {
+                            case 3: ex.input("flow2", flow[2][ti]);
+                            case 2: ex.input("flow1", flow[1][ti]);
+                            case 1: ex.input("flow0", flow[0][ti]);
+                            default:
+                            {
+                                char tmp[16];
+                                sprintf(tmp, "flow%d", fi);
+                                ex.extract(tmp, flow[fi][ti], cmd);
+                            }
+                            }
+                        }
 
-            std::vector<ncnn::VkMat> bindings(2);
-            bindings[0] = timestep_gpu_padded[0];
-            bindings[1] = timestep_gpu_padded[1];
+                        {
+                            // flownet flow mask reversed
+                            ncnn::Extractor ex = flownet.create_extractor();
+                            ex.set_blob_vkallocator(blob_vkallocator);
+                            ex.set_workspace_vkallocator(blob_vkallocator);
+                            ex.set_staging_vkallocator(staging_vkallocator);
+
+                            ex.input("in0", in1_gpu_padded[ti]);
+                            ex.input("in1", in0_gpu_padded[ti]);
+                            ex.input("in2", timestep_gpu_padded_reversed[ti / 4]);
+
+                            // intentional fall through
+                            switch (fi)
+                            {
+                            case 3: ex.input("flow2", flow_reversed[2][ti]);
+                            case 2: ex.input("flow1", flow_reversed[1][ti]);
+                            case 1: ex.input("flow0", flow_reversed[0][ti]);
+                            default:
+                            {
+                                char tmp[16];
+                                sprintf(tmp, "flow%d", fi);
+                                ex.extract(tmp, flow_reversed[fi][ti], cmd);
+                            }
+                            }
+                        }
 
-            std::vector<ncnn::vk_constant_type> constants(4);
-            constants[0].i = timestep_gpu_padded[0].w;
-            constants[1].i = timestep_gpu_padded[0].h;
-            constants[2].i = timestep_gpu_padded[0].cstep;
-            constants[3].f = timestep;
+                        // merge flow and flow_reversed
+                        {
+                            std::vector<ncnn::VkMat> bindings(2);
+                            bindings[0] = flow[fi][ti];
+                            bindings[1] = flow_reversed[fi][ti];
+
+                            std::vector<ncnn::vk_constant_type> constants(3);
+                            constants[0].i = flow[fi][ti].w;
+                            constants[1].i = flow[fi][ti].h;
+                            constants[2].i = flow[fi][ti].cstep;
+
+                            ncnn::VkMat dispatcher;
+                            dispatcher.w = flow[fi][ti].w;
+                            dispatcher.h = flow[fi][ti].h;
+                            dispatcher.c = 1;
+                            cmd.record_pipeline(rife_flow_tta_temporal_avg, bindings, constants, dispatcher);
+                        }
+                    }
 
-            cmd.record_pipeline(rife_v4_timestep, bindings, constants, timestep_gpu_padded[0]);
-        }
+                    // avg flow mask
+                    {
+                        std::vector<ncnn::VkMat> bindings(8);
+                        bindings[0] = flow[fi][0];
+                        bindings[1] = flow[fi][1];
+                        bindings[2] = flow[fi][2];
+                        bindings[3] = flow[fi][3];
+                        bindings[4] = flow[fi][4];
+                        bindings[5] = flow[fi][5];
+                        bindings[6] = flow[fi][6];
+                        bindings[7] = flow[fi][7];
 
-        ncnn::VkMat out_gpu_padded[8];
-        if (tta_temporal_mode)
-        {
-            ncnn::VkMat timestep_gpu_padded_reversed[2];
-            {
-                timestep_gpu_padded_reversed[0].create(w_padded, h_padded, 1, in_out_tile_elemsize, 1, blob_vkallocator);
-                timestep_gpu_padded_reversed[1].create(h_padded, w_padded, 1, in_out_tile_elemsize, 1, blob_vkallocator);
+                        std::vector<ncnn::vk_constant_type> constants(3);
+                        constants[0].i = flow[fi][0].w;
+                        constants[1].i = flow[fi][0].h;
+                        constants[2].i = flow[fi][0].cstep;
 
-                std::vector<ncnn::VkMat> bindings(2);
-                bindings[0] = timestep_gpu_padded_reversed[0];
-                bindings[1] = timestep_gpu_padded_reversed[1];
+                        ncnn::VkMat dispatcher;
+                        dispatcher.w = flow[fi][0].w;
+                        dispatcher.h = flow[fi][0].h;
+                        dispatcher.c = 1;
+                        cmd.record_pipeline(rife_flow_tta_avg, bindings, constants, dispatcher);
+                    }
+                    {
+                        std::vector<ncnn::VkMat> bindings(8);
+                        bindings[0] = flow_reversed[fi][0];
+                        bindings[1] = flow_reversed[fi][1];
+                        bindings[2] = flow_reversed[fi][2];
+                        bindings[3] = flow_reversed[fi][3];
+                        bindings[4] = flow_reversed[fi][4];
+                        bindings[5] = flow_reversed[fi][5];
+                        bindings[6] = flow_reversed[fi][6];
+                        bindings[7] = flow_reversed[fi][7];
 
-                std::vector<ncnn::vk_constant_type> constants(4);
-                constants[0].i = timestep_gpu_padded_reversed[0].w;
-                constants[1].i = timestep_gpu_padded_reversed[0].h;
-                constants[2].i = timestep_gpu_padded_reversed[0].cstep;
-                constants[3].f = 1.f - timestep;
+                        std::vector<ncnn::vk_constant_type> constants(3);
+                        constants[0].i = flow_reversed[fi][0].w;
+                        constants[1].i = flow_reversed[fi][0].h;
+                        constants[2].i = flow_reversed[fi][0].cstep;
 
-                cmd.record_pipeline(rife_v4_timestep, bindings, constants, timestep_gpu_padded_reversed[0]);
-            }
+                        ncnn::VkMat dispatcher;
+                        dispatcher.w = flow_reversed[fi][0].w;
+                        dispatcher.h = flow_reversed[fi][0].h;
+                        dispatcher.c = 1;
+                        cmd.record_pipeline(rife_flow_tta_avg, bindings, constants, dispatcher);
+                    }
+                }
 
-            ncnn::VkMat flow[4][8];
-            ncnn::VkMat flow_reversed[4][8];
-            for (int fi = 0; fi < 4; fi++)
-            {
+                ncnn::VkMat out_gpu_padded_reversed[8];
                 for (int ti = 0; ti < 8; ti++)
                 {
                     {
-                        // flownet flow mask
+                        // flownet
                         ncnn::Extractor ex = flownet.create_extractor();
                         ex.set_blob_vkallocator(blob_vkallocator);
                         ex.set_workspace_vkallocator(blob_vkallocator);
@@ -2653,24 +2773,15 @@ int RIFE::process_v4(const ncnn::Mat& in0image, const ncnn::Mat& in1image, float
                         ex.input("in0", in0_gpu_padded[ti]);
                         ex.input("in1", in1_gpu_padded[ti]);
                         ex.input("in2", timestep_gpu_padded[ti / 4]);
+                        ex.input("flow0", flow[0][ti]);
+                        ex.input("flow1", flow[1][ti]);
+                        ex.input("flow2", flow[2][ti]);
+                        ex.input("flow3", flow[3][ti]);
 
-                        // intentional fall through
-                        switch (fi)
-                        {
-                        case 3: ex.input("flow2", flow[2][ti]);
-                        case 2: ex.input("flow1", flow[1][ti]);
-                        case 1: ex.input("flow0", flow[0][ti]);
-                        default:
-                        {
-                            char tmp[16];
-                            sprintf(tmp, "flow%d", fi);
-                            ex.extract(tmp, flow[fi][ti], cmd);
-                        }
-                        }
+                        ex.extract("out0", out_gpu_padded[ti], cmd);
                     }
 
                     {
-                        // flownet flow mask reversed
                         ncnn::Extractor ex = flownet.create_extractor();
                         ex.set_blob_vkallocator(blob_vkallocator);
                         ex.set_workspace_vkallocator(blob_vkallocator);
@@ -2679,91 +2790,91 @@ int RIFE::process_v4(const ncnn::Mat& in0image, const ncnn::Mat& in1image, float
                         ex.input("in0", in1_gpu_padded[ti]);
                         ex.input("in1", in0_gpu_padded[ti]);
                         ex.input("in2", timestep_gpu_padded_reversed[ti / 4]);
+                        ex.input("flow0", flow_reversed[0][ti]);
+                        ex.input("flow1", flow_reversed[1][ti]);
+                        ex.input("flow2", flow_reversed[2][ti]);
+                        ex.input("flow3", flow_reversed[3][ti]);
+
+                        ex.extract("out0", out_gpu_padded_reversed[ti], cmd);
+                    }
+
+                    // merge output
+                    {
+                        std::vector<ncnn::VkMat> bindings(2);
+                        bindings[0] = out_gpu_padded[ti];
+                        bindings[1] = out_gpu_padded_reversed[ti];
+
+                        std::vector<ncnn::vk_constant_type> constants(3);
+                        constants[0].i = out_gpu_padded[ti].w;
+                        constants[1].i = out_gpu_padded[ti].h;
+                        constants[2].i = out_gpu_padded[ti].cstep;
+
+                        ncnn::VkMat dispatcher;
+                        dispatcher.w = out_gpu_padded[ti].w;
+                        dispatcher.h = out_gpu_padded[ti].h;
+                        dispatcher.c = 3;
+                        cmd.record_pipeline(rife_out_tta_temporal_avg, bindings, constants, dispatcher);
+                    }
+                }
+            }
+            else
+            {
+                ncnn::VkMat flow[4][8];
+                for (int fi = 0; fi < 4; fi++)
+                {
+                    for (int ti = 0; ti < 8; ti++)
+                    {
+                        // flownet flow mask
+                        ncnn::Extractor ex = flownet.create_extractor();
+                        ex.set_blob_vkallocator(blob_vkallocator);
+                        ex.set_workspace_vkallocator(blob_vkallocator);
+                        ex.set_staging_vkallocator(staging_vkallocator);
+
+                        ex.input("in0", in0_gpu_padded[ti]);
+                        ex.input("in1", in1_gpu_padded[ti]);
+                        ex.input("in2", timestep_gpu_padded[ti / 4]);
 
                         // intentional fall through
                         switch (fi)
                         {
-                        case 3: ex.input("flow2", flow_reversed[2][ti]);
-                        case 2: ex.input("flow1", flow_reversed[1][ti]);
-                        case 1: ex.input("flow0", flow_reversed[0][ti]);
+                        case 3: ex.input("flow2", flow[2][ti]);
+                        case 2: ex.input("flow1", flow[1][ti]);
+                        case 1: ex.input("flow0", flow[0][ti]);
                         default:
                         {
                             char tmp[16];
                             sprintf(tmp, "flow%d", fi);
-                            ex.extract(tmp, flow_reversed[fi][ti], cmd);
+                            ex.extract(tmp, flow[fi][ti], cmd);
                         }
                         }
                     }
 
-                    // merge flow and flow_reversed
+                    // avg flow mask
                     {
-                        std::vector<ncnn::VkMat> bindings(2);
-                        bindings[0] = flow[fi][ti];
-                        bindings[1] = flow_reversed[fi][ti];
+                        std::vector<ncnn::VkMat> bindings(8);
+                        bindings[0] = flow[fi][0];
+                        bindings[1] = flow[fi][1];
+                        bindings[2] = flow[fi][2];
+                        bindings[3] = flow[fi][3];
+                        bindings[4] = flow[fi][4];
+                        bindings[5] = flow[fi][5];
+                        bindings[6] = flow[fi][6];
+                        bindings[7] = flow[fi][7];
 
                         std::vector<ncnn::vk_constant_type> constants(3);
-                        constants[0].i = flow[fi][ti].w;
-                        constants[1].i = flow[fi][ti].h;
-                        constants[2].i = flow[fi][ti].cstep;
+                        constants[0].i = flow[fi][0].w;
+                        constants[1].i = flow[fi][0].h;
+                        constants[2].i = flow[fi][0].cstep;
 
                         ncnn::VkMat dispatcher;
-                        dispatcher.w = flow[fi][ti].w;
-                        dispatcher.h = flow[fi][ti].h;
+                        dispatcher.w = flow[fi][0].w;
+                        dispatcher.h = flow[fi][0].h;
                         dispatcher.c = 1;
-                        cmd.record_pipeline(rife_flow_tta_temporal_avg, bindings, constants, dispatcher);
+                        cmd.record_pipeline(rife_flow_tta_avg, bindings, constants, dispatcher);
                     }
                 }
 
-                // avg flow mask
-                {
-                    std::vector<ncnn::VkMat> bindings(8);
-                    bindings[0] = flow[fi][0];
-                    bindings[1] = flow[fi][1];
-                    bindings[2] = flow[fi][2];
-                    bindings[3] = flow[fi][3];
-                    bindings[4] = flow[fi][4];
-                    bindings[5] = flow[fi][5];
-                    bindings[6] = flow[fi][6];
-                    bindings[7] = flow[fi][7];
-
-                    std::vector<ncnn::vk_constant_type> constants(3);
-                    constants[0].i = flow[fi][0].w;
-                    constants[1].i = flow[fi][0].h;
-                    constants[2].i = flow[fi][0].cstep;
-
-                    ncnn::VkMat dispatcher;
-                    dispatcher.w = flow[fi][0].w;
-                    dispatcher.h = flow[fi][0].h;
-                    dispatcher.c = 1;
-                    cmd.record_pipeline(rife_flow_tta_avg, bindings, constants, dispatcher);
-                }
-                {
-                    std::vector<ncnn::VkMat> bindings(8);
-                    bindings[0] = flow_reversed[fi][0];
-                    bindings[1] = flow_reversed[fi][1];
-                    bindings[2] = flow_reversed[fi][2];
-                    bindings[3] = flow_reversed[fi][3];
-                    bindings[4] = flow_reversed[fi][4];
-                    bindings[5] = flow_reversed[fi][5];
-                    bindings[6] = flow_reversed[fi][6];
-                    bindings[7] = flow_reversed[fi][7];
-
-                    std::vector<ncnn::vk_constant_type> constants(3);
-                    constants[0].i = flow_reversed[fi][0].w;
-                    constants[1].i = flow_reversed[fi][0].h;
-                    constants[2].i = flow_reversed[fi][0].cstep;
-
-                    ncnn::VkMat dispatcher;
-                    dispatcher.w = flow_reversed[fi][0].w;
-                    dispatcher.h = flow_reversed[fi][0].h;
-                    dispatcher.c = 1;
-                    cmd.record_pipeline(rife_flow_tta_avg, bindings, constants, dispatcher);
-                }
-            }
-
-            ncnn::VkMat out_gpu_padded_reversed[8];
-            for (int ti = 0; ti < 8; ti++)
-            {
+                for (int ti = 0; ti < 8; ti++)
                 {
                     // flownet
                     ncnn::Extractor ex = flownet.create_extractor();
@@ -2781,159 +2892,49 @@ int RIFE::process_v4(const ncnn::Mat& in0image, const ncnn::Mat& in1image, float
 
                     ex.extract("out0", out_gpu_padded[ti], cmd);
                 }
+            }
 
-                {
-                    ncnn::Extractor ex = flownet.create_extractor();
-                    ex.set_blob_vkallocator(blob_vkallocator);
-                    ex.set_workspace_vkallocator(blob_vkallocator);
-                    ex.set_staging_vkallocator(staging_vkallocator);
-
-                    ex.input("in0", in1_gpu_padded[ti]);
-                    ex.input("in1", in0_gpu_padded[ti]);
-                    ex.input("in2", timestep_gpu_padded_reversed[ti / 4]);
-                    ex.input("flow0", flow_reversed[0][ti]);
-                    ex.input("flow1", flow_reversed[1][ti]);
-                    ex.input("flow2", flow_reversed[2][ti]);
-                    ex.input("flow3", flow_reversed[3][ti]);
-
-                    ex.extract("out0", out_gpu_padded_reversed[ti], cmd);
-                }
-
-                // merge output
-                {
-                    std::vector<ncnn::VkMat> bindings(2);
-                    bindings[0] = out_gpu_padded[ti];
-                    bindings[1] = out_gpu_padded_reversed[ti];
-
-                    std::vector<ncnn::vk_constant_type> constants(3);
-                    constants[0].i = out_gpu_padded[ti].w;
-                    constants[1].i = out_gpu_padded[ti].h;
-                    constants[2].i = out_gpu_padded[ti].cstep;
+            trace_submit(cmd, "flownet");
 
-                    ncnn::VkMat dispatcher;
-                    dispatcher.w = out_gpu_padded[ti].w;
-                    dispatcher.h = out_gpu_padded[ti].h;
-                    dispatcher.c = 3;
-                    cmd.record_pipeline(rife_out_tta_temporal_avg, bindings, constants, dispatcher);
-                }
+            if (opt.use_fp16_storage && opt.use_int8_storage)
+            {
+                out_gpu[k].create(w, h, (size_t)channels, 1, blob_vkallocator);
             }
-        }
-        else
-        {
-            ncnn::VkMat flow[4][8];
-            for (int fi = 0; fi < 4; fi++)
+            else
             {
-                for (int ti = 0; ti < 8; ti++)
-                {
-                    // flownet flow mask
-                    ncnn::Extractor ex = flownet.create_extractor();
-                    ex.set_blob_vkallocator(blob_vkallocator);
-                    ex.set_workspace_vkallocator(blob_vkallocator);
-                    ex.set_staging_vkallocator(staging_vkallocator);
-
-                    ex.input("in0", in0_gpu_padded[ti]);
-                    ex.input("in1", in1_gpu_padded[ti]);
-                    ex.input("in2", timestep_gpu_padded[ti / 4]);
-
-                    // intentional fall through
-                    switch (fi)
-                    {
-                    case 3: ex.input("flow2", flow[2][ti]);
-                    case 2: ex.input("flow1", flow[1][ti]);
-                    case 1: ex.input("flow0", flow[0][ti]);
-                    default:
-                    {
-                        char tmp[16];
-                        sprintf(tmp, "flow%d", fi);
-                        ex.extract(tmp, flow[fi][ti], cmd);
-                    }
-                    }
-                }
-
-                // avg flow mask
-                {
-                    std::vector<ncnn::VkMat> bindings(8);
-                    bindings[0] = flow[fi][0];
-                    bindings[1] = flow[fi][1];
-                    bindings[2] = flow[fi][2];
-                    bindings[3] = flow[fi][3];
-                    bindings[4] = flow[fi][4];
-                    bindings[5] = flow[fi][5];
-                    bindings[6] = flow[fi][6];
-                    bindings[7] = flow[fi][7];
-
-                    std::vector<ncnn::vk_constant_type> constants(3);
-                    constants[0].i = flow[fi][0].w;
-                    constants[1].i = flow[fi][0].h;
-                    constants[2].i = flow[fi][0].cstep;
-
-                    ncnn::VkMat dispatcher;
-                    dispatcher.w = flow[fi][0].w;
-                    dispatcher.h = flow[fi][0].h;
-                    dispatcher.c = 1;
-                    cmd.record_pipeline(rife_flow_tta_avg, bindings, constants, dispatcher);
-                }
+                out_gpu[k].create(w, h, channels, (size_t)4u, 1, blob_vkallocator);
             }
 
-            for (int ti = 0; ti < 8; ti++)
+            // postproc
             {
-                // flownet
-                ncnn::Extractor ex = flownet.create_extractor();
-                ex.set_blob_vkallocator(blob_vkallocator);
-                ex.set_workspace_vkallocator(blob_vkallocator);
-                ex.set_staging_vkallocator(staging_vkallocator);
-
-                ex.input("in0", in0_gpu_padded[ti]);
-                ex.input("in1", in1_gpu_padded[ti]);
-                ex.input("in2", timestep_gpu_padded[ti / 4]);
-                ex.input("flow0", flow[0][ti]);
-                ex.input("flow1", flow[1][ti]);
-                ex.input("flow2", flow[2][ti]);
-                ex.input("flow3", flow[3][ti]);
-
-                ex.extract("out0", out_gpu_padded[ti], cmd);
+                std::vector<ncnn::VkMat> bindings(9);
+                bindings[0] = out_gpu_padded[0];
+                bindings[1] = out_gpu_padded[1];
+                bindings[2] = out_gpu_padded[2];
+                bindings[3] = out_gpu_padded[3];
+                bindings[4] = out_gpu_padded[4];
+                bindings[5] = out_gpu_padded[5];
+                bindings[6] = out_gpu_padded[6];
+                bindings[7] = out_gpu_padded[7];
+                bindings[8] = out_gpu[k];
+
+                std::vector<ncnn::vk_constant_type> constants(6);
+                constants[0].i = out_gpu_padded[0].w;
+                constants[1].i = out_gpu_padded[0].h;
+                constants[2].i = out_gpu_padded[0].cstep;
+                constants[3].i = out_gpu[k].w;
+                constants[4].i = out_gpu[k].h;
+                constants[5].i = out_gpu[k].cstep;
+
+                cmd.record_pipeline(rife_postproc, bindings, constants, out_gpu[k]);
             }
         }
-
-        if (opt.use_fp16_storage && opt.use_int8_storage)
-        {
-            out_gpu.create(w, h, (size_t)channels, 1, blob_vkallocator);
-        }
-        else
-        {
-            out_gpu.create(w, h, channels, (size_t)4u, 1, blob_vkallocator);
-        }
-
-        // postproc
-        {
-            std::vector<ncnn::VkMat> bindings(9);
-            bindings[0] = out_gpu_padded[0];
-            bindings[1] = out_gpu_padded[1];
-            bindings[2] = out_gpu_padded[2];
-            bindings[3] = out_gpu_padded[3];
-            bindings[4] = out_gpu_padded[4];
-            bindings[5] = out_gpu_padded[5];
-            bindings[6] = out_gpu_padded[6];
-            bindings[7] = out_gpu_padded[7];
-            bindings[8] = out_gpu;
-
-            std::vector<ncnn::vk_constant_type> constants(6);
-            constants[0].i = out_gpu_padded[0].w;
-            constants[1].i = out_gpu_padded[0].h;
-            constants[2].i = out_gpu_padded[0].cstep;
-            constants[3].i = out_gpu.w;
-            constants[4].i = out_gpu.h;
-            constants[5].i = out_gpu.cstep;
-
-            cmd.record_pipeline(rife_postproc, bindings, constants, out_gpu);
-        }
     }
     else
     {
         // preproc
         ncnn::VkMat in0_gpu_padded;
         ncnn::VkMat in1_gpu_padded;
-        ncnn::VkMat timestep_gpu_padded;
         {
             in0_gpu_padded.create(w_padded, h_padded, 3, in_out_tile_elemsize, 1, blob_vkallocator);
 
@@ -2968,46 +2969,123 @@ int RIFE::process_v4(const ncnn::Mat& in0image, const ncnn::Mat& in1image, float
 
             cmd.record_pipeline(rife_preproc, bindings, constants, in1_gpu_padded);
         }
+
+        for (size_t k = 0; k < todo.size(); k++)
         {
-            timestep_gpu_padded.create(w_padded, h_padded, 1, in_out_tile_elemsize, 1, blob_vkallocator);
+            const float timestep = timesteps[todo[k]];
+
+            ncnn::VkMat timestep_gpu_padded;
+            {
+                timestep_gpu_padded.create(w_padded, h_padded, 1, in_out_tile_elemsize, 1, blob_vkallocator);
+
+                std::vector<ncnn::VkMat> bindings(1);
+                bindings[0] = timestep_gpu_padded;
+
+                std::vector<ncnn::vk_constant_type> constants(4);
+                constants[0].i = timestep_gpu_padded.w;
+                constants[1].i = timestep_gpu_padded.h;
+                constants[2].i = timestep_gpu_padded.cstep;
+                constants[3].f = timestep;
+
+                cmd.record_pipeline(rife_v4_timestep, bindings, constants, timestep_gpu_padded);
+            }
 
-            std::vector<ncnn::VkMat> bindings(1);
-            bindings[0] = timestep_gpu_padded;
+            ncnn::VkMat out_gpu_padded;
+            if (tta_temporal_mode)
+            {
+                ncnn::VkMat timestep_gpu_padded_reversed;
+                {
+                    timestep_gpu_padded_reversed.create(w_padded, h_padded, 1, in_out_tile_elemsize, 1, blob_vkallocator);
+
+                    std::vector<ncnn::VkMat> bindings(1);
+                    bindings[0] = timestep_gpu_padded_reversed;
+
+                    std::vector<ncnn::vk_constant_type> constants(4);
+                    constants[0].i = timestep_gpu_padded_reversed.w;
+                    constants[1].i = timestep_gpu_padded_reversed.h;
+                    constants[2].i = timestep_gpu_padded_reversed.cstep;
+                    constants[3].f = 1.f - timestep;
+
+                    cmd.record_pipeline(rife_v4_timestep, bindings, constants, timestep_gpu_padded_reversed);
+                }
+
+                ncnn::VkMat flow[4];
+                ncnn::VkMat flow_reversed[4];
+                for (int fi = 0; fi < 4; fi++)
+                {
+                    {
+                        // flownet flow mask
+                        ncnn::Extractor ex = flownet.create_extractor();
+                        ex.set_blob_vkallocator(blob_vkallocator);
+                        ex.set_workspace_vkallocator(blob_vkallocator);
+                        ex.set_staging_vkallocator(staging_vkallocator);
+
+                        ex.input("in0", in0_gpu_padded);
+                        ex.input("in1", in1_gpu_padded);
+                        ex.input("in2", timestep_gpu_padded);
 
-            std::vector<ncnn::vk_constant_type> constants(4);
-            constants[0].i = timestep_gpu_padded.w;
-            constants[1].i = timestep_gpu_padded.h;
-            constants[2].i = timestep_gpu_padded.cstep;
-            constants[3].f = timestep;
+                        // intentional fall through
+                        switch (fi)
+                        {
+                        case 3: ex.input("flow2", flow[2]);
+                        case 2: ex.input("flow1", flow[1]);
+                        case 1: ex.input("flow0", flow[0]);
+                        default:
+                        {
+                            char tmp[16];
+                            sprintf(tmp, "flow%d", fi);
+                            ex.extract(tmp, flow[fi], cmd);
+                        }
+                        }
+                    }
+
+                    {
+                        // flownet flow mask reversed
+                        ncnn::Extractor ex = flownet.create_extractor();
+                        ex.set_blob_vkallocator(blob_vkallocator);
+                        ex.set_workspace_vkallocator(blob_vkallocator);
+                        ex.set_staging_vkallocator(staging_vkallocator);
 
-            cmd.record_pipeline(rife_v4_timestep, bindings, constants, timestep_gpu_padded);
-        }
+                        ex.input("in0", in1_gpu_padded);
+                        ex.input("in1", in0_gpu_padded);
+                        ex.input("in2", timestep_gpu_padded_reversed);
 
-        ncnn::VkMat out_gpu_padded;
-        if (tta_temporal_mode)
-        {
-            ncnn::VkMat timestep_gpu_padded_reversed;
-            {
-                timestep_gpu_padded_reversed.create(w_padded, h_padded, 1, in_out_tile_elemsize, 1, blob_vkallocator);
+                        // intentional fall through
+                        switch (fi)
+                        {
+                        case 3: ex.input("flow2", flow_reversed[2]);
+                        case 2: ex.input("flow1", flow_reversed[1]);
+                        case 1: ex.input("flow0", flow_reversed[0]);
+                        default:
+                        {
+                            char tmp[16];
+                            sprintf(tmp, "flow%d", fi);
+                            ex.extract(tmp, flow_reversed[fi], cmd);
+                        }
+                        }
+                    }
 
-                std::vector<ncnn::VkMat> bindings(1);
-                bindings[0] = timestep_gpu_padded_reversed;
+                    // merge flow and flow_reversed
+                    {
+                        std::vector<ncnn::VkMat> bindings(2);
+                        bindings[0] = flow[fi];
+                        bindings[1] = flow_reversed[fi];
 
-                std::vector<ncnn::vk_constant_type> constants(4);
-                constants[0].i = timestep_gpu_padded_reversed.w;
-                constants[1].i = timestep_gpu_padded_reversed.h;
-                constants[2].i = timestep_gpu_padded_reversed.cstep;
-                constants[3].f = 1.f - timestep;
+                        std::vector<ncnn::vk_constant_type> constants(3);
+                        constants[0].i = flow[fi].w;
+                        constants[1].i = flow[fi].h;
+                        constants[2].i = flow[fi].cstep;
 
-                cmd.record_pipeline(rife_v4_timestep, bindings, constants, timestep_gpu_padded_reversed);
-            }
+                        ncnn::VkMat dispatcher;
+                        dispatcher.w = flow[fi].w;
+                        dispatcher.h = flow[fi].h;
+                        dispatcher.c = 1;
+                        cmd.record_pipeline(rife_flow_tta_temporal_avg, bindings, constants, dispatcher);
+                    }
+                }
 
-            ncnn::VkMat flow[4];
-            ncnn::VkMat flow_reversed[4];
-            for (int fi = 0; fi < 4; fi++)
-            {
                 {
-                    // flownet flow mask
+                    // flownet
                     ncnn::Extractor ex = flownet.create_extractor();
                     ex.set_blob_vkallocator(blob_vkallocator);
                     ex.set_workspace_vkallocator(blob_vkallocator);
@@ -3016,24 +3094,16 @@ int RIFE::process_v4(const ncnn::Mat& in0image, const ncnn::Mat& in1image, float
                     ex.input("in0", in0_gpu_padded);
                     ex.input("in1", in1_gpu_padded);
                     ex.input("in2", timestep_gpu_padded);
+                    ex.input("flow0", flow[0]);
+                    ex.input("flow1", flow[1]);
+                    ex.input("flow2", flow[2]);
+                    ex.input("flow3", flow[3]);
 
-                    // intentional fall through
-                    switch (fi)
-                    {
-                    case 3: ex.input("flow2", flow[2]);
-                    case 2: ex.input("flow1", flow[1]);
-                    case 1: ex.input("flow0", flow[0]);
-                    default:
-                    {
-                        char tmp[16];
-                        sprintf(tmp, "flow%d", fi);
-                        ex.extract(tmp, flow[fi], cmd);
-                    }
-                    }
+                    ex.extract("out0", out_gpu_padded, cmd);
                 }
 
+                ncnn::VkMat out_gpu_padded_reversed;
                 {
-                    // flownet flow mask reversed
                     ncnn::Extractor ex = flownet.create_extractor();
                     ex.set_blob_vkallocator(blob_vkallocator);
                     ex.set_workspace_vkallocator(blob_vkallocator);
@@ -3042,41 +3112,33 @@ int RIFE::process_v4(const ncnn::Mat& in0image, const ncnn::Mat& in1image, float
                     ex.input("in0", in1_gpu_padded);
                     ex.input("in1", in0_gpu_padded);
                     ex.input("in2", timestep_gpu_padded_reversed);
+                    ex.input("flow0", flow_reversed[0]);
+                    ex.input("flow1", flow_reversed[1]);
+                    ex.input("flow2", flow_reversed[2]);
+                    ex.input("flow3", flow_reversed[3]);
 
-                    // intentional fall through
-                    switch (fi)
-                    {
-                    case 3: ex.input("flow2", flow_reversed[2]);
-                    case 2: ex.input("flow1", flow_reversed[1]);
-                    case 1: ex.input("flow0", flow_reversed[0]);
-                    default:
-                    {
-                        char tmp[16];
-                        sprintf(tmp, "flow%d", fi);
-                        ex.extract(tmp, flow_reversed[fi], cmd);
-                    }
-                    }
+                    ex.extract("out0", out_gpu_padded_reversed, cmd);
                 }
 
-                // merge flow and flow_reversed
+                // merge output
                 {
                     std::vector<ncnn::VkMat> bindings(2);
-                    bindings[0] = flow[fi];
-                    bindings[1] = flow_reversed[fi];
+                    bindings[0] = out_gpu_padded;
+                    bindings[1] = out_gpu_padded_reversed;
 
                     std::vector<ncnn::vk_constant_type> constants(3);
-                    constants[0].i = flow[fi].w;
-                    constants[1].i = flow[fi].h;
-                    constants[2].i = flow[fi].cstep;
+                    constants[0].i = out_gpu_padded.w;
+                    constants[1].i = out_gpu_padded.h;
+                    constants[2].i = out_gpu_padded.cstep;
 
                     ncnn::VkMat dispatcher;
-                    dispatcher.w = flow[fi].w;
-                    dispatcher.h = flow[fi].h;
-                    dispatcher.c = 1;
-                    cmd.record_pipeline(rife_flow_tta_temporal_avg, bindings, constants, dispatcher);
+                    dispatcher.w = out_gpu_padded.w;
+                    dispatcher.h = out_gpu_padded.h;
+                    dispatcher.c = 3;
+                    cmd.record_pipeline(rife_out_tta_temporal_avg, bindings, constants, dispatcher);
                 }
             }
-
+            else
             {
                 // flownet
                 ncnn::Extractor ex = flownet.create_extractor();
@@ -3087,111 +3149,97 @@ int RIFE::process_v4(const ncnn::Mat& in0image, const ncnn::Mat& in1image, float
                 ex.input("in0", in0_gpu_padded);
                 ex.input("in1", in1_gpu_padded);
                 ex.input("in2", timestep_gpu_padded);
-                ex.input("flow0", flow[0]);
-                ex.input("flow1", flow[1]);
-                ex.input("flow2", flow[2]);
-                ex.input("flow3", flow[3]);
+
+                if (trace_enabled())
+                {
+                    // each flow stage in its own submission, the extractor keeps the blobs computed so far
+                    for (int fi = 0; fi < 4; fi++)
+                    {
+                        char tmp[16];
+                        sprintf(tmp, "flow%d", fi);
+                        ncnn::VkMat flow;
+                        ex.extract(tmp, flow, cmd);
+                        trace_submit(cmd, v4_flow_stages[fi]);
+                    }
+                }
 
                 ex.extract("out0", out_gpu_padded, cmd);
             }
 
-            ncnn::VkMat out_gpu_padded_reversed;
-            {
-                ncnn::Extractor ex = flownet.create_extractor();
-                ex.set_blob_vkallocator(blob_vkallocator);
-                ex.set_workspace_vkallocator(blob_vkallocator);
-                ex.set_staging_vkallocator(staging_vkallocator);
-
-                ex.input("in0", in1_gpu_padded);
-                ex.input("in1", in0_gpu_padded);
-                ex.input("in2", timestep_gpu_padded_reversed);
-                ex.input("flow0", flow_reversed[0]);
-                ex.input("flow1", flow_reversed[1]);
-                ex.input("flow2", flow_reversed[2]);
-                ex.input("flow3", flow_reversed[3]);
+            trace_submit(cmd, "flownet");
 
-                ex.extract("out0", out_gpu_padded_reversed, cmd);
+            if (opt.use_fp16_storage && opt.use_int8_storage)
+            {
+                out_gpu[k].create(w, h, (size_t)channels, 1, blob_vkallocator);
+            }
+            else
+            {
+                out_gpu[k].create(w, h, channels, (size_t)4u, 1, blob_vkallocator);
             }
 
-            // merge output
+            // postproc
             {
                 std::vector<ncnn::VkMat> bindings(2);
                 bindings[0] = out_gpu_padded;
-                bindings[1] = out_gpu_padded_reversed;
+                bindings[1] = out_gpu[k];
 
-                std::vector<ncnn::vk_constant_type> constants(3);
+                std::vector<ncnn::vk_constant_type> constants(6);
                 constants[0].i = out_gpu_padded.w;
                 constants[1].i = out_gpu_padded.h;
                 constants[2].i = out_gpu_padded.cstep;
+                constants[3].i = out_gpu[k].w;
+                constants[4].i = out_gpu[k].h;
+                constants[5].i = out_gpu[k].cstep;
 
-                ncnn::VkMat dispatcher;
-                dispatcher.w = out_gpu_padded.w;
-                dispatcher.h = out_gpu_padded.h;
-                dispatcher.c = 3;
-                cmd.record_pipeline(rife_out_tta_temporal_avg, bindings, constants, dispatcher);
+                cmd.record_pipeline(rife_postproc, bindings, constants, out_gpu[k]);
             }
         }
-        else
-        {
-            // flownet
-            ncnn::Extractor ex = flownet.create_extractor();
-            ex.set_blob_vkallocator(blob_vkallocator);
-            ex.set_workspace_vkallocator(blob_vkallocator);
-            ex.set_staging_vkallocator(staging_vkallocator);
-
-            ex.input("in0", in0_gpu_padded);
-            ex.input("in1", in1_gpu_padded);
-            ex.input("in2", timestep_gpu_padded);
-            ex.extract("out0", out_gpu_padded, cmd);
-        }
-
-        if (opt.use_fp16_storage && opt.use_int8_storage)
-        {
-            out_gpu.create(w, h, (size_t)channels, 1, blob_vkallocator);
-        }
-        else
-        {
-            out_gpu.create(w, h, channels, (size_t)4u, 1, blob_vkallocator);
-        }
-
-        // postproc
-        {
-            std::vector<ncnn::VkMat> bindings(2);
-            bindings[0] = out_gpu_padded;
-            bindings[1] = out_gpu;
-
-            std::vector<ncnn::vk_constant_type> constants(6);
-            constants[0].i = out_gpu_padded.w;
-            constants[1].i = out_gpu_padded.h;
-            constants[2].i = out_gpu_padded.cstep;
-            constants[3].i = out_gpu.w;
-            constants[4].i = out_gpu.h;
-            constants[5].i = out_gpu.cstep;
-
-            cmd.record_pipeline(rife_postproc, bindings, constants, out_gpu);
-        }
     }
 
     // download
     {
-        ncnn::Mat out;
+        std::vector<ncnn::Mat> out(todo.size());
+        std::vector<ncnn::VkBufferMemory> out_views(todo.size());
+        std::vector<ncnn::VkMat> out_gpu_mapped(todo.size());
+        std::vector<char> out_mapped(todo.size(), 0);
 
-        if (opt.use_fp16_storage && opt.use_int8_storage)
+        for (size_t k = 0; k < todo.size(); k++)
         {
-            out = ncnn::Mat(out_gpu.w, out_gpu.h, (unsigned char*)outimage.data, (size_t)channels, 1);
-        }
+            if (opt.use_fp16_storage && opt.use_int8_storage)
+            {
+                out_mapped[k] = view_download_frame(frame_vkallocator, out_gpu[k], (const unsigned char*)outimages[todo[k]].data, channels, &out_views[k]);
+                out[k] = ncnn::Mat(out_gpu[k].w, out_gpu[k].h, (unsigned char*)outimages[todo[k]].data, (size_t)channels, 1);
+            }
 
-        cmd.record_clone(out_gpu, out, opt);
+            if (out_mapped[k])
+            {
+                out_mapped[k] = record_download_frame(out_gpu[k], &out_views[k], channels, out_gpu_mapped[k], out[k], cmd, opt);
+            }
+            else
+            {
+                cmd.record_clone(out_gpu[k], out[k], opt);
+            }
+        }
 
+        trace_submit(cmd, "download");
         cmd.submit_and_wait();
 
+        for (size_t k = 0; k < todo.size(); k++)
+        {
+            if (out_mapped[k])
+                frame_vkallocator->invalidate(&out_views[k]);
+        }
+
         if (!(opt.use_fp16_storage && opt.use_int8_storage))
         {
+            for (size_t k = 0; k < todo.size(); k++)
+            {
 #if _WIN32
-            out.to_pixels((unsigned char*)outimage.data, ncnn::Mat::PIXEL_RGB2BGR);
+                out[k].to_pixels((unsigned char*)outimages[todo[k]].data, ncnn::Mat::PIXEL_RGB2BGR);
 #else
-            out.to_pixels((unsigned char*)outimage.data, ncnn::Mat::PIXEL_RGB);
+                out[k].to_pixels((unsigned char*)outimages[todo[k]].data, ncnn::Mat::PIXEL_RGB);
 #endif
+            }
         }
     }
 
@@ -3229,18 +3277,6 @@ int RIFE::process_v4_cpu(const ncnn::Mat& in0image, const ncnn::Mat& in1image, f
     int w_padded = (w + 31) / 32 * 32;
     int h_padded = (h + 31) / 32 * 32;
 
-    ncnn::Mat in0;
-    ncnn::Mat in1;
-    {
-#if _WIN32
-        in0 = ncnn::Mat::from_pixels(pixel0data, ncnn::Mat::PIXEL_BGR2RGB, w, h);
-        in1 = ncnn::Mat::from_pixels(pixel1data, ncnn::Mat::PIXEL_BGR2RGB, w, h);
-#else
-        in0 = ncnn::Mat::from_pixels(pixel0data, ncnn::Mat::PIXEL_RGB, w, h);
-        in1 = ncnn::Mat::from_pixels(pixel1data, ncnn::Mat::PIXEL_RGB, w, h);
-#endif
-    }
-
     ncnn::Mat out;
 
     if (tta_mode)
@@ -3249,66 +3285,8 @@ int RIFE::process_v4_cpu(const ncnn::Mat& in0image, const ncnn::Mat& in1image, f
         ncnn::Mat in0_padded[8];
         ncnn::Mat in1_padded[8];
         ncnn::Mat timestep_padded[2];
-        {
-            in0_padded[0].create(w_padded, h_padded, 3);
-            for (int q = 0; q < 3; q++)
-            {
-                float* outptr = in0_padded[0].channel(q);
-
-                int i = 0;
-                for (; i < h; i++)
-                {
-                    const float* ptr = in0.channel(q).row(i);
-
-                    int j = 0;
-                    for (; j < w; j++)
-                    {
-                        *outptr++ = *ptr++ * (1 / 255.f);
-                    }
-                    for (; j < w_padded; j++)
-                    {
-                        *outptr++ = 0.f;
-                    }
-                }
-                for (; i < h_padded; i++)
-                {
-                    for (int j = 0; j < w_padded; j++)
-                    {
-                        *outptr++ = 0.f;
-                    }
-                }
-            }
-        }
-        {
-            in1_padded[0].create(w_padded, h_padded, 3);
-            for (int q = 0; q < 3; q++)
-            {
-                float* outptr = in1_padded[0].channel(q);
-
-                int i = 0;
-                for (; i < h; i++)
-                {
-                    const float* ptr = in1.channel(q).row(i);
-
-                    int j = 0;
-                    for (; j < w; j++)
-                    {
-                        *outptr++ = *ptr++ * (1 / 255.f);
-                    }
-                    for (; j < w_padded; j++)
-                    {
-                        *outptr++ = 0.f;
-                    }
-                }
-                for (; i < h_padded; i++)
-                {
-                    for (int j = 0; j < w_padded; j++)
-                    {
-                        *outptr++ = 0.f;
-                    }
-                }
-            }
-        }
+        preproc_cpu(pixel0data, w, h, w_padded, h_padded, in0_padded, 8, opt.num_threads);
+        preproc_cpu(pixel1data, w, h, w_padded, h_padded, in1_padded, 8, opt.num_threads);
         {
             timestep_padded[0].create(w_padded, h_padded, 1);
             timestep_padded[1].create(h_padded, w_padded, 1);
@@ -3316,102 +3294,6 @@ int RIFE::process_v4_cpu(const ncnn::Mat& in0image, const ncnn::Mat& in1image, f
             timestep_padded[1].fill(timestep);
         }
 
-        // the other 7 directions
-        {
-            in0_padded[1].create(w_padded, h_padded, 3);
-            in0_padded[2].create(w_padded, h_padded, 3);
-            in0_padded[3].create(w_padded, h_padded, 3);
-            in0_padded[4].create(h_padded, w_padded, 3);
-            in0_padded[5].create(h_padded, w_padded, 3);
-            in0_padded[6].create(h_padded, w_padded, 3);
-            in0_padded[7].create(h_padded, w_padded, 3);
-
-            for (int q = 0; q < 3; q++)
-            {
-                const ncnn::Mat in0_padded_0 = in0_padded[0].channel(q);
-                ncnn::Mat in0_padded_1 = in0_padded[1].channel(q);
-                ncnn::Mat in0_padded_2 = in0_padded[2].channel(q);
-                ncnn::Mat in0_padded_3 = in0_padded[3].channel(q);
-                ncnn::Mat in0_padded_4 = in0_padded[4].channel(q);
-                ncnn::Mat in0_padded_5 = in0_padded[5].channel(q);
-                ncnn::Mat in0_padded_6 = in0_padded[6].channel(q);
-                ncnn::Mat in0_padded_7 = in0_padded[7].channel(q);
-
-                for (int i = 0; i < h_padded; i++)
-                {
-                    const float* outptr0 = in0_padded_0.row(i);
-                    float* outptr1 = in0_padded_1.row(i) + w_padded - 1;
-                    float* outptr2 = in0_padded_2.row(h_padded - 1 - i) + w_padded - 1;
-                    float* outptr3 = in0_padded_3.row(h_padded - 1 - i);
-
-                    for (int j = 0; j < w_padded; j++)
-                    {
-                        float* outptr4 = in0_padded_4.row(j) + i;
-                        float* outptr5 = in0_padded_5.row(j) + h_padded - 1 - i;
-                        float* outptr6 = in0_padded_6.row(w_padded - 1 - j) + h_padded - 1 - i;
-                        float* outptr7 = in0_padded_7.row(w_padded - 1 - j) + i;
-
-                        float v = *outptr0++;
-
-                        *outptr1-- = v;
-                        *outptr2-- = v;
-                        *outptr3++ = v;
-                        *outptr4 = v;
-                        *outptr5 = v;
-                        *outptr6 = v;
-                        *outptr7 = v;
-                    }
-                }
-            }
-        }
-        {
-            in1_padded[1].create(w_padded, h_padded, 3);
-            in1_padded[2].create(w_padded, h_padded, 3);
-            in1_padded[3].create(w_padded, h_padded, 3);
-            in1_padded[4].create(h_padded, w_padded, 3);
-            in1_padded[5].create(h_padded, w_padded, 3);
-            in1_padded[6].create(h_padded, w_padded, 3);
-            in1_padded[7].create(h_padded, w_padded, 3);
-
-            for (int q = 0; q < 3; q++)
-            {
-                const ncnn::Mat in1_padded_0 = in1_padded[0].channel(q);
-                ncnn::Mat in1_padded_1 = in1_padded[1].channel(q);
-                ncnn::Mat in1_padded_2 = in1_padded[2].channel(q);
-                ncnn::Mat in1_padded_3 = in1_padded[3].channel(q);
-                ncnn::Mat in1_padded_4 = in1_padded[4].channel(q);
-                ncnn::Mat in1_padded_5 = in1_padded[5].channel(q);
-                ncnn::Mat in1_padded_6 = in1_padded[6].channel(q);
-                ncnn::Mat in1_padded_7 = in1_padded[7].channel(q);
-
-                for (int i = 0; i < h_padded; i++)
-                {
-                    const float* outptr0 = in1_padded_0.row(i);
-                    float* outptr1 = in1_padded_1.row(i) + w_padded - 1;
-                    float* outptr2 = in1_padded_2.row(h_padded - 1 - i) + w_padded - 1;
-                    float* outptr3 = in1_padded_3.row(h_padded - 1 - i);
-
-                    for (int j = 0; j < w_padded; j++)
-                    {
-                        float* outptr4 = in1_padded_4.row(j) + i;
-                        float* outptr5 = in1_padded_5.row(j) + h_padded - 1 - i;
-                        float* outptr6 = in1_padded_6.row(w_padded - 1 - j) + h_padded - 1 - i;
-                        float* outptr7 = in1_padded_7.row(w_padded - 1 - j) + i;
-
-                        float v = *outptr0++;
-
-                        *outptr1-- = v;
-                        *outptr2-- = v;
-                        *outptr3++ = v;
-                        *outptr4 = v;
-                        *outptr5 = v;
-                        *outptr6 = v;
-                        *outptr7 = v;
-                    }
-                }
-            }
-        }
-
         ncnn::Mat out_padded[8];
         ncnn::Mat out_padded_reversed[8];
         if (tta_temporal_mode)
@@ -4149,66 +4031,8 @@ int RIFE::process_v4_cpu(const ncnn::Mat& in0image, const ncnn::Mat& in1image, f
         ncnn::Mat in0_padded;
         ncnn::Mat in1_padded;
         ncnn::Mat timestep_padded;
-        {
-            in0_padded.create(w_padded, h_padded, 3);
-            for (int q = 0; q < 3; q++)
-            {
-                float* outptr = in0_padded.channel(q);
-
-                int i = 0;
-                for (; i < h; i++)
-                {
-                    const float* ptr = in0.channel(q).row(i);
-
-                    int j = 0;
-                    for (; j < w; j++)
-                    {
-                        *outptr++ = *ptr++ * (1 / 255.f);
-                    }
-                    for (; j < w_padded; j++)
-                    {
-                        *outptr++ = 0.f;
-                    }
-                }
-                for (; i < h_padded; i++)
-                {
-                    for (int j = 0; j < w_padded; j++)
-                    {
-                        *outptr++ = 0.f;
-                    }
-                }
-            }
-        }
-        {
-            in1_padded.create(w_padded, h_padded, 3);
-            for (int q = 0; q < 3; q++)
-            {
-                float* outptr = in1_padded.channel(q);
-
-                int i = 0;
-                for (; i < h; i++)
-                {
-                    const float* ptr = in1.channel(q).row(i);
-
-                    int j = 0;
-                    for (; j < w; j++)
-                    {
-                        *outptr++ = *ptr++ * (1 / 255.f);
-                    }
-                    for (; j < w_padded; j++)
-                    {
-                        *outptr++ = 0.f;
-                    }
-                }
-                for (; i < h_padded; i++)
-                {
-                    for (int j = 0; j < w_padded; j++)
-                    {
-                        *outptr++ = 0.f;
-                    }
-                }
-            }
-        }
+        preproc_cpu(pixel0data, w, h, w_padded, h_padded, &in0_padded, 1, opt.num_threads);
+        preproc_cpu(pixel1data, w, h, w_padded, h_padded, &in1_padded, 1, opt.num_threads);
         {
             timestep_padded.create(w_padded, h_padded, 1);
             timestep_padded.fill(timestep);
@@ -4,14 +4,18 @@
 #define RIFE_H
 
 #include <string>
+#include <list>
+#include <vector>
 
 // ncnn
 #include "net.h"
 
+class MappedFrameAllocator;
+
 class RIFE
 {
 public:
-    RIFE(int gpuid, bool tta_mode = false, bool tta_temporal_mode = false, bool uhd_mode = false, int num_threads = 1, bool rife_v2 = false, bool rife_v4 = false);
+    RIFE(int gpuid, bool tta_mode = false, bool tta_temporal_mode = false, bool uhd_mode = false, int num_threads = 1, bool rife_v2 = false, bool rife_v4 = false, int tta_jobs = 1, int tilesize = 0);
     ~RIFE();
 
 #if _WIN32
@@ -20,14 +24,64 @@ public:
     int load(const std::string& modeldir);
 #endif
 
-    int process(const ncnn::Mat& in0image, const ncnn::Mat& in1image, float timestep, ncnn::Mat& outimage) const;
+    // host memory this gpu copies frames from and into directly, null on cpu
+    // decoded and output frames allocated here skip the staging memcpy on upload and download
+    ncnn::Allocator* frame_allocator() const;
+
+    // frame ids only identify frames within one job, call before a new job reuses them
+    void clear_context_features() const;
+
+    // upload both inputs into blob_vkallocator ahead of process(), so the transfer overlaps other work
+    int upload(const ncnn::Mat& in0image, const ncnn::Mat& in1image, ncnn::VkMat& in0_gpu, ncnn::VkMat& in1_gpu, ncnn::VkAllocator* blob_vkallocator) const;
 
-    int process_cpu(const ncnn::Mat& in0image, const ncnn::Mat& in1image, float timestep, ncnn::Mat& outimage) const;
+    // in0id and in1id identify the source frames for reusing contextnet features, -1 disables caching
+    // in0_gpu and in1_gpu are optional inputs from upload()
+    int process(const ncnn::Mat& in0image, const ncnn::Mat& in1image, float timestep, ncnn::Mat& outimage, int in0id = -1, int in1id = -1, const ncnn::VkMat& in0_gpu = ncnn::VkMat(), const ncnn::VkMat& in1_gpu = ncnn::VkMat()) const;
+
+    int process_cpu(const ncnn::Mat& in0image, const ncnn::Mat& in1image, float timestep, ncnn::Mat& outimage, int in0id = -1, int in1id = -1) const;
 
     int process_v4(const ncnn::Mat& in0image, const ncnn::Mat& in1image, float timestep, ncnn::Mat& outimage) const;
 
+    // interpolate all timesteps of one pair, inputs are uploaded and preprocessed only once
+    int process_v4_multi(const ncnn::Mat& in0image, const ncnn::Mat& in1image, const std::vector<float>& timesteps, std::vector<ncnn::Mat>& outimages, const ncnn::VkMat& in0_gpu = ncnn::VkMat(), const ncnn::VkMat& in1_gpu = ncnn::VkMat()) const;
+
     int process_v4_cpu(const ncnn::Mat& in0image, const ncnn::Mat& in1image, float timestep, ncnn::Mat& outimage) const;
 
+private:
+    // frames larger than tilesize are interpolated as overlapping tiles and blended back
+    bool tiled(int w, int h) const;
+    int process_tiled(const ncnn::Mat& in0image, const ncnn::Mat& in1image, const std::vector<float>& timesteps, std::vector<ncnn::Mat>& outimages) const;
+
+    // flownet on padded planar inputs, with the uhd down and upscale around it
+    void extract_flow(const ncnn::Mat& in0_padded, const ncnn::Mat& in1_padded, ncnn::Mat& flow, const ncnn::Option& opt) const;
+
+    // views receives the mapped ranges of inputs in frame_allocator() memory and must outlive cmd
+    void record_upload(const ncnn::Mat& in0image, const ncnn::Mat& in1image, ncnn::VkMat& in0_gpu, ncnn::VkMat& in1_gpu, ncnn::VkCompute& cmd, const ncnn::Option& opt, ncnn::VkBufferMemory views[2]) const;
+
+    // with tracing on, run what is recorded so far and time it as one stage of this gpu
+    // splits the pair into several submissions, so the stages add up to a little more than an untraced run
+    void trace_submit(ncnn::VkCompute& cmd, const char* stage) const;
+
+    // contextnet is split into the image-only feature pyramid and the flow dependent warp
+    void extract_context_features(const ncnn::VkMat& in_gpu_padded, ncnn::VkMat features[4], bool cache, ncnn::VkCompute& cmd, const ncnn::Option& opt) const;
+    void extract_context_features(const ncnn::Mat& in_padded, ncnn::Mat features[4]) const;
+    void warp_context_features(const ncnn::VkMat features[4], const char* flowname, const ncnn::VkMat& flow, ncnn::VkMat ctx[4], ncnn::VkCompute& cmd, const ncnn::Option& opt) const;
+    void warp_context_features(const ncnn::Mat features[4], const char* flowname, const ncnn::Mat& flow, ncnn::Mat ctx[4]) const;
+
+    bool find_context_features(int frameid, int ti, ncnn::VkMat features[4]) const;
+    bool find_context_features(int frameid, int ti, ncnn::Mat features[4]) const;
+    void cache_context_features(int frameid, int ti, const ncnn::VkMat features[4]) const;
+    void cache_context_features(int frameid, int ti, const ncnn::Mat features[4]) const;
+
+    class ContextFeatures
+    {
+    public:
+        int frameid;
+        int ti;
+        ncnn::VkMat features_gpu[4];
+        ncnn::Mat features[4];
+    };
+
 private:
     ncnn::VulkanDevice* vkdev;
     ncnn::Net flownet;
@@ -49,6 +103,22 @@ private:
     int num_threads;
     bool rife_v2;
     bool rife_v4;
+    int tta_jobs;
+    int tilesize;
+
+    // contextnet pyramid blob names feeding the warp layers of f1 f2 f3 f4
+    std::string context_feature_blobs[4];
+
+    // recently used contextnet features keyed by source frame, most recent first
+    ncnn::VkAllocator* context_feature_vkallocator;
+    mutable ncnn::Mutex context_feature_lock;
+    mutable std::list<ContextFeatures> context_feature_cache;
+
+    // mapped staging memory for whole frames
+    MappedFrameAllocator* frame_vkallocator;
+
+    // gpu id of the trace events
+    int trace_device;
 };
 
 #endif // RIFE_H
@@ -0,0 +1,323 @@
+// rife implemented with ncnn library
+
+#include "rife_cpu.h"
+
+#include <string.h>
+#include <algorithm>
+
+#if __SSE2__
+#include <emmintrin.h>
+#include <xmmintrin.h>
+#endif
+#if __ARM_NEON
+#include <arm_neon.h>
+#endif
+
+// transpose a 32x32 float tile
+static void transpose_tile_32(const float* src, float* dst)
+{
+    for (int r = 0; r < 32; r += 4)
+    {
+        for (int c = 0; c < 32; c += 4)
+        {
+            const float* p = src + r * 32 + c;
+            float* outptr = dst + c * 32 + r;
+#if __SSE2__
+            __m128 _r0 = _mm_loadu_ps(p);
+            __m128 _r1 = _mm_loadu_ps(p + 32);
+            __m128 _r2 = _mm_loadu_ps(p + 64);
+            __m128 _r3 = _mm_loadu_ps(p + 96);
+            _MM_TRANSPOSE4_PS(_r0, _r1, _r2, _r3);
+            _mm_storeu_ps(outptr, _r0);
+            _mm_storeu_ps(outptr + 32, _r1);
+            _mm_storeu_ps(outptr + 64, _r2);
+            _mm_storeu_ps(outptr + 96, _r3);
+#elif __ARM_NEON
+            float32x4x2_t _r01 = vtrnq_f32(vld1q_f32(p), vld1q_f32(p + 32));
+            float32x4x2_t _r23 = vtrnq_f32(vld1q_f32(p + 64), vld1q_f32(p + 96));
+            vst1q_f32(outptr, vcombine_f32(vget_low_f32(_r01.val[0]), vget_low_f32(_r23.val[0])));
+            vst1q_f32(outptr + 32, vcombine_f32(vget_low_f32(_r01.val[1]), vget_low_f32(_r23.val[1])));
+            vst1q_f32(outptr + 64, vcombine_f32(vget_high_f32(_r01.val[0]), vget_high_f32(_r23.val[0])));
+            vst1q_f32(outptr + 96, vcombine_f32(vget_high_f32(_r01.val[1]), vget_high_f32(_r23.val[1])));
+#else
+            for (int i = 0; i < 4; i++)
+            {
+                for (int j = 0; j < 4; j++)
+                {
+                    outptr[j * 32 + i] = p[i * 32 + j];
+                }
+            }
+#endif
+        }
+    }
+}
+
+static void copy_reversed_32(const float* ptr, float* outptr)
+{
+    for (int c = 0; c < 32; c++)
+    {
+        *outptr-- = *ptr++;
+    }
+}
+
+// interleaved uint8 rgb (bgr on windows) to the normalized zero padded planar input of the requested tta directions
+// works on 32x32 tiles so every direction is written with contiguous rows, null entries of outs are skipped
+static void preproc_cpu_tiles(const unsigned char* pixeldata, int w, int h, int w_padded, int h_padded, ncnn::Mat* const outs[8], int num_threads)
+{
+    bool transposed = false;
+    for (int k = 0; k < 8; k++)
+    {
+        if (!outs[k])
+            continue;
+
+        if (k < 4)
+        {
+            outs[k]->create(w_padded, h_padded, 3);
+        }
+        else
+        {
+            outs[k]->create(h_padded, w_padded, 3);
+            transposed = true;
+        }
+    }
+
+    const int tiles_x = w_padded / 32;
+    const int tiles_y = h_padded / 32;
+
+    #pragma omp parallel for num_threads(num_threads)
+    for (int t = 0; t < tiles_x * tiles_y; t++)
+    {
+        const int ty = t / tiles_x * 32;
+        const int tx = t % tiles_x * 32;
+
+        float tile[3][32 * 32];
+        float tile_t[32 * 32];
+
+        // normalize and pad
+        for (int r = 0; r < 32; r++)
+        {
+            const int i = ty + r;
+            const int cend = i < h ? std::max(std::min(32, w - tx), 0) : 0;
+
+            float* tp0 = tile[0] + r * 32;
+            float* tp1 = tile[1] + r * 32;
+            float* tp2 = tile[2] + r * 32;
+#if _WIN32
+            std::swap(tp0, tp2);
+#endif
+
+            const unsigned char* p = pixeldata + ((size_t)i * w + tx) * 3;
+
+            int c = 0;
+#if __ARM_NEON
+            float32x4_t _scale = vdupq_n_f32(1 / 255.f);
+            for (; c + 7 < cend; c += 8)
+            {
+                uint8x8x3_t _p = vld3_u8(p + c * 3);
+                uint16x8_t _p0 = vmovl_u8(_p.val[0]);
+                uint16x8_t _p1 = vmovl_u8(_p.val[1]);
+                uint16x8_t _p2 = vmovl_u8(_p.val[2]);
+                vst1q_f32(tp0 + c, vmulq_f32(vcvtq_f32_u32(vmovl_u16(vget_low_u16(_p0))), _scale));
+                vst1q_f32(tp0 + c + 4, vmulq_f32(vcvtq_f32_u32(vmovl_u16(vget_high_u16(_p0))), _scale));
+                vst1q_f32(tp1 + c, vmulq_f32(vcvtq_f32_u32(vmovl_u16(vget_low_u16(_p1))), _scale));
+                vst1q_f32(tp1 + c + 4, vmulq_f32(vcvtq_f32_u32(vmovl_u16(vget_high_u16(_p1))), _scale));
+                vst1q_f32(tp2 + c, vmulq_f32(vcvtq_f32_u32(vmovl_u16(vget_low_u16(_p2))), _scale));
+                vst1q_f32(tp2 + c + 4, vmulq_f32(vcvtq_f32_u32(vmovl_u16(vget_high_u16(_p2))), _scale));
+            }
+#endif // __ARM_NEON
+            for (; c < cend; c++)
+            {
+                tp0[c] = p[c * 3 + 0] * (1 / 255.f);
+                tp1[c] = p[c * 3 + 1] * (1 / 255.f);
+                tp2[c] = p[c * 3 + 2] * (1 / 255.f);
+            }
+            for (; c < 32; c++)
+            {
+                tp0[c] = 0.f;
+                tp1[c] = 0.f;
+                tp2[c] = 0.f;
+            }
+        }
+
+        for (int q = 0; q < 3; q++)
+        {
+            // direction 0 1 2 3 keep the row layout
+            for (int r = 0; r < 32; r++)
+            {
+                const int i = ty + r;
+                const float* tp = tile[q] + r * 32;
+
+                if (outs[0])
+                    memcpy(outs[0]->channel(q).row(i) + tx, tp, 32 * sizeof(float));
+                if (outs[1])
+                    copy_reversed_32(tp, outs[1]->channel(q).row(i) + w_padded - 1 - tx);
+                if (outs[2])
+                    copy_reversed_32(tp, outs[2]->channel(q).row(h_padded - 1 - i) + w_padded - 1 - tx);
+                if (outs[3])
+                    memcpy(outs[3]->channel(q).row(h_padded - 1 - i) + tx, tp, 32 * sizeof(float));
+            }
+
+            if (!transposed)
+                continue;
+
+            // direction 4 5 6 7 are transposed
+            transpose_tile_32(tile[q], tile_t);
+
+            for (int c = 0; c < 32; c++)
+            {
+                const int j = tx + c;
+                const float* tp = tile_t + c * 32;
+
+                if (outs[4])
+                    memcpy(outs[4]->channel(q).row(j) + ty, tp, 32 * sizeof(float));
+                if (outs[5])
+                    copy_reversed_32(tp, outs[5]->channel(q).row(j) + h_padded - 1 - ty);
+                if (outs[6])
+                    copy_reversed_32(tp, outs[6]->channel(q).row(w_padded - 1 - j) + h_padded - 1 - ty);
+                if (outs[7])
+                    memcpy(outs[7]->channel(q).row(w_padded - 1 - j) + ty, tp, 32 * sizeof(float));
+            }
+        }
+    }
+}
+
+// the first count tta directions
+void preproc_cpu(const unsigned char* pixeldata, int w, int h, int w_padded, int h_padded, ncnn::Mat* outs, int count, int num_threads)
+{
+    ncnn::Mat* dirs[8] = {0, 0, 0, 0, 0, 0, 0, 0};
+    for (int k = 0; k < count; k++)
+    {
+        dirs[k] = &outs[k];
+    }
+
+    preproc_cpu_tiles(pixeldata, w, h, w_padded, h_padded, dirs, num_threads);
+}
+
+// a single tta direction
+void preproc_cpu_direction(const unsigned char* pixeldata, int w, int h, int w_padded, int h_padded, int ti, ncnn::Mat& out, int num_threads)
+{
+    ncnn::Mat* dirs[8] = {0, 0, 0, 0, 0, 0, 0, 0};
+    dirs[ti] = &out;
+
+    preproc_cpu_tiles(pixeldata, w, h, w_padded, h_padded, dirs, num_threads);
+}
+
+// position of the canonical pixel (i, j) in tta direction ti, w and h are the canonical size
+static inline void tta_position(int ti, int i, int j, int w, int h, int* r, int* c)
+{
+    switch (ti)
+    {
+    case 0: *r = i; *c = j; break;
+    case 1: *r = i; *c = w - 1 - j; break;
+    case 2: *r = h - 1 - i; *c = w - 1 - j; break;
+    case 3: *r = h - 1 - i; *c = j; break;
+    case 4: *r = j; *c = i; break;
+    case 5: *r = j; *c = h - 1 - i; break;
+    case 6: *r = w - 1 - j; *c = h - 1 - i; break;
+    default: *r = w - 1 - j; *c = i; break;
+    }
+}
+
+// the canonical flow x and y are sign_x * x and sign_y * y of direction ti, swapped for the transposed directions
+static const float tta_flow_sign_x[8] = {1.f, -1.f, -1.f, 1.f, 1.f, 1.f, -1.f, -1.f};
+static const float tta_flow_sign_y[8] = {1.f, 1.f, -1.f, -1.f, 1.f, -1.f, -1.f, 1.f};
+
+// add flow of direction ti to the canonical flow_sum, every channel pair is one flow field
+void tta_flow_accumulate(const ncnn::Mat& flow, int ti, ncnn::Mat& flow_sum, int num_threads)
+{
+    const int w = flow_sum.w;
+    const int h = flow_sum.h;
+    const float sign_x = tta_flow_sign_x[ti];
+    const float sign_y = tta_flow_sign_y[ti];
+    const bool swap = ti >= 4;
+
+    for (int p = 0; p + 1 < flow_sum.c; p += 2)
+    {
+        const ncnn::Mat flow_x = flow.channel(swap ? p + 1 : p);
+        const ncnn::Mat flow_y = flow.channel(swap ? p : p + 1);
+        ncnn::Mat sum_x = flow_sum.channel(p);
+        ncnn::Mat sum_y = flow_sum.channel(p + 1);
+
+        #pragma omp parallel for num_threads(num_threads)
+        for (int i = 0; i < h; i++)
+        {
+            float* sxptr = sum_x.row(i);
+            float* syptr = sum_y.row(i);
+
+            for (int j = 0; j < w; j++)
+            {
+                int r;
+                int c;
+                tta_position(ti, i, j, w, h, &r, &c);
+
+                sxptr[j] += sign_x * flow_x.row(r)[c];
+                syptr[j] += sign_y * flow_y.row(r)[c];
+            }
+        }
+    }
+}
+
+// the canonical flow_avg seen from direction ti
+void tta_flow_transform(const ncnn::Mat& flow_avg, int ti, ncnn::Mat& flow, int num_threads)
+{
+    const int w = flow_avg.w;
+    const int h = flow_avg.h;
+    const float sign_x = tta_flow_sign_x[ti];
+    const float sign_y = tta_flow_sign_y[ti];
+    const bool swap = ti >= 4;
+
+    if (swap)
+        flow.create(h, w, flow_avg.c);
+    else
+        flow.create(w, h, flow_avg.c);
+
+    for (int p = 0; p + 1 < flow_avg.c; p += 2)
+    {
+        const ncnn::Mat avg_x = flow_avg.channel(p);
+        const ncnn::Mat avg_y = flow_avg.channel(p + 1);
+        ncnn::Mat flow_x = flow.channel(swap ? p + 1 : p);
+        ncnn::Mat flow_y = flow.channel(swap ? p : p + 1);
+
+        #pragma omp parallel for num_threads(num_threads)
+        for (int i = 0; i < h; i++)
+        {
+            const float* axptr = avg_x.row(i);
+            const float* ayptr = avg_y.row(i);
+
+            for (int j = 0; j < w; j++)
+            {
+                int r;
+                int c;
+                tta_position(ti, i, j, w, h, &r, &c);
+
+                flow_x.row(r)[c] = sign_x * axptr[j];
+                flow_y.row(r)[c] = sign_y * ayptr[j];
+            }
+        }
+    }
+}
+
+// add the padded output of direction ti to the canonical out_sum
+void tta_out_accumulate(const ncnn::Mat& out_padded, int ti, int w_padded, int h_padded, ncnn::Mat& out_sum, int num_threads)
+{
+    for (int q = 0; q < out_sum.c; q++)
+    {
+        const ncnn::Mat out_padded_q = out_padded.channel(q);
+        ncnn::Mat out_sum_q = out_sum.channel(q);
+
+        #pragma omp parallel for num_threads(num_threads)
+        for (int i = 0; i < out_sum.h; i++)
+        {
+            float* outptr = out_sum_q.row(i);
+
+            for (int j = 0; j < out_sum.w; j++)
+            {
+                int r;
+                int c;
+                tta_position(ti, i, j, w_padded, h_padded, &r, &c);
+
+                outptr[j] += out_padded_q.row(r)[c];
+            }
+        }
+    }
+}
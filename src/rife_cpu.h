@@ -0,0 +1,26 @@
+// rife implemented with ncnn library
+
+#ifndef RIFE_CPU_H
+#define RIFE_CPU_H
+
+// ncnn
+#include "mat.h"
+
+// the cpu kernels of process_cpu, shared with rife-bench so that it times the same code
+
+// interleaved uint8 rgb (bgr on windows) to the normalized zero padded planar input of the first count tta directions
+void preproc_cpu(const unsigned char* pixeldata, int w, int h, int w_padded, int h_padded, ncnn::Mat* outs, int count, int num_threads);
+
+// a single tta direction
+void preproc_cpu_direction(const unsigned char* pixeldata, int w, int h, int w_padded, int h_padded, int ti, ncnn::Mat& out, int num_threads);
+
+// add flow of direction ti to the canonical flow_sum, every channel pair is one flow field
+void tta_flow_accumulate(const ncnn::Mat& flow, int ti, ncnn::Mat& flow_sum, int num_threads);
+
+// the canonical flow_avg seen from direction ti
+void tta_flow_transform(const ncnn::Mat& flow_avg, int ti, ncnn::Mat& flow, int num_threads);
+
+// add the padded output of direction ti to the canonical out_sum
+void tta_out_accumulate(const ncnn::Mat& out_padded, int ti, int w_padded, int h_padded, ncnn::Mat& out_sum, int num_threads);
+
+#endif // RIFE_CPU_H
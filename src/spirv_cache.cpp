@@ -0,0 +1,201 @@
+// rife implemented with ncnn library
+
+#include "spirv_cache.h"
+
+#include <stdio.h>
+
+#if _WIN32
+#include <windows.h>
+#else // _WIN32
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif // _WIN32
+
+#if _WIN32
+static std::wstring spirv_cache_dir;
+#else
+static std::string spirv_cache_dir;
+#endif
+
+// bump when the file layout changes
+static const uint32_t spirv_cache_version = 1;
+
+#if _WIN32
+int set_spirv_cache_dir(const std::wstring& dirpath)
+{
+    spirv_cache_dir = dirpath;
+
+    if (spirv_cache_dir.empty())
+        return 0;
+
+    if (!CreateDirectoryW(spirv_cache_dir.c_str(), NULL) && GetLastError() != ERROR_ALREADY_EXISTS)
+    {
+        fwprintf(stderr, L"create cache directory failed %ls\n", spirv_cache_dir.c_str());
+        spirv_cache_dir.clear();
+        return -1;
+    }
+
+    return 0;
+}
+#else // _WIN32
+int set_spirv_cache_dir(const std::string& dirpath)
+{
+    spirv_cache_dir = dirpath;
+
+    if (spirv_cache_dir.empty())
+        return 0;
+
+    struct stat s;
+    if (stat(spirv_cache_dir.c_str(), &s) != 0 && mkdir(spirv_cache_dir.c_str(), 0755) != 0)
+    {
+        fprintf(stderr, "create cache directory failed %s\n", spirv_cache_dir.c_str());
+        spirv_cache_dir.clear();
+        return -1;
+    }
+
+    return 0;
+}
+#endif // _WIN32
+
+// 64bit fnv-1a
+static uint64_t hash_bytes(uint64_t hash, const void* data, size_t size)
+{
+    const unsigned char* p = (const unsigned char*)data;
+    for (size_t i = 0; i < size; i++)
+    {
+        hash ^= p[i];
+        hash *= 0x100000001b3ULL;
+    }
+    return hash;
+}
+
+static uint64_t spirv_cache_key(const ncnn::VulkanDevice* vkdev, const char* comp_data, int comp_data_size, const ncnn::Option& opt)
+{
+    uint64_t hash = 0xcbf29ce484222325ULL;
+
+    hash = hash_bytes(hash, &spirv_cache_version, sizeof(spirv_cache_version));
+
+    const ncnn::GpuInfo& info = vkdev->info;
+    const uint32_t ids[3] = {info.vendor_id(), info.device_id(), info.driver_version()};
+    hash = hash_bytes(hash, ids, sizeof(ids));
+    hash = hash_bytes(hash, info.pipeline_cache_uuid(), 16);
+
+    // the option flags that turn into shader macros
+    const unsigned char flags[6] = {
+        (unsigned char)opt.use_fp16_packed,
+        (unsigned char)opt.use_fp16_storage,
+        (unsigned char)opt.use_fp16_arithmetic,
+        (unsigned char)opt.use_int8_storage,
+        (unsigned char)opt.use_int8_arithmetic,
+        (unsigned char)opt.use_shader_pack8
+    };
+    hash = hash_bytes(hash, flags, sizeof(flags));
+
+    hash = hash_bytes(hash, comp_data, comp_data_size);
+
+    return hash;
+}
+
+#if _WIN32
+static std::wstring spirv_cache_path(uint64_t key, const char* suffix)
+{
+    wchar_t name[64];
+    swprintf(name, 64, L"%016llx%hs", (unsigned long long)key, suffix);
+    return spirv_cache_dir + L"\\" + name;
+}
+#else // _WIN32
+static std::string spirv_cache_path(uint64_t key, const char* suffix)
+{
+    char name[64];
+    sprintf(name, "%016llx%s", (unsigned long long)key, suffix);
+    return spirv_cache_dir + "/" + name;
+}
+#endif // _WIN32
+
+static int load_spirv_cache(uint64_t key, std::vector<uint32_t>& spirv)
+{
+#if _WIN32
+    FILE* fp = _wfopen(spirv_cache_path(key, ".spv").c_str(), L"rb");
+#else
+    FILE* fp = fopen(spirv_cache_path(key, ".spv").c_str(), "rb");
+#endif
+    if (!fp)
+        return -1;
+
+    fseek(fp, 0, SEEK_END);
+    long size = ftell(fp);
+    rewind(fp);
+
+    // anything but whole words starting with the spirv magic is a broken entry
+    if (size <= 0 || size % 4 != 0)
+    {
+        fclose(fp);
+        return -1;
+    }
+
+    spirv.resize(size / 4);
+    size_t nread = fread(spirv.data(), 4, spirv.size(), fp);
+    fclose(fp);
+
+    if (nread != spirv.size() || spirv[0] != 0x07230203)
+    {
+        spirv.clear();
+        return -1;
+    }
+
+    return 0;
+}
+
+static void save_spirv_cache(uint64_t key, const std::vector<uint32_t>& spirv)
+{
+    // write aside and rename, so concurrent launches never read a partial file
+    char suffix[32];
+#if _WIN32
+    sprintf(suffix, ".%lu.tmp", (unsigned long)GetCurrentProcessId());
+#else
+    sprintf(suffix, ".%ld.tmp", (long)getpid());
+#endif
+
+#if _WIN32
+    std::wstring tmppath = spirv_cache_path(key, suffix);
+    std::wstring path = spirv_cache_path(key, ".spv");
+    FILE* fp = _wfopen(tmppath.c_str(), L"wb");
+#else
+    std::string tmppath = spirv_cache_path(key, suffix);
+    std::string path = spirv_cache_path(key, ".spv");
+    FILE* fp = fopen(tmppath.c_str(), "wb");
+#endif
+    if (!fp)
+        return;
+
+    size_t nwrite = fwrite(spirv.data(), 4, spirv.size(), fp);
+    fclose(fp);
+
+#if _WIN32
+    if (nwrite != spirv.size() || !MoveFileExW(tmppath.c_str(), path.c_str(), MOVEFILE_REPLACE_EXISTING))
+        DeleteFileW(tmppath.c_str());
+#else
+    if (nwrite != spirv.size() || rename(tmppath.c_str(), path.c_str()) != 0)
+        unlink(tmppath.c_str());
+#endif
+}
+
+int compile_spirv_module_cached(const ncnn::VulkanDevice* vkdev, const char* comp_data, int comp_data_size, const ncnn::Option& opt, std::vector<uint32_t>& spirv)
+{
+    if (spirv_cache_dir.empty() || !vkdev)
+        return ncnn::compile_spirv_module(comp_data, comp_data_size, opt, spirv);
+
+    const uint64_t key = spirv_cache_key(vkdev, comp_data, comp_data_size, opt);
+
+    if (load_spirv_cache(key, spirv) == 0)
+        return 0;
+
+    int ret = ncnn::compile_spirv_module(comp_data, comp_data_size, opt, spirv);
+    if (ret != 0)
+        return ret;
+
+    save_spirv_cache(key, spirv);
+
+    return 0;
+}
@@ -0,0 +1,23 @@
+// rife implemented with ncnn library
+
+#ifndef SPIRV_CACHE_H
+#define SPIRV_CACHE_H
+
+#include <string>
+#include <vector>
+
+// ncnn
+#include "gpu.h"
+#include "option.h"
+
+// directory keeping compiled spirv across runs, empty disables the disk cache
+#if _WIN32
+int set_spirv_cache_dir(const std::wstring& dirpath);
+#else
+int set_spirv_cache_dir(const std::string& dirpath);
+#endif
+
+// compile_spirv_module, looked up on disk first by device, driver, option flags and shader source
+int compile_spirv_module_cached(const ncnn::VulkanDevice* vkdev, const char* comp_data, int comp_data_size, const ncnn::Option& opt, std::vector<uint32_t>& spirv);
+
+#endif // SPIRV_CACHE_H
@@ -0,0 +1,516 @@
+#ifndef STREAM_IO_H
+#define STREAM_IO_H
+
+// yuv4mpeg2 and raw rgb24 frame streams on stdin and stdout
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#if __SSE2__
+#include <emmintrin.h>
+#endif
+#if __ARM_NEON
+#include <arm_neon.h>
+#endif
+
+// ncnn
+#include "mat.h"
+
+class StreamFormat
+{
+public:
+    int y4m;// 0=raw rgb24 1=yuv4mpeg2
+    int w;
+    int h;
+    int chroma;// 420 or 444
+    int full_range;
+
+    // y4m stream header parameters other than size, frame rate and colorspace, passed through to the output
+    std::string params;
+    int fps_num;
+    int fps_den;
+    std::string colorspace;
+
+    size_t frame_size() const
+    {
+        if (!y4m)
+            return (size_t)w * h * 3;
+
+        if (chroma == 444)
+            return (size_t)w * h * 3;
+
+        return (size_t)w * h + (size_t)((w + 1) / 2) * ((h + 1) / 2) * 2;
+    }
+};
+
+static int stream_read_line(FILE* fp, std::string& line)
+{
+    line.clear();
+    for (;;)
+    {
+        int c = fgetc(fp);
+        if (c == EOF)
+            return line.empty() ? -1 : 0;
+        if (c == '\n')
+            return 0;
+        line += (char)c;
+    }
+}
+
+// the raw rgb24 size comes from the command line, y4m carries its own header
+static int stream_read_header(FILE* fp, StreamFormat& format)
+{
+    if (!format.y4m)
+        return format.w > 0 && format.h > 0 ? 0 : -1;
+
+    std::string line;
+    if (stream_read_line(fp, line) != 0 || line.compare(0, 9, "YUV4MPEG2") != 0)
+    {
+        fprintf(stderr, "input stream is not yuv4mpeg2\n");
+        return -1;
+    }
+
+    format.w = 0;
+    format.h = 0;
+    format.chroma = 420;
+    format.full_range = 0;
+    format.fps_num = 0;
+    format.fps_den = 0;
+    format.colorspace = "420jpeg";
+    format.params.clear();
+
+    size_t pos = 9;
+    while (pos < line.size())
+    {
+        size_t end = line.find(' ', pos + 1);
+        if (end == std::string::npos)
+            end = line.size();
+
+        std::string token = line.substr(pos + 1, end - pos - 1);
+        pos = end;
+
+        if (token.empty())
+            continue;
+
+        switch (token[0])
+        {
+        case 'W':
+            format.w = atoi(token.c_str() + 1);
+            break;
+        case 'H':
+            format.h = atoi(token.c_str() + 1);
+            break;
+        case 'F':
+            sscanf(token.c_str() + 1, "%d:%d", &format.fps_num, &format.fps_den);
+            break;
+        case 'C':
+            format.colorspace = token.substr(1);
+            break;
+        default:
+            if (token == "XCOLORRANGE=FULL")
+                format.full_range = 1;
+            format.params += " " + token;
+            break;
+        }
+    }
+
+    if (format.colorspace == "444")
+    {
+        format.chroma = 444;
+    }
+    else if (format.colorspace != "420" && format.colorspace != "420jpeg" && format.colorspace != "420paldv" && format.colorspace != "420mpeg2")
+    {
+        fprintf(stderr, "unsupported yuv4mpeg2 colorspace %s, only 8bit 420 and 444\n", format.colorspace.c_str());
+        return -1;
+    }
+
+    if (format.w <= 0 || format.h <= 0)
+    {
+        fprintf(stderr, "invalid yuv4mpeg2 frame size\n");
+        return -1;
+    }
+
+    return 0;
+}
+
+// the output runs at twice the input frame rate
+static int stream_write_header(FILE* fp, const StreamFormat& format)
+{
+    if (!format.y4m)
+        return 0;
+
+    fprintf(fp, "YUV4MPEG2 W%d H%d", format.w, format.h);
+    if (format.fps_num > 0 && format.fps_den > 0)
+        fprintf(fp, " F%d:%d", format.fps_num * 2, format.fps_den);
+    fprintf(fp, " C%s%s\n", format.colorspace.c_str(), format.params.c_str());
+
+    return ferror(fp) ? -1 : 0;
+}
+
+static int stream_read_frame(FILE* fp, const StreamFormat& format, ncnn::Mat& raw, ncnn::Allocator* allocator = 0)
+{
+    if (format.y4m)
+    {
+        std::string line;
+        if (stream_read_line(fp, line) != 0)
+            return -1;
+
+        if (line.compare(0, 5, "FRAME") != 0)
+        {
+            fprintf(stderr, "invalid yuv4mpeg2 frame header\n");
+            return -1;
+        }
+    }
+
+    const size_t size = format.frame_size();
+
+    raw.create((int)size, (size_t)1u, allocator);
+    if (fread(raw.data, 1, size, fp) != size)
+    {
+        raw.release();
+        return -1;
+    }
+
+    return 0;
+}
+
+static int stream_write_frame(FILE* fp, const StreamFormat& format, const ncnn::Mat& raw)
+{
+    if (format.y4m)
+        fputs("FRAME\n", fp);
+
+    fwrite(raw.data, 1, format.frame_size(), fp);
+
+    return ferror(fp) ? -1 : 0;
+}
+
+// bt.601 in 8bit, studio swing unless the stream says full range
+class YuvCoeffs
+{
+public:
+    float y_offset;
+    float y_scale;
+    float rv;
+    float gu;
+    float gv;
+    float bu;
+
+    YuvCoeffs(int full_range)
+    {
+        y_offset = full_range ? 0.f : 16.f;
+        y_scale = full_range ? 1.f : 255.f / 219.f;
+
+        const float c_scale = full_range ? 1.f : 255.f / 224.f;
+        rv = 1.402f * c_scale;
+        gu = -0.344136f * c_scale;
+        gv = -0.714136f * c_scale;
+        bu = 1.772f * c_scale;
+    }
+};
+
+static inline unsigned char yuv_clamp(float v)
+{
+    int i = (int)(v + 0.5f);
+    return (unsigned char)(i < 0 ? 0 : i > 255 ? 255 : i);
+}
+
+// convert one row of full resolution y u v planes to interleaved rgb, bgr on windows
+static void yuv_to_rgb_row(const unsigned char* yptr, const unsigned char* uptr, const unsigned char* vptr, unsigned char* rgb, int w, const YuvCoeffs& k)
+{
+#if _WIN32
+    const int ri = 2;
+    const int bi = 0;
+#else
+    const int ri = 0;
+    const int bi = 2;
+#endif
+
+    int x = 0;
+#if __SSE2__
+    {
+        unsigned char rtmp[16];
+        unsigned char gtmp[16];
+        unsigned char btmp[16];
+
+        const __m128 _y_offset = _mm_set1_ps(k.y_offset);
+        const __m128 _y_scale = _mm_set1_ps(k.y_scale);
+        const __m128 _c_offset = _mm_set1_ps(128.f);
+        const __m128 _rv = _mm_set1_ps(k.rv);
+        const __m128 _gu = _mm_set1_ps(k.gu);
+        const __m128 _gv = _mm_set1_ps(k.gv);
+        const __m128 _bu = _mm_set1_ps(k.bu);
+        const __m128 _half = _mm_set1_ps(0.5f);
+        const __m128i _zero = _mm_setzero_si128();
+
+        for (; x + 15 < w; x += 16)
+        {
+            __m128i _y8 = _mm_loadu_si128((const __m128i*)(yptr + x));
+            __m128i _u8 = _mm_loadu_si128((const __m128i*)(uptr + x));
+            __m128i _v8 = _mm_loadu_si128((const __m128i*)(vptr + x));
+
+            __m128i _y16[2] = {_mm_unpacklo_epi8(_y8, _zero), _mm_unpackhi_epi8(_y8, _zero)};
+            __m128i _u16[2] = {_mm_unpacklo_epi8(_u8, _zero), _mm_unpackhi_epi8(_u8, _zero)};
+            __m128i _v16[2] = {_mm_unpacklo_epi8(_v8, _zero), _mm_unpackhi_epi8(_v8, _zero)};
+
+            __m128i _r32[4];
+            __m128i _g32[4];
+            __m128i _b32[4];
+            for (int q = 0; q < 4; q++)
+            {
+                __m128i _yi = (q & 1) ? _mm_unpackhi_epi16(_y16[q / 2], _zero) : _mm_unpacklo_epi16(_y16[q / 2], _zero);
+                __m128i _ui = (q & 1) ? _mm_unpackhi_epi16(_u16[q / 2], _zero) : _mm_unpacklo_epi16(_u16[q / 2], _zero);
+                __m128i _vi = (q & 1) ? _mm_unpackhi_epi16(_v16[q / 2], _zero) : _mm_unpacklo_epi16(_v16[q / 2], _zero);
+
+                __m128 _y = _mm_mul_ps(_mm_sub_ps(_mm_cvtepi32_ps(_yi), _y_offset), _y_scale);
+                __m128 _u = _mm_sub_ps(_mm_cvtepi32_ps(_ui), _c_offset);
+                __m128 _v = _mm_sub_ps(_mm_cvtepi32_ps(_vi), _c_offset);
+
+                __m128 _r = _mm_add_ps(_mm_add_ps(_y, _mm_mul_ps(_v, _rv)), _half);
+                __m128 _g = _mm_add_ps(_mm_add_ps(_y, _mm_add_ps(_mm_mul_ps(_u, _gu), _mm_mul_ps(_v, _gv))), _half);
+                __m128 _b = _mm_add_ps(_mm_add_ps(_y, _mm_mul_ps(_u, _bu)), _half);
+
+                // truncate like yuv_clamp, packus saturates to 0~255
+                _r32[q] = _mm_cvttps_epi32(_r);
+                _g32[q] = _mm_cvttps_epi32(_g);
+                _b32[q] = _mm_cvttps_epi32(_b);
+            }
+
+            _mm_storeu_si128((__m128i*)rtmp, _mm_packus_epi16(_mm_packs_epi32(_r32[0], _r32[1]), _mm_packs_epi32(_r32[2], _r32[3])));
+            _mm_storeu_si128((__m128i*)gtmp, _mm_packus_epi16(_mm_packs_epi32(_g32[0], _g32[1]), _mm_packs_epi32(_g32[2], _g32[3])));
+            _mm_storeu_si128((__m128i*)btmp, _mm_packus_epi16(_mm_packs_epi32(_b32[0], _b32[1]), _mm_packs_epi32(_b32[2], _b32[3])));
+
+            unsigned char* outptr = rgb + x * 3;
+            for (int i = 0; i < 16; i++)
+            {
+                outptr[ri] = rtmp[i];
+                outptr[1] = gtmp[i];
+                outptr[bi] = btmp[i];
+                outptr += 3;
+            }
+        }
+    }
+#elif __ARM_NEON
+    {
+        const float32x4_t _y_offset = vdupq_n_f32(k.y_offset);
+        const float32x4_t _c_offset = vdupq_n_f32(128.f);
+        const float32x4_t _half = vdupq_n_f32(0.5f);
+
+        for (; x + 15 < w; x += 16)
+        {
+            uint8x16_t _y8 = vld1q_u8(yptr + x);
+            uint8x16_t _u8 = vld1q_u8(uptr + x);
+            uint8x16_t _v8 = vld1q_u8(vptr + x);
+
+            uint16x8_t _y16[2] = {vmovl_u8(vget_low_u8(_y8)), vmovl_u8(vget_high_u8(_y8))};
+            uint16x8_t _u16[2] = {vmovl_u8(vget_low_u8(_u8)), vmovl_u8(vget_high_u8(_u8))};
+            uint16x8_t _v16[2] = {vmovl_u8(vget_low_u8(_v8)), vmovl_u8(vget_high_u8(_v8))};
+
+            int16x4_t _r16[4];
+            int16x4_t _g16[4];
+            int16x4_t _b16[4];
+            for (int q = 0; q < 4; q++)
+            {
+                uint32x4_t _yi = (q & 1) ? vmovl_u16(vget_high_u16(_y16[q / 2])) : vmovl_u16(vget_low_u16(_y16[q / 2]));
+                uint32x4_t _ui = (q & 1) ? vmovl_u16(vget_high_u16(_u16[q / 2])) : vmovl_u16(vget_low_u16(_u16[q / 2]));
+                uint32x4_t _vi = (q & 1) ? vmovl_u16(vget_high_u16(_v16[q / 2])) : vmovl_u16(vget_low_u16(_v16[q / 2]));
+
+                float32x4_t _y = vmulq_n_f32(vsubq_f32(vcvtq_f32_u32(_yi), _y_offset), k.y_scale);
+                float32x4_t _u = vsubq_f32(vcvtq_f32_u32(_ui), _c_offset);
+                float32x4_t _v = vsubq_f32(vcvtq_f32_u32(_vi), _c_offset);
+
+                float32x4_t _r = vaddq_f32(vaddq_f32(_y, vmulq_n_f32(_v, k.rv)), _half);
+                float32x4_t _g = vaddq_f32(vaddq_f32(_y, vaddq_f32(vmulq_n_f32(_u, k.gu), vmulq_n_f32(_v, k.gv))), _half);
+                float32x4_t _b = vaddq_f32(vaddq_f32(_y, vmulq_n_f32(_u, k.bu)), _half);
+
+                _r16[q] = vqmovn_s32(vcvtq_s32_f32(_r));
+                _g16[q] = vqmovn_s32(vcvtq_s32_f32(_g));
+                _b16[q] = vqmovn_s32(vcvtq_s32_f32(_b));
+            }
+
+            uint8x16x3_t _rgb;
+            _rgb.val[ri] = vcombine_u8(vqmovun_s16(vcombine_s16(_r16[0], _r16[1])), vqmovun_s16(vcombine_s16(_r16[2], _r16[3])));
+            _rgb.val[1] = vcombine_u8(vqmovun_s16(vcombine_s16(_g16[0], _g16[1])), vqmovun_s16(vcombine_s16(_g16[2], _g16[3])));
+            _rgb.val[bi] = vcombine_u8(vqmovun_s16(vcombine_s16(_b16[0], _b16[1])), vqmovun_s16(vcombine_s16(_b16[2], _b16[3])));
+            vst3q_u8(rgb + x * 3, _rgb);
+        }
+    }
+#endif
+    for (; x < w; x++)
+    {
+        float y = (yptr[x] - k.y_offset) * k.y_scale;
+        float u = uptr[x] - 128.f;
+        float v = vptr[x] - 128.f;
+
+        rgb[x * 3 + ri] = yuv_clamp(y + v * k.rv);
+        rgb[x * 3 + 1] = yuv_clamp(y + u * k.gu + v * k.gv);
+        rgb[x * 3 + bi] = yuv_clamp(y + u * k.bu);
+    }
+}
+
+// decode one frame as read from the stream into interleaved rgb, bgr on windows
+static void stream_frame_to_image(const StreamFormat& format, const ncnn::Mat& raw, ncnn::Mat& image, int num_threads, ncnn::Allocator* allocator = 0)
+{
+    const int w = format.w;
+    const int h = format.h;
+
+    image.create(w, h, (size_t)3u, 3, allocator);
+
+    const unsigned char* src = (const unsigned char*)raw.data;
+    unsigned char* dst = (unsigned char*)image.data;
+
+    if (!format.y4m)
+    {
+#if _WIN32
+        #pragma omp parallel for num_threads(num_threads)
+        for (int i = 0; i < h; i++)
+        {
+            const unsigned char* ptr = src + (size_t)i * w * 3;
+            unsigned char* outptr = dst + (size_t)i * w * 3;
+            for (int j = 0; j < w; j++)
+            {
+                outptr[0] = ptr[2];
+                outptr[1] = ptr[1];
+                outptr[2] = ptr[0];
+                ptr += 3;
+                outptr += 3;
+            }
+        }
+#else
+        (void)num_threads;
+        memcpy(dst, src, (size_t)w * h * 3);
+#endif
+        return;
+    }
+
+    const YuvCoeffs k(format.full_range);
+
+    const int cw = format.chroma == 444 ? w : (w + 1) / 2;
+    const int ch = format.chroma == 444 ? h : (h + 1) / 2;
+    const unsigned char* yplane = src;
+    const unsigned char* uplane = yplane + (size_t)w * h;
+    const unsigned char* vplane = uplane + (size_t)cw * ch;
+
+    #pragma omp parallel for num_threads(num_threads)
+    for (int i = 0; i < h; i++)
+    {
+        const unsigned char* yptr = yplane + (size_t)i * w;
+        const unsigned char* uptr;
+        const unsigned char* vptr;
+
+        std::vector<unsigned char> urow;
+        std::vector<unsigned char> vrow;
+        if (format.chroma == 444)
+        {
+            uptr = uplane + (size_t)i * w;
+            vptr = vplane + (size_t)i * w;
+        }
+        else
+        {
+            // nearest upsampling of the half resolution chroma
+            urow.resize(w);
+            vrow.resize(w);
+
+            const unsigned char* cuptr = uplane + (size_t)(i / 2) * cw;
+            const unsigned char* cvptr = vplane + (size_t)(i / 2) * cw;
+            for (int j = 0; j < w; j++)
+            {
+                urow[j] = cuptr[j / 2];
+                vrow[j] = cvptr[j / 2];
+            }
+
+            uptr = urow.data();
+            vptr = vrow.data();
+        }
+
+        yuv_to_rgb_row(yptr, uptr, vptr, dst + (size_t)i * w * 3, w, k);
+    }
+}
+
+// encode interleaved rgb, bgr on windows, into one frame of the stream format
+static void stream_image_to_frame(const StreamFormat& format, const ncnn::Mat& image, ncnn::Mat& raw, ncnn::Allocator* allocator = 0)
+{
+    const int w = format.w;
+    const int h = format.h;
+
+    raw.create((int)format.frame_size(), (size_t)1u, allocator);
+
+    const unsigned char* src = (const unsigned char*)image.data;
+    unsigned char* dst = (unsigned char*)raw.data;
+
+#if _WIN32
+    const int ri = 2;
+    const int bi = 0;
+#else
+    const int ri = 0;
+    const int bi = 2;
+#endif
+
+    if (!format.y4m)
+    {
+        for (size_t i = 0; i < (size_t)w * h; i++)
+        {
+            dst[i * 3] = src[i * 3 + ri];
+            dst[i * 3 + 1] = src[i * 3 + 1];
+            dst[i * 3 + 2] = src[i * 3 + bi];
+        }
+        return;
+    }
+
+    const float y_offset = format.full_range ? 0.f : 16.f;
+    const float y_scale = format.full_range ? 1.f : 219.f / 255.f;
+    const float c_scale = format.full_range ? 1.f : 224.f / 255.f;
+
+    const int cw = format.chroma == 444 ? w : (w + 1) / 2;
+    const int ch = format.chroma == 444 ? h : (h + 1) / 2;
+    unsigned char* yplane = dst;
+    unsigned char* uplane = yplane + (size_t)w * h;
+    unsigned char* vplane = uplane + (size_t)cw * ch;
+
+    for (int i = 0; i < h; i++)
+    {
+        const unsigned char* ptr = src + (size_t)i * w * 3;
+        unsigned char* yptr = yplane + (size_t)i * w;
+        for (int j = 0; j < w; j++)
+        {
+            yptr[j] = yuv_clamp(y_offset + (0.299f * ptr[ri] + 0.587f * ptr[1] + 0.114f * ptr[bi]) * y_scale);
+            ptr += 3;
+        }
+    }
+
+    // chroma of the average of each 2x2 block in 420
+    const int step = format.chroma == 444 ? 1 : 2;
+    for (int i = 0; i < ch; i++)
+    {
+        unsigned char* uptr = uplane + (size_t)i * cw;
+        unsigned char* vptr = vplane + (size_t)i * cw;
+        for (int j = 0; j < cw; j++)
+        {
+            float r = 0.f;
+            float g = 0.f;
+            float b = 0.f;
+            int n = 0;
+            for (int y = i * step; y < std::min(i * step + step, h); y++)
+            {
+                for (int x = j * step; x < std::min(j * step + step, w); x++)
+                {
+                    const unsigned char* ptr = src + ((size_t)y * w + x) * 3;
+                    r += ptr[ri];
+                    g += ptr[1];
+                    b += ptr[bi];
+                    n++;
+                }
+            }
+            r /= n;
+            g /= n;
+            b /= n;
+
+            uptr[j] = yuv_clamp(128.f + (-0.168736f * r - 0.331264f * g + 0.5f * b) * c_scale);
+            vptr[j] = yuv_clamp(128.f + (0.5f * r - 0.418688f * g - 0.081312f * b) * c_scale);
+        }
+    }
+}
+
+#endif // STREAM_IO_H
@@ -0,0 +1,304 @@
+// rife implemented with ncnn library
+
+#ifndef TASK_QUEUE_H
+#define TASK_QUEUE_H
+
+#include <stddef.h>
+#include <atomic>
+#include <utility>
+#include <vector>
+
+// ncnn
+#include "mat.h"
+#include "platform.h"
+
+#include "filesystem_utils.h"
+
+// all output frames interpolated from the same pair of source frames
+class Task
+{
+public:
+    int id;
+    int in0index;
+    int in1index;
+
+    path_t in0path;
+    path_t in1path;
+    std::vector<path_t> outpaths;
+    std::vector<float> timesteps;
+
+    ncnn::Mat in0image;
+    ncnn::Mat in1image;
+    std::vector<ncnn::Mat> outimages;
+
+    // stream mode, source frames as read so that they are written back untouched
+    ncnn::Mat in0raw;
+    ncnn::Mat in1raw;
+
+    // inputs uploaded ahead of proc in async mode
+    int slot;
+    ncnn::VkMat in0_gpu;
+    ncnn::VkMat in1_gpu;
+};
+
+// pixel memory held by a task, source frames shared with other tasks are counted for each of them
+static size_t task_bytes(const Task& v)
+{
+    size_t bytes = v.in0image.total() * v.in0image.elemsize + v.in1image.total() * v.in1image.elemsize;
+    bytes += v.in0raw.total() * v.in0raw.elemsize + v.in1raw.total() * v.in1raw.elemsize;
+    for (size_t i=0; i<v.outimages.size(); i++)
+    {
+        bytes += v.outimages[i].total() * v.outimages[i].elemsize;
+    }
+
+    return bytes;
+}
+
+// ncnn mats are copied by reference count even when the task is moved
+// drop the references left in the moved from task, so an idle queue slot never holds frames
+static void release_task_frames(Task& v)
+{
+    v.in0image.release();
+    v.in1image.release();
+    v.in0raw.release();
+    v.in1raw.release();
+    v.in0_gpu.release();
+    v.in1_gpu.release();
+}
+
+// bounded lock-free ring of preallocated task slots, for many producers and many consumers
+// tasks are moved in and out of the slots, so put and get neither copy frames, paths and vectors nor allocate
+// bounded by task count and by the pixel memory of the queued tasks, whichever is reached first
+// a task larger than the whole budget is still let into an empty queue
+// put and get only touch the lock when they have to sleep, full and empty waiters are woken separately
+class TaskQueue
+{
+public:
+    TaskQueue() : cells(0), capacity(0), max_bytes(0), bytes(0), enqueue_pos(0), dequeue_pos(0), waiting_put(0), waiting_get(0)
+    {
+        set_limits(8, 0);
+    }
+
+    ~TaskQueue()
+    {
+        clear();
+    }
+
+    // only while no thread is using the queue
+    void set_limits(int count, size_t membytes)
+    {
+        clear();
+
+        capacity = count;
+        cells = new Cell[capacity];
+        for (size_t i=0; i<capacity; i++)
+        {
+            cells[i].sequence.store(i, std::memory_order_relaxed);
+            cells[i].bytes = 0;
+        }
+
+        max_bytes = membytes;
+        bytes.store(0);
+        enqueue_pos.store(0);
+        dequeue_pos.store(0);
+    }
+
+    // v is moved into the queue and left empty
+    void put(Task& v)
+    {
+        const size_t tbytes = task_bytes(v);
+
+        while (!reserve(tbytes))
+        {
+            lock.lock();
+            waiting_put++;
+            bool ok = reserve(tbytes);
+            if (!ok)
+                not_full.wait(lock);
+            waiting_put--;
+            lock.unlock();
+
+            if (ok)
+                break;
+        }
+
+        while (!try_push(v, tbytes))
+        {
+            lock.lock();
+            waiting_put++;
+            bool ok = try_push(v, tbytes);
+            if (!ok)
+                not_full.wait(lock);
+            waiting_put--;
+            lock.unlock();
+
+            if (ok)
+                break;
+        }
+
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (waiting_get.load() > 0)
+        {
+            lock.lock();
+            not_empty.signal();
+            lock.unlock();
+        }
+    }
+
+    void get(Task& v)
+    {
+        size_t tbytes = 0;
+
+        while (!try_pop(v, tbytes))
+        {
+            lock.lock();
+            waiting_get++;
+            bool ok = try_pop(v, tbytes);
+            if (!ok)
+                not_empty.wait(lock);
+            waiting_get--;
+            lock.unlock();
+
+            if (ok)
+                break;
+        }
+
+        release(tbytes);
+    }
+
+    // false right away when the queue is empty
+    bool try_get(Task& v)
+    {
+        size_t tbytes = 0;
+
+        if (!try_pop(v, tbytes))
+            return false;
+
+        release(tbytes);
+        return true;
+    }
+
+private:
+    void release(size_t tbytes)
+    {
+        bytes.fetch_sub(tbytes);
+
+        // a freed slot or freed bytes may admit any of the blocked producers
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (waiting_put.load() > 0)
+        {
+            lock.lock();
+            not_full.broadcast();
+            lock.unlock();
+        }
+    }
+
+    void clear()
+    {
+        if (!cells)
+            return;
+
+        delete[] cells;
+        cells = 0;
+    }
+
+    bool reserve(size_t tbytes)
+    {
+        size_t current = bytes.load();
+        for (;;)
+        {
+            if (max_bytes && current != 0 && current + tbytes > max_bytes)
+                return false;
+
+            if (bytes.compare_exchange_weak(current, current + tbytes))
+                return true;
+        }
+    }
+
+    bool try_push(Task& v, size_t tbytes)
+    {
+        Cell* cell;
+        size_t pos = enqueue_pos.load(std::memory_order_relaxed);
+        for (;;)
+        {
+            cell = &cells[pos % capacity];
+            size_t seq = cell->sequence.load(std::memory_order_acquire);
+            ptrdiff_t dif = (ptrdiff_t)seq - (ptrdiff_t)pos;
+            if (dif == 0)
+            {
+                if (enqueue_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                    break;
+            }
+            else if (dif < 0)
+            {
+                return false;
+            }
+            else
+            {
+                pos = enqueue_pos.load(std::memory_order_relaxed);
+            }
+        }
+
+        cell->task = std::move(v);
+        release_task_frames(v);
+        cell->bytes = tbytes;
+        cell->sequence.store(pos + 1, std::memory_order_release);
+        return true;
+    }
+
+    bool try_pop(Task& v, size_t& tbytes)
+    {
+        Cell* cell;
+        size_t pos = dequeue_pos.load(std::memory_order_relaxed);
+        for (;;)
+        {
+            cell = &cells[pos % capacity];
+            size_t seq = cell->sequence.load(std::memory_order_acquire);
+            ptrdiff_t dif = (ptrdiff_t)seq - (ptrdiff_t)(pos + 1);
+            if (dif == 0)
+            {
+                if (dequeue_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                    break;
+            }
+            else if (dif < 0)
+            {
+                return false;
+            }
+            else
+            {
+                pos = dequeue_pos.load(std::memory_order_relaxed);
+            }
+        }
+
+        v = std::move(cell->task);
+        tbytes = cell->bytes;
+
+        release_task_frames(cell->task);
+        cell->sequence.store(pos + capacity, std::memory_order_release);
+        return true;
+    }
+
+    // sequence == pos when free for the producer at pos, pos + 1 when filled for the consumer at pos
+    struct Cell
+    {
+        std::atomic<size_t> sequence;
+        Task task;
+        size_t bytes;
+    };
+
+    Cell* cells;
+    size_t capacity;
+    size_t max_bytes;
+    std::atomic<size_t> bytes;
+    std::atomic<size_t> enqueue_pos;
+    std::atomic<size_t> dequeue_pos;
+
+    // sleepers are counted under the lock, so a wakeup is never lost between the failed try and the wait
+    std::atomic<int> waiting_put;
+    std::atomic<int> waiting_get;
+    ncnn::Mutex lock;
+    ncnn::ConditionVariable not_full;
+    ncnn::ConditionVariable not_empty;
+};
+
+#endif // TASK_QUEUE_H
@@ -0,0 +1,182 @@
+// rife implemented with ncnn library
+
+#include "trace.h"
+
+#include <math.h>
+#include <string.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+
+// ncnn
+#include "platform.h"
+
+class TraceEvent
+{
+public:
+    const char* stage;
+    int device;
+    int tid;
+    int id;
+    double start;
+    double end;
+};
+
+static bool enabled = false;
+
+static ncnn::Mutex lock;
+static std::vector<TraceEvent> events;
+
+// small sequential thread ids keep the trace viewer rows in thread creation order
+static std::atomic<int> next_tid(0);
+static thread_local int tid = -1;
+
+static const std::chrono::steady_clock::time_point epoch = std::chrono::steady_clock::now();
+
+void trace_enable()
+{
+    enabled = true;
+}
+
+bool trace_enabled()
+{
+    return enabled;
+}
+
+double trace_now()
+{
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - epoch).count();
+}
+
+void trace_event(const char* stage, int device, double start, double end, int id)
+{
+    if (tid == -1)
+        tid = next_tid++;
+
+    TraceEvent e;
+    e.stage = stage;
+    e.device = device;
+    e.tid = tid;
+    e.id = id;
+    e.start = start;
+    e.end = end;
+
+    lock.lock();
+    events.push_back(e);
+    lock.unlock();
+}
+
+int trace_write(FILE* fp)
+{
+    lock.lock();
+
+    // process 0 holds the host stages, process g+1 the stages timed on gpu g
+    std::vector<int> devices;
+    for (size_t i=0; i<events.size(); i++)
+    {
+        if (std::find(devices.begin(), devices.end(), events[i].device) == devices.end())
+            devices.push_back(events[i].device);
+    }
+
+    fprintf(fp, "{\"traceEvents\":[\n");
+
+    for (size_t i=0; i<devices.size(); i++)
+    {
+        if (devices[i] == -1)
+            fprintf(fp, "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":0,\"args\":{\"name\":\"host\"}},\n");
+        else
+            fprintf(fp, "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%d,\"args\":{\"name\":\"gpu %d\"}},\n", devices[i] + 1, devices[i]);
+    }
+
+    for (size_t i=0; i<events.size(); i++)
+    {
+        const TraceEvent& e = events[i];
+
+        fprintf(fp, "{\"name\":\"%s\",\"ph\":\"X\",\"pid\":%d,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f", e.stage, e.device + 1, e.tid, e.start * 1000, (e.end - e.start) * 1000);
+
+        if (e.id != -1)
+            fprintf(fp, ",\"args\":{\"id\":%d}", e.id);
+
+        fprintf(fp, i + 1 < events.size() ? "},\n" : "}\n");
+    }
+
+    fprintf(fp, "]}\n");
+
+    lock.unlock();
+
+    return ferror(fp) ? -1 : 0;
+}
+
+// nearest rank
+static double percentile(const std::vector<double>& sorted, double p)
+{
+    size_t rank = (size_t)ceil(p * sorted.size());
+    return sorted[std::max(rank, (size_t)1) - 1];
+}
+
+void trace_summary(FILE* fp)
+{
+    std::map<std::pair<int, std::string>, std::vector<double> > durations;
+
+    lock.lock();
+    for (size_t i=0; i<events.size(); i++)
+    {
+        durations[std::make_pair(events[i].device, std::string(events[i].stage))].push_back(events[i].end - events[i].start);
+    }
+    lock.unlock();
+
+    fprintf(fp, "%-20s %6s %8s %12s %10s %10s %10s %10s\n", "stage", "device", "count", "total ms", "p50 ms", "p90 ms", "p99 ms", "max ms");
+
+    std::map<std::pair<int, std::string>, std::vector<double> >::iterator it = durations.begin();
+    for (; it != durations.end(); it++)
+    {
+        std::vector<double>& d = it->second;
+        std::sort(d.begin(), d.end());
+
+        double total = 0.0;
+        for (size_t i=0; i<d.size(); i++)
+        {
+            total += d[i];
+        }
+
+        char device[16];
+        if (it->first.first == -1)
+            sprintf(device, "host");
+        else
+            sprintf(device, "gpu%d", it->first.first);
+
+        fprintf(fp, "%-20s %6s %8d %12.1f %10.2f %10.2f %10.2f %10.2f\n", it->first.second.c_str(), device, (int)d.size(), total,
+                percentile(d, 0.5), percentile(d, 0.9), percentile(d, 0.99), d.back());
+    }
+}
+
+void trace_runs(FILE* fp, const char* kernel, int w, int h, std::vector<double>& ms)
+{
+    if (ms.empty())
+        return;
+
+    std::sort(ms.begin(), ms.end());
+
+    double mean = 0.0;
+    for (size_t i=0; i<ms.size(); i++)
+    {
+        mean += ms[i];
+    }
+    mean /= ms.size();
+
+    // sample standard deviation, its ratio to the mean tells whether two runs can be compared at all
+    double variance = 0.0;
+    for (size_t i=0; i<ms.size(); i++)
+    {
+        variance += (ms[i] - mean) * (ms[i] - mean);
+    }
+    const double stddev = ms.size() > 1 ? sqrt(variance / (ms.size() - 1)) : 0.0;
+    const double cv = mean > 0.0 ? stddev / mean : 0.0;
+
+    fprintf(fp, "{\"kernel\":\"%s\",\"width\":%d,\"height\":%d,\"runs\":%d,\"min_ms\":%.3f,\"median_ms\":%.3f,\"mean_ms\":%.3f,\"stddev_ms\":%.3f,\"cv\":%.4f,\"max_ms\":%.3f}\n",
+            kernel, w, h, (int)ms.size(), ms[0], percentile(ms, 0.5), mean, stddev, cv, ms.back());
+}
@@ -0,0 +1,51 @@
+// rife implemented with ncnn library
+
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stdio.h>
+#include <vector>
+
+// timing of every pipeline stage, off until trace_enable()
+// events are kept in memory and written once as chrome trace-event json, see chrome://tracing or ui.perfetto.dev
+void trace_enable();
+bool trace_enabled();
+
+// steady clock in milliseconds
+double trace_now();
+
+// one complete event on the calling thread
+// device is the gpu id for gpu stages and -1 for host stages, id is the task id or -1
+void trace_event(const char* stage, int device, double start, double end, int id = -1);
+
+// records the enclosing block, stage must be a string literal
+class TraceScope
+{
+public:
+    TraceScope(const char* _stage, int _device = -1, int _id = -1) : stage(_stage), device(_device), id(_id)
+    {
+        start = trace_enabled() ? trace_now() : 0.0;
+    }
+
+    ~TraceScope()
+    {
+        if (trace_enabled())
+            trace_event(stage, device, start, trace_now(), id);
+    }
+
+private:
+    const char* stage;
+    int device;
+    int id;
+    double start;
+};
+
+int trace_write(FILE* fp);
+
+// count, total and percentiles of every stage on every device
+void trace_summary(FILE* fp);
+
+// one json line with the min, median, mean, standard deviation, coefficient of variation and max of repeated runs of a microbenchmark on a WxH frame, sorts ms
+void trace_runs(FILE* fp, const char* kernel, int w, int h, std::vector<double>& ms);
+
+#endif // TRACE_H
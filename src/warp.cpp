@@ -1,6 +1,27 @@
 // rife implemented with ncnn library
 
 #include "rife_ops.h"
+#include "spirv_cache.h"
+
+// ncnn
+#include "cpu.h"
+
+#include <algorithm>
+
+#if __SSE2__
+#include <emmintrin.h>
+#if __AVX__
+#include <immintrin.h>
+#endif
+#endif
+#if __ARM_NEON
+#include <arm_neon.h>
+#endif
+
+#if RIFE_WARP_X86_AVX2
+// pack1 gather kernel in warp_x86_avx2.cpp, chosen at runtime
+int warp_row_pack1_avx2(const float* imageptr, const float* fxptr, const float* fyptr, float* outptr0, int w, int h, int y, int channels, size_t cstep, size_t out_cstep);
+#endif
 
 #include "warp.comp.hex.h"
 #include "warp_pack4.comp.hex.h"
@@ -19,6 +40,9 @@ Warp::Warp()
 
 int Warp::create_pipeline(const Option& opt)
 {
+    // packed blobs only on the cpu, the gpu keeps the pack1 shader the graph was exported with
+    support_packing = !opt.use_vulkan_compute;
+
     if (!vkdev)
         return 0;
 
@@ -32,7 +56,7 @@ int Warp::create_pipeline(const Option& opt)
             ncnn::MutexLockGuard guard(lock);
             if (spirv.empty())
             {
-                compile_spirv_module(warp_comp_data, sizeof(warp_comp_data), opt, spirv);
+                compile_spirv_module_cached(vkdev, warp_comp_data, sizeof(warp_comp_data), opt, spirv);
             }
         }
 
@@ -49,7 +73,7 @@ int Warp::create_pipeline(const Option& opt)
             ncnn::MutexLockGuard guard(lock);
             if (spirv.empty())
             {
-                compile_spirv_module(warp_pack4_comp_data, sizeof(warp_pack4_comp_data), opt, spirv);
+                compile_spirv_module_cached(vkdev, warp_pack4_comp_data, sizeof(warp_pack4_comp_data), opt, spirv);
             }
         }
 
@@ -67,7 +91,7 @@ int Warp::create_pipeline(const Option& opt)
             ncnn::MutexLockGuard guard(lock);
             if (spirv.empty())
             {
-                compile_spirv_module(warp_pack8_comp_data, sizeof(warp_pack8_comp_data), opt, spirv);
+                compile_spirv_module_cached(vkdev, warp_pack8_comp_data, sizeof(warp_pack8_comp_data), opt, spirv);
             }
         }
 
@@ -93,73 +117,143 @@ int Warp::destroy_pipeline(const Option& opt)
     return 0;
 }
 
+// blend the elempack lanes of the four neighbours
+static inline void bilinear_interpolate(const float* p0, const float* p1, const float* p2, const float* p3, float alpha, float beta, int elempack, float* outptr)
+{
+    int k = 0;
+#if __AVX__
+    {
+        __m256 _alpha = _mm256_set1_ps(alpha);
+        __m256 _beta = _mm256_set1_ps(beta);
+        __m256 _alpha1 = _mm256_set1_ps(1 - alpha);
+        __m256 _beta1 = _mm256_set1_ps(1 - beta);
+        for (; k + 7 < elempack; k += 8)
+        {
+            __m256 _v4 = _mm256_add_ps(_mm256_mul_ps(_mm256_loadu_ps(p0 + k), _alpha1), _mm256_mul_ps(_mm256_loadu_ps(p1 + k), _alpha));
+            __m256 _v5 = _mm256_add_ps(_mm256_mul_ps(_mm256_loadu_ps(p2 + k), _alpha1), _mm256_mul_ps(_mm256_loadu_ps(p3 + k), _alpha));
+            _mm256_storeu_ps(outptr + k, _mm256_add_ps(_mm256_mul_ps(_v4, _beta1), _mm256_mul_ps(_v5, _beta)));
+        }
+    }
+#endif // __AVX__
+#if __SSE2__
+    {
+        __m128 _alpha = _mm_set1_ps(alpha);
+        __m128 _beta = _mm_set1_ps(beta);
+        __m128 _alpha1 = _mm_set1_ps(1 - alpha);
+        __m128 _beta1 = _mm_set1_ps(1 - beta);
+        for (; k + 3 < elempack; k += 4)
+        {
+            __m128 _v4 = _mm_add_ps(_mm_mul_ps(_mm_loadu_ps(p0 + k), _alpha1), _mm_mul_ps(_mm_loadu_ps(p1 + k), _alpha));
+            __m128 _v5 = _mm_add_ps(_mm_mul_ps(_mm_loadu_ps(p2 + k), _alpha1), _mm_mul_ps(_mm_loadu_ps(p3 + k), _alpha));
+            _mm_storeu_ps(outptr + k, _mm_add_ps(_mm_mul_ps(_v4, _beta1), _mm_mul_ps(_v5, _beta)));
+        }
+    }
+#endif // __SSE2__
+#if __ARM_NEON
+    {
+        float32x4_t _alpha = vdupq_n_f32(alpha);
+        float32x4_t _beta = vdupq_n_f32(beta);
+        float32x4_t _alpha1 = vdupq_n_f32(1 - alpha);
+        float32x4_t _beta1 = vdupq_n_f32(1 - beta);
+        for (; k + 3 < elempack; k += 4)
+        {
+            float32x4_t _v4 = vaddq_f32(vmulq_f32(vld1q_f32(p0 + k), _alpha1), vmulq_f32(vld1q_f32(p1 + k), _alpha));
+            float32x4_t _v5 = vaddq_f32(vmulq_f32(vld1q_f32(p2 + k), _alpha1), vmulq_f32(vld1q_f32(p3 + k), _alpha));
+            vst1q_f32(outptr + k, vaddq_f32(vmulq_f32(_v4, _beta1), vmulq_f32(_v5, _beta)));
+        }
+    }
+#endif // __ARM_NEON
+    for (; k < elempack; k++)
+    {
+        float v4 = p0[k] * (1 - alpha) + p1[k] * alpha;
+        float v5 = p2[k] * (1 - alpha) + p3[k] * alpha;
+
+        outptr[k] = v4 * (1 - beta) + v5 * beta;
+    }
+}
+
 int Warp::forward(const std::vector<Mat>& bottom_blobs, std::vector<Mat>& top_blobs, const Option& opt) const
 {
     const Mat& image_blob = bottom_blobs[0];
-    const Mat& flow_blob = bottom_blobs[1];
 
     int w = image_blob.w;
     int h = image_blob.h;
     int channels = image_blob.c;
+    size_t elemsize = image_blob.elemsize;
+    int elempack = image_blob.elempack;
 
-    Mat& top_blob = top_blobs[0];
-    top_blob.create(w, h, channels);
-    if (top_blob.empty())
-        return -100;
-
-    #pragma omp parallel for num_threads(opt.num_threads)
-    for (int q = 0; q < channels; q++)
+    // flow is always read as two planar channels
+    Mat flow_blob = bottom_blobs[1];
+    if (flow_blob.elempack != 1)
     {
-        float* outptr = top_blob.channel(q);
+        Option opt_pack1 = opt;
+        opt_pack1.blob_allocator = opt.workspace_allocator;
 
-        const Mat image = image_blob.channel(q);
+        convert_packing(bottom_blobs[1], flow_blob, 1, opt_pack1);
+        if (flow_blob.empty())
+            return -100;
+    }
 
-        const float* fxptr = flow_blob.channel(0);
-        const float* fyptr = flow_blob.channel(1);
+    Mat& top_blob = top_blobs[0];
+    top_blob.create(w, h, channels, elemsize, elempack, opt.blob_allocator);
+    if (top_blob.empty())
+        return -100;
 
-        for (int y = 0; y < h; y++)
-        {
-            for (int x = 0; x < w; x++)
-            {
-                float flow_x = fxptr[0];
-                float flow_y = fyptr[0];
+    const float* imageptr = image_blob;
+    float* outptr0 = top_blob;
+    const size_t cstep = image_blob.cstep * elempack;
+    const size_t out_cstep = top_blob.cstep * elempack;
 
-                float sample_x = x + flow_x;
-                float sample_y = y + flow_y;
+    const float* fxptr0 = flow_blob.channel(0);
+    const float* fyptr0 = flow_blob.channel(1);
 
-                // bilinear interpolate
-                float v;
-                {
-                    int x0 = floor(sample_x);
-                    int y0 = floor(sample_y);
-                    int x1 = x0 + 1;
-                    int y1 = y0 + 1;
+#if RIFE_WARP_X86_AVX2
+    const bool use_avx2 = ncnn::cpu_support_x86_avx2();
+#endif
 
-                    x0 = std::min(std::max(x0, 0), w - 1);
-                    y0 = std::min(std::max(y0, 0), h - 1);
-                    x1 = std::min(std::max(x1, 0), w - 1);
-                    y1 = std::min(std::max(y1, 0), h - 1);
+    // split rows over all threads, every channel reuses the sample position of a pixel
+    #pragma omp parallel for num_threads(opt.num_threads)
+    for (int y = 0; y < h; y++)
+    {
+        const float* fxptr = fxptr0 + y * w;
+        const float* fyptr = fyptr0 + y * w;
 
-                    float alpha = sample_x - x0;
-                    float beta = sample_y - y0;
+        int x = 0;
+#if RIFE_WARP_X86_AVX2
+        if (elempack == 1 && use_avx2)
+        {
+            x = warp_row_pack1_avx2(imageptr, fxptr, fyptr, outptr0, w, h, y, channels, cstep, out_cstep);
+        }
+#endif // RIFE_WARP_X86_AVX2
+        for (; x < w; x++)
+        {
+            float sample_x = x + fxptr[x];
+            float sample_y = y + fyptr[x];
 
-                    float v0 = image.row(y0)[x0];
-                    float v1 = image.row(y0)[x1];
-                    float v2 = image.row(y1)[x0];
-                    float v3 = image.row(y1)[x1];
+            int x0 = floor(sample_x);
+            int y0 = floor(sample_y);
+            int x1 = x0 + 1;
+            int y1 = y0 + 1;
 
-                    float v4 = v0 * (1 - alpha) + v1 * alpha;
-                    float v5 = v2 * (1 - alpha) + v3 * alpha;
+            x0 = std::min(std::max(x0, 0), w - 1);
+            y0 = std::min(std::max(y0, 0), h - 1);
+            x1 = std::min(std::max(x1, 0), w - 1);
+            y1 = std::min(std::max(y1, 0), h - 1);
 
-                    v = v4 * (1 - beta) + v5 * beta;
-                }
+            float alpha = sample_x - x0;
+            float beta = sample_y - y0;
 
-                outptr[0] = v;
+            const int i0 = (y0 * w + x0) * elempack;
+            const int i1 = (y0 * w + x1) * elempack;
+            const int i2 = (y1 * w + x0) * elempack;
+            const int i3 = (y1 * w + x1) * elempack;
 
-                outptr += 1;
+            for (int q = 0; q < channels; q++)
+            {
+                const float* ptr = imageptr + q * cstep;
+                float* outptr = outptr0 + q * out_cstep + (y * w + x) * elempack;
 
-                fxptr += 1;
-                fyptr += 1;
+                bilinear_interpolate(ptr + i0, ptr + i1, ptr + i2, ptr + i3, alpha, beta, elempack, outptr);
             }
         }
     }
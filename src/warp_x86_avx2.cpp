@@ -0,0 +1,63 @@
+// rife implemented with ncnn library
+
+// built with avx2 but not fma, so the sums round like the scalar kernel in warp.cpp
+// only call after ncnn::cpu_support_x86_avx2()
+
+#include <stddef.h>
+#include <immintrin.h>
+
+// warp pack1 pixels of row y eight at a time, returns how many pixels were done
+int warp_row_pack1_avx2(const float* imageptr, const float* fxptr, const float* fyptr, float* outptr0, int w, int h, int y, int channels, size_t cstep, size_t out_cstep)
+{
+    const __m256 _lane = _mm256_set_ps(7.f, 6.f, 5.f, 4.f, 3.f, 2.f, 1.f, 0.f);
+    const __m256i _zero = _mm256_setzero_si256();
+    const __m256i _one = _mm256_set1_epi32(1);
+    const __m256i _wmax = _mm256_set1_epi32(w - 1);
+    const __m256i _hmax = _mm256_set1_epi32(h - 1);
+    const __m256i _w = _mm256_set1_epi32(w);
+    const __m256 _one_ps = _mm256_set1_ps(1.f);
+
+    int x = 0;
+    for (; x + 7 < w; x += 8)
+    {
+        __m256 _sample_x = _mm256_add_ps(_mm256_add_ps(_mm256_set1_ps((float)x), _lane), _mm256_loadu_ps(fxptr + x));
+        __m256 _sample_y = _mm256_add_ps(_mm256_set1_ps((float)y), _mm256_loadu_ps(fyptr + x));
+
+        __m256i _x0 = _mm256_cvttps_epi32(_mm256_floor_ps(_sample_x));
+        __m256i _y0 = _mm256_cvttps_epi32(_mm256_floor_ps(_sample_y));
+        __m256i _x1 = _mm256_add_epi32(_x0, _one);
+        __m256i _y1 = _mm256_add_epi32(_y0, _one);
+
+        _x0 = _mm256_min_epi32(_mm256_max_epi32(_x0, _zero), _wmax);
+        _y0 = _mm256_min_epi32(_mm256_max_epi32(_y0, _zero), _hmax);
+        _x1 = _mm256_min_epi32(_mm256_max_epi32(_x1, _zero), _wmax);
+        _y1 = _mm256_min_epi32(_mm256_max_epi32(_y1, _zero), _hmax);
+
+        __m256 _alpha = _mm256_sub_ps(_sample_x, _mm256_cvtepi32_ps(_x0));
+        __m256 _beta = _mm256_sub_ps(_sample_y, _mm256_cvtepi32_ps(_y0));
+        __m256 _alpha1 = _mm256_sub_ps(_one_ps, _alpha);
+        __m256 _beta1 = _mm256_sub_ps(_one_ps, _beta);
+
+        __m256i _i0 = _mm256_add_epi32(_mm256_mullo_epi32(_y0, _w), _x0);
+        __m256i _i1 = _mm256_add_epi32(_mm256_mullo_epi32(_y0, _w), _x1);
+        __m256i _i2 = _mm256_add_epi32(_mm256_mullo_epi32(_y1, _w), _x0);
+        __m256i _i3 = _mm256_add_epi32(_mm256_mullo_epi32(_y1, _w), _x1);
+
+        for (int q = 0; q < channels; q++)
+        {
+            const float* ptr = imageptr + q * cstep;
+
+            __m256 _v0 = _mm256_i32gather_ps(ptr, _i0, 4);
+            __m256 _v1 = _mm256_i32gather_ps(ptr, _i1, 4);
+            __m256 _v2 = _mm256_i32gather_ps(ptr, _i2, 4);
+            __m256 _v3 = _mm256_i32gather_ps(ptr, _i3, 4);
+
+            __m256 _v4 = _mm256_add_ps(_mm256_mul_ps(_v0, _alpha1), _mm256_mul_ps(_v1, _alpha));
+            __m256 _v5 = _mm256_add_ps(_mm256_mul_ps(_v2, _alpha1), _mm256_mul_ps(_v3, _alpha));
+
+            _mm256_storeu_ps(outptr0 + q * out_cstep + y * w + x, _mm256_add_ps(_mm256_mul_ps(_v4, _beta1), _mm256_mul_ps(_v5, _beta)));
+        }
+    }
+
+    return x;
+}
@@ -7,6 +7,12 @@
 #include "webp/decode.h"
 #include "webp/encode.h"
 
+// decoded pixel buffers are freed by the caller with the matching free
+#ifndef WEBP_IMAGE_MALLOC
+#define WEBP_IMAGE_MALLOC(sz) malloc(sz)
+#define WEBP_IMAGE_FREE(p) free(p)
+#endif
+
 unsigned char* webp_load(const unsigned char* buffer, int len, int* w, int* h, int* c)
 {
     unsigned char* pixeldata = 0;
@@ -21,7 +27,7 @@ unsigned char* webp_load(const unsigned char* buffer, int len, int* w, int* h, i
     int height = config.input.height;
     int channels = config.input.has_alpha ? 4 : 3;
 
-    pixeldata = (unsigned char*)malloc(width * height * channels);
+    pixeldata = (unsigned char*)WEBP_IMAGE_MALLOC(width * height * channels);
 
 #if _WIN32
     config.output.colorspace = channels == 4 ? MODE_BGRA : MODE_BGR;
@@ -36,7 +42,7 @@ unsigned char* webp_load(const unsigned char* buffer, int len, int* w, int* h, i
 
     if (WebPDecode(buffer, len, &config) != VP8_STATUS_OK)
     {
-        free(pixeldata);
+        WEBP_IMAGE_FREE(pixeldata);
         return NULL;
     }
 
@@ -4,6 +4,17 @@
 // image decoder and encoder with WIC
 #include <wincodec.h>
 
+// decoded pixel buffers are freed by the caller with the matching free
+#ifndef WIC_IMAGE_MALLOC
+#define WIC_IMAGE_MALLOC(sz) malloc(sz)
+#define WIC_IMAGE_FREE(p) free(p)
+#endif
+
+// decoded pixel buffers only, encoder scratch goes through WIC_IMAGE_MALLOC
+#ifndef WIC_IMAGE_FRAME_MALLOC
+#define WIC_IMAGE_FRAME_MALLOC(sz) WIC_IMAGE_MALLOC(sz)
+#endif
+
 unsigned char* wic_decode_image(const wchar_t* filepath, int* w, int* h, int* c)
 {
     IWICImagingFactory* factory = 0;
@@ -83,7 +94,7 @@ unsigned char* wic_decode_image(const wchar_t* filepath, int* w, int* h, int* c)
     if (lock->GetStride((UINT*)&stride))
         goto RETURN;
 
-    bgrdata = (unsigned char*)malloc(width * height * channels);
+    bgrdata = (unsigned char*)WIC_IMAGE_FRAME_MALLOC(width * height * channels);
     if (!bgrdata)
         goto RETURN;
 
@@ -151,7 +162,7 @@ int wic_encode_image(const wchar_t* filepath, int w, int h, int c, void* bgrdata
     if (!IsEqualGUID(format, c == 4 ? GUID_WICPixelFormat32bppBGRA : GUID_WICPixelFormat24bppBGR))
         goto RETURN;
 
-    data = (unsigned char*)malloc(h * stride);
+    data = (unsigned char*)WIC_IMAGE_MALLOC(h * stride);
     if (!data)
         goto RETURN;
 
@@ -174,7 +185,7 @@ int wic_encode_image(const wchar_t* filepath, int w, int h, int c, void* bgrdata
     ret = 1;
 
 RETURN:
-    if (data) free(data);
+    if (data) WIC_IMAGE_FREE(data);
     if (encoder) encoder->Release();
     if (frame) frame->Release();
     if (stream) stream->Release();
@@ -237,7 +248,7 @@ int wic_encode_jpeg_image(const wchar_t* filepath, int w, int h, int c, void* bg
     if (!IsEqualGUID(format, GUID_WICPixelFormat24bppBGR))
         goto RETURN;
 
-    data = (unsigned char*)malloc(h * stride);
+    data = (unsigned char*)WIC_IMAGE_MALLOC(h * stride);
     if (!data)
         goto RETURN;
 
@@ -260,7 +271,7 @@ int wic_encode_jpeg_image(const wchar_t* filepath, int w, int h, int c, void* bg
     ret = 1;
 
 RETURN:
-    if (data) free(data);
+    if (data) WIC_IMAGE_FREE(data);
     if (encoder) encoder->Release();
     if (frame) frame->Release();
     if (propertybag) propertybag->Release();